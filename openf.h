@@ -1,6 +1,12 @@
 #ifndef OPENF_H
 #define OPENF_H
 
+/* The POSIX paths use POSIX.1-2008 and Linux APIs (pread, fdatasync, CLOCK_MONOTONIC, rwlocks, copy_file_range,
+   ...) that strict -std=c99/c11 hides; this only takes effect when openf.h precedes other system headers */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -8,11 +14,68 @@ extern "C" {
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <math.h>
 
 /*-----------------------------------
   Configurations & Debug
 ------------------------------------*/
 
+#if defined(__unix__) || defined(__APPLE__)
+#define OPENF_POSIX 1
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#else
+#define OPENF_POSIX 0
+#endif
+
+/* Extent walking for sparse copies (glibc only exposes SEEK_DATA/SEEK_HOLE under _GNU_SOURCE) */
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+#define OPENF__SEEK_DATA SEEK_DATA
+#define OPENF__SEEK_HOLE SEEK_HOLE
+#elif defined(__linux__)
+#define OPENF__SEEK_DATA 3
+#define OPENF__SEEK_HOLE 4
+#endif
+
+/* Worker threads for batch and parallel operations (define as 0 to run everything serially) */
+#ifndef OPENF_THREADS
+#define OPENF_THREADS OPENF_POSIX
+#endif
+
+#if OPENF_THREADS
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* On GCC/Clang x86-64, kernels above SSE2 are compiled with target attributes and picked at runtime */
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define OPENF__X86_DISPATCH 1
+#define OPENF__TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#else
+#define OPENF__X86_DISPATCH 0
+#endif
+
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define OPENF_RESTRICT __restrict
+#else
+#define OPENF_RESTRICT
+#endif
+
 #ifndef OPENF_DEBUG
 #define OPENF_DEBUG 0
 #endif
@@ -41,7 +104,8 @@ typedef enum {
     OPENF_ERR_CLOSE_FAILED,
     OPENF_ERR_FILE_EXISTS,
     OPENF_ERR_FILE_NOT_FOUND,
-    OPENF_ERR_GENERAL_FAILURE
+    OPENF_ERR_GENERAL_FAILURE,
+    OPENF_ERR_INVALID_ARG
 } OpenF_Error;
 
 /*-----------------------------------
@@ -244,10 +308,122 @@ static inline OpenF_Error openf_get_size(const char* path, size_t* out_size) {
     return OPENF_OK;
 }
 
-/* Copy file */
+#if OPENF_POSIX
+/* Write every iovec in order, retrying short writes (the array is consumed) */
+static inline int openf__writev_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+/* Write all of buf at offset, retrying short writes */
+static inline int openf__pwrite_all(int fd, const void* buf, size_t len, off_t offset) {
+    const char* p = (const char*)buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+#endif
+
+#if OPENF_POSIX && defined(OPENF__SEEK_DATA)
+/* Copy only the data extents of a regular file; holes are left unwritten and the size is set with ftruncate.
+   *out_handled stays 0 when the source cannot be walked this way, so the caller falls back to a plain copy. */
+static inline OpenF_Error openf__copy_sparse(const char* src, const char* dest, int* out_handled) {
+    *out_handled = 0;
+    int in = open(src, O_RDONLY);
+    if (in < 0) return OPENF_ERR_FILE_NOT_FOUND;
+
+    struct stat st;
+    if (fstat(in, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(in);
+        return OPENF_OK;
+    }
+    off_t size = st.st_size;
+    off_t data = lseek(in, 0, OPENF__SEEK_DATA);
+    if (data < 0 && errno != ENXIO) {
+        // Extent queries unsupported here (e.g. EINVAL on old kernels)
+        close(in);
+        return OPENF_OK;
+    }
+    if (data < 0) data = size;  // ENXIO: no data at all, the whole file is a hole
+    *out_handled = 1;
+
+    int out = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out < 0) {
+        close(in);
+        return OPENF_ERR_OPEN_FAILED;
+    }
+
+    const size_t chunk = (size_t)1 << 20;
+    char* buffer = (char*)malloc(chunk);
+    OpenF_Error err = buffer ? OPENF_OK : OPENF_ERR_MEM_ALLOC;
+    off_t copied = 0;
+    while (err == OPENF_OK && data < size) {
+        off_t hole = lseek(in, data, OPENF__SEEK_HOLE);
+        if (hole < 0 || hole > size) hole = size;
+        for (off_t pos = data; pos < hole && err == OPENF_OK;) {
+            size_t want = (size_t)(hole - pos) < chunk ? (size_t)(hole - pos) : chunk;
+            ssize_t got = pread(in, buffer, want, pos);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) {
+                err = OPENF_ERR_READ_FAILED;
+            } else if (openf__pwrite_all(out, buffer, (size_t)got, pos) != 0) {
+                err = OPENF_ERR_WRITE_FAILED;
+            } else {
+                pos += got;
+                copied += got;
+            }
+        }
+        if (hole >= size) break;
+        data = lseek(in, hole, OPENF__SEEK_DATA);
+        if (data < 0) break;  // ENXIO: only a trailing hole remains
+    }
+    free(buffer);
+
+    // Extending the file creates the trailing hole; earlier gaps were never written
+    if (err == OPENF_OK && ftruncate(out, size) != 0) err = OPENF_ERR_WRITE_FAILED;
+    close(in);
+    if (close(out) != 0 && err == OPENF_OK) err = OPENF_ERR_CLOSE_FAILED;
+
+    OPENF_DBG_PRINT("openf_copy_file: copied %lld of %lld bytes as data from '%s'", (long long)copied, (long long)size, src);
+    (void)copied;
+
+    return err;
+}
+#endif
+
+/* Copy file (sparse-aware on POSIX: only data extents are read and written) */
 static inline OpenF_Error openf_copy_file(const char* src, const char* dest) {
     if (!src || !dest) return OPENF_ERR_NULL_ARG;
 
+#if OPENF_POSIX && defined(OPENF__SEEK_DATA)
+    int handled = 0;
+    OpenF_Error sparse_err = openf__copy_sparse(src, dest, &handled);
+    if (handled || sparse_err != OPENF_OK) return sparse_err;
+#endif
+
     FILE* fsrc = fopen(src, "rb");
     if (!fsrc) return OPENF_ERR_FILE_NOT_FOUND;
 
@@ -282,6 +458,100 @@ static inline OpenF_Error openf_copy_file(const char* src, const char* dest) {
     return OPENF_OK;
 }
 
+typedef struct {
+    unsigned long long blocks_total;    // Blocks in the source
+    unsigned long long blocks_written;  // Blocks that differed and were rewritten
+    unsigned long long bytes_written;
+} OpenF_SyncStats;
+
+/* Bring dest up to date with src by rewriting only the fixed-size blocks that differ (block_size 0 = 64 KB).
+   dest is updated in place and truncated or extended to the source size; it is created if missing. */
+static inline OpenF_Error openf_sync_file_ex(const char* src, const char* dest, size_t block_size, OpenF_SyncStats* out_stats) {
+    if (!src || !dest) return OPENF_ERR_NULL_ARG;
+    if (block_size == 0) block_size = 64 * 1024;
+    if (out_stats) memset(out_stats, 0, sizeof(*out_stats));
+#if OPENF_POSIX
+    int in = open(src, O_RDONLY);
+    if (in < 0) return OPENF_ERR_FILE_NOT_FOUND;
+    int out = open(dest, O_RDWR | O_CREAT, 0666);
+    if (out < 0) {
+        close(in);
+        return OPENF_ERR_OPEN_FAILED;
+    }
+
+    struct stat src_st, dest_st;
+    if (fstat(in, &src_st) != 0 || fstat(out, &dest_st) != 0) {
+        close(in);
+        close(out);
+        return OPENF_ERR_SEEK_FAILED;
+    }
+    off_t src_size = src_st.st_size, dest_size = dest_st.st_size;
+
+    char* a = (char*)malloc(block_size * 2);
+    if (!a) {
+        close(in);
+        close(out);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    char* b = a + block_size;
+
+    OpenF_Error err = OPENF_OK;
+    OpenF_SyncStats stats = {0, 0, 0};
+    for (off_t pos = 0; pos < src_size && err == OPENF_OK;) {
+        size_t len = (size_t)(src_size - pos) < block_size ? (size_t)(src_size - pos) : block_size;
+        ssize_t got = pread(in, a, len, pos);
+        if (got < 0 && errno == EINTR) continue;
+        if (got != (ssize_t)len) {
+            err = OPENF_ERR_READ_FAILED;
+            break;
+        }
+
+        // Bytes already in dest for this block; a shorter or differing block is rewritten whole
+        int same = 0;
+        if (pos + (off_t)len <= dest_size) {
+            ssize_t have;
+            do {
+                have = pread(out, b, len, pos);
+            } while (have < 0 && errno == EINTR);
+            same = have == (ssize_t)len && memcmp(a, b, len) == 0;
+        }
+        if (!same) {
+            if (openf__pwrite_all(out, a, len, pos) != 0) {
+                err = OPENF_ERR_WRITE_FAILED;
+                break;
+            }
+            stats.blocks_written++;
+            stats.bytes_written += len;
+        }
+        stats.blocks_total++;
+        pos += (off_t)len;
+    }
+    free(a);
+
+    if (err == OPENF_OK && dest_size != src_size && ftruncate(out, src_size) != 0) err = OPENF_ERR_WRITE_FAILED;
+    close(in);
+    if (close(out) != 0 && err == OPENF_OK) err = OPENF_ERR_CLOSE_FAILED;
+    if (out_stats) *out_stats = stats;
+
+    OPENF_DBG_PRINT("openf_sync_file: rewrote %llu of %llu blocks of '%s'", stats.blocks_written, stats.blocks_total, dest);
+
+    return err;
+#else
+    OpenF_Error err = openf_copy_file(src, dest);
+    size_t size = 0;
+    if (err == OPENF_OK && out_stats && openf_get_size(src, &size) == OPENF_OK) {
+        out_stats->blocks_total = out_stats->blocks_written = (size + block_size - 1) / block_size;
+        out_stats->bytes_written = size;
+    }
+    return err;
+#endif
+}
+
+/* Update dest in place from src, writing only changed 64 KB blocks */
+static inline OpenF_Error openf_sync_file(const char* src, const char* dest) {
+    return openf_sync_file_ex(src, dest, 0, NULL);
+}
+
 /* Merge two files (concatenate) */
 static inline OpenF_Error openf_merge_files(const char* out, const char* a, const char* b) {
     if (!out || !a || !b) return OPENF_ERR_NULL_ARG;
@@ -323,211 +593,790 @@ static inline OpenF_Error openf_merge_files(const char* out, const char* a, cons
 }
 
 /*-----------------------------------
-  BMP 24-bit image support
+  Parallel execution helpers
 ------------------------------------*/
 
-#pragma pack(push,1)
-typedef struct {
-    unsigned short bfType;      // 'BM'
-    unsigned int bfSize;
-    unsigned short bfReserved1;
-    unsigned short bfReserved2;
-    unsigned int bfOffBits;
-} OpenF_BMPFileHeader;
+typedef void (*OpenF_RangeFn)(void* ctx, size_t index);
+
+/* Number of online CPUs (at least 1) */
+static inline unsigned int openf_cpu_count(void) {
+#if OPENF_POSIX
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) return (unsigned int)n;
+#endif
+    return 1;
+}
+
+/*-----------------------------------
+  Task scheduler
+------------------------------------*/
+
+typedef void (*OpenF_TaskFn)(void* ctx);
 
+/* Counts unfinished tasks; zero-initialize, pass to openf_submit, then openf_wait on it */
 typedef struct {
-    unsigned int biSize;
-    int biWidth;
-    int biHeight;
-    unsigned short biPlanes;
-    unsigned short biBitCount;
-    unsigned int biCompression;
-    unsigned int biSizeImage;
-    int biXPelsPerMeter;
-    int biYPelsPerMeter;
-    unsigned int biClrUsed;
-    unsigned int biClrImportant;
-} OpenF_BMPInfoHeader;
-#pragma pack(pop)
+    unsigned long pending;
+} OpenF_TaskGroup;
 
 typedef struct {
-    unsigned int width;
-    unsigned int height;
-    unsigned char* pixels; // RGB 24-bit, row-major bottom-up
-} OpenF_Image;
+    unsigned int num_threads;   // Scheduler workers, 0 = CPU count
+    int pin_threads;            // Pin worker i to CPU (first_cpu + i) % CPU count (Linux only)
+    unsigned int first_cpu;
+} OpenF_InitOptions;
 
-/* Load uncompressed 24-bit BMP */
-static inline OpenF_Error openf_load_bmp(const char* path, OpenF_Image** out_image) {
-    if (!path || !out_image) return OPENF_ERR_NULL_ARG;
+typedef struct OpenF__Task {
+    OpenF_TaskFn fn;
+    void* ctx;
+    OpenF_TaskGroup* group;
+    struct OpenF__Task* next;   // Injection queue link
+    int heap;                   // Allocated by openf_submit; embedded tasks belong to their owner
+} OpenF__Task;
 
-    FILE* f = fopen(path, "rb");
-    if (!f) return OPENF_ERR_FILE_NOT_FOUND;
+static inline void openf__run_task(OpenF__Task* task) {
+    // An embedded task may be reused by its owner as soon as fn returns, so read it first
+    OpenF_TaskGroup* group = task->group;
+    int heap = task->heap;
+    task->fn(task->ctx);
+#if OPENF_THREADS
+    if (group) __atomic_sub_fetch(&group->pending, 1, __ATOMIC_RELEASE);
+#else
+    if (group) group->pending--;
+#endif
+    if (heap) free(task);
+}
 
-    OpenF_BMPFileHeader file_header;
-    if (fread(&file_header, sizeof(file_header), 1, f) != 1) {
-        fclose(f);
-        return OPENF_ERR_READ_FAILED;
-    }
+#if OPENF_THREADS
 
-    if (file_header.bfType != 0x4D42) { // 'BM'
-        fclose(f);
-        return OPENF_ERR_INVALID_FORMAT;
-    }
+/* Chase-Lev work-stealing deque: the owning worker pushes and pops at the bottom, thieves take from the
+   top. Fixed capacity; a full deque makes the submitter run the task itself. */
+#define OPENF__DEQUE_SIZE 4096
 
-    OpenF_BMPInfoHeader info_header;
-    if (fread(&info_header, sizeof(info_header), 1, f) != 1) {
-        fclose(f);
-        return OPENF_ERR_READ_FAILED;
-    }
+typedef struct {
+    OpenF__Task* buffer[OPENF__DEQUE_SIZE];
+    char pad0[64];
+    long long top;
+    char pad1[64];
+    long long bottom;
+    char pad2[64];
+} OpenF__Deque;
 
-    if (info_header.biBitCount != 24 || info_header.biCompression != 0) {
-        fclose(f);
-        return OPENF_ERR_UNSUPPORTED;
-    }
+typedef struct {
+    OpenF__Deque deque;
+    pthread_t thread;
+    unsigned int index;
+    unsigned int seed;          // Victim selection
+} OpenF__Worker;
 
-    if (info_header.biWidth <= 0 || info_header.biHeight == 0) {
-        fclose(f);
-        return OPENF_ERR_INVALID_FORMAT;
-    }
+/* All scheduler state is static, so each translation unit that includes openf.h has its own scheduler */
+typedef struct {
+    int running;
+    int stop;
+    unsigned int count;
+    unsigned int started;       // Threads actually running (count unless startup failed)
+    OpenF__Worker* workers;
+    pthread_mutex_t lock;       // Injection queue and sleeping workers
+    pthread_cond_t wake;
+    OpenF__Task* inject_head;
+    OpenF__Task* inject_tail;
+    unsigned long inject_count;
+    unsigned long long epoch;   // Bumped on every submit so a worker never sleeps past new work
+    unsigned int sleepers;
+} OpenF__Scheduler;
 
-    unsigned int width = (unsigned int)info_header.biWidth;
-    unsigned int height = (unsigned int)(info_header.biHeight < 0 ? -info_header.biHeight : info_header.biHeight);
+static inline OpenF__Scheduler* openf__scheduler(void) {
+    static OpenF__Scheduler scheduler;
+    return &scheduler;
+}
 
-    size_t row_size = ((width * 3 + 3) / 4) * 4;
-    size_t pixel_data_size = row_size * height;
+/* Worker running on this thread, NULL outside the pool */
+static inline OpenF__Worker** openf__current_worker(void) {
+    static __thread OpenF__Worker* current;
+    return &current;
+}
 
-    unsigned char* pixels = (unsigned char*)malloc(width * height * 3);
-    if (!pixels) {
-        fclose(f);
-        return OPENF_ERR_MEM_ALLOC;
-    }
+static inline int openf__deque_push(OpenF__Deque* d, OpenF__Task* task) {
+    long long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    long long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    if (b - t >= OPENF__DEQUE_SIZE) return 0;
+    __atomic_store_n(&d->buffer[b & (OPENF__DEQUE_SIZE - 1)], task, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);  // Publishes the task to thieves
+    return 1;
+}
 
-    if (fseek(f, file_header.bfOffBits, SEEK_SET) != 0) {
-        free(pixels);
-        fclose(f);
-        return OPENF_ERR_SEEK_FAILED;
+static inline OpenF__Task* openf__deque_pop(OpenF__Deque* d) {
+    long long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
     }
-
-    unsigned char* row_data = (unsigned char*)malloc(row_size);
-    if (!row_data) {
-        free(pixels);
-        fclose(f);
-        return OPENF_ERR_MEM_ALLOC;
+    OpenF__Task* task = __atomic_load_n(&d->buffer[b & (OPENF__DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+        // Last item: race any thief for it
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) task = NULL;
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
     }
+    return task;
+}
 
-    int top_down = info_header.biHeight < 0 ? 1 : 0;
+static inline OpenF__Task* openf__deque_steal(OpenF__Deque* d) {
+    long long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return NULL;
+    OpenF__Task* task = __atomic_load_n(&d->buffer[t & (OPENF__DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return NULL;
+    return task;
+}
 
-    for (unsigned int y = 0; y < height; y++) {
-        if (fread(row_data, 1, row_size, f) != row_size) {
-            free(row_data);
-            free(pixels);
-            fclose(f);
-            return OPENF_ERR_READ_FAILED;
-        }
-        unsigned int target_y = top_down ? y : (height - 1 - y);
-        for (unsigned int x = 0; x < width; x++) {
-            unsigned int dst_idx = (target_y * width + x) * 3;
-            unsigned int src_idx = x * 3;
-            // BMP stores as BGR, convert to RGB
-            pixels[dst_idx + 0] = row_data[src_idx + 2];
-            pixels[dst_idx + 1] = row_data[src_idx + 1];
-            pixels[dst_idx + 2] = row_data[src_idx + 0];
+/* Own deque first, then the injection queue, then steal from a random victim onward */
+static inline OpenF__Task* openf__find_task(OpenF__Scheduler* s, OpenF__Worker* self) {
+    OpenF__Task* task = self ? openf__deque_pop(&self->deque) : NULL;
+    if (task) return task;
+    if (__atomic_load_n(&s->inject_count, __ATOMIC_ACQUIRE) > 0) {
+        pthread_mutex_lock(&s->lock);
+        task = s->inject_head;
+        if (task) {
+            s->inject_head = task->next;
+            if (!s->inject_head) s->inject_tail = NULL;
+            __atomic_sub_fetch(&s->inject_count, 1, __ATOMIC_RELEASE);
         }
+        pthread_mutex_unlock(&s->lock);
+        if (task) return task;
     }
-
-    free(row_data);
-    fclose(f);
-
-    OpenF_Image* img = (OpenF_Image*)malloc(sizeof(OpenF_Image));
-    if (!img) {
-        free(pixels);
-        return OPENF_ERR_MEM_ALLOC;
+    unsigned int start = 0;
+    if (self) {
+        self->seed = self->seed * 1103515245u + 12345u;
+        start = (self->seed >> 16) % s->count;
     }
+    for (unsigned int i = 0; i < s->count; i++) {
+        OpenF__Worker* victim = &s->workers[(start + i) % s->count];
+        if (victim == self) continue;
+        task = openf__deque_steal(&victim->deque);
+        if (task) return task;
+    }
+    return NULL;
+}
 
-    img->width = width;
-    img->height = height;
-    img->pixels = pixels;
-    *out_image = img;
-
-    OPENF_DBG_PRINT("openf_load_bmp: loaded '%s' %ux%u pixels", path, width, height);
-
-    return OPENF_OK;
+static inline void openf__wake_worker(OpenF__Scheduler* s) {
+    __atomic_add_fetch(&s->epoch, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&s->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&s->lock);
+        pthread_cond_signal(&s->wake);
+        pthread_mutex_unlock(&s->lock);
+    }
 }
 
-/* Save RGB 24-bit BMP (uncompressed) */
-static inline OpenF_Error openf_save_bmp(const char* path, const OpenF_Image* image) {
-    if (!path || !image || !image->pixels) return OPENF_ERR_NULL_ARG;
+static inline void* openf__scheduler_worker(void* arg) {
+    OpenF__Worker* self = (OpenF__Worker*)arg;
+    OpenF__Scheduler* s = openf__scheduler();
+    *openf__current_worker() = self;
+    for (;;) {
+        unsigned long long seen = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+        OpenF__Task* task = openf__find_task(s, self);
+        if (task) {
+            openf__run_task(task);
+            continue;
+        }
+        pthread_mutex_lock(&s->lock);
+        if (s->stop) {
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        // Announce sleeping before re-checking the epoch; a submitter bumps the epoch before checking sleepers
+        __atomic_add_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST) == seen) pthread_cond_wait(&s->wake, &s->lock);
+        __atomic_sub_fetch(&s->sleepers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&s->lock);
+    }
+    *openf__current_worker() = NULL;
+    return NULL;
+}
 
-    FILE* f = fopen(path, "wb");
-    if (!f) return OPENF_ERR_OPEN_FAILED;
+static inline void openf__pin_thread(unsigned int cpu) {
+#if defined(__linux__) && defined(SYS_sched_setaffinity)
+    unsigned long mask[16];
+    memset(mask, 0, sizeof(mask));
+    cpu %= (unsigned int)(sizeof(mask) * 8);
+    mask[cpu / (sizeof(unsigned long) * 8)] |= 1ul << (cpu % (sizeof(unsigned long) * 8));
+    syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+#else
+    (void)cpu;
+#endif
+}
 
-    unsigned int width = image->width;
-    unsigned int height = image->height;
+typedef struct {
+    OpenF__Worker* worker;
+    int pin;
+    unsigned int cpu;
+} OpenF__WorkerStart;
 
-    size_t row_size = ((width * 3 + 3) / 4) * 4;
-    size_t pixel_data_size = row_size * height;
-    size_t file_size = sizeof(OpenF_BMPFileHeader) + sizeof(OpenF_BMPInfoHeader) + pixel_data_size;
+static inline void* openf__scheduler_thread(void* arg) {
+    OpenF__WorkerStart start = *(OpenF__WorkerStart*)arg;
+    free(arg);
+    if (start.pin) openf__pin_thread(start.cpu);
+    return openf__scheduler_worker(start.worker);
+}
 
-    OpenF_BMPFileHeader file_header = {0};
-    file_header.bfType = 0x4D42; // 'BM'
-    file_header.bfSize = (unsigned int)file_size;
-    file_header.bfOffBits = sizeof(OpenF_BMPFileHeader) + sizeof(OpenF_BMPInfoHeader);
+static inline int openf__scheduler_running(void) {
+    return __atomic_load_n(&openf__scheduler()->running, __ATOMIC_ACQUIRE);
+}
 
-    OpenF_BMPInfoHeader info_header = {0};
-    info_header.biSize = sizeof(OpenF_BMPInfoHeader);
-    info_header.biWidth = (int)width;
-    info_header.biHeight = (int)height;
-    info_header.biPlanes = 1;
-    info_header.biBitCount = 24;
-    info_header.biCompression = 0;
-    info_header.biSizeImage = (unsigned int)pixel_data_size;
-    info_header.biXPelsPerMeter = 0;
-    info_header.biYPelsPerMeter = 0;
+static inline void openf__scheduler_stop(void) {
+    OpenF__Scheduler* s = openf__scheduler();
+    if (!s->running) return;
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    for (unsigned int i = 0; i < s->started; i++) pthread_join(s->workers[i].thread, NULL);
+    __atomic_store_n(&s->running, 0, __ATOMIC_RELEASE);
 
-    if (fwrite(&file_header, sizeof(file_header), 1, f) != 1) {
-        fclose(f);
-        return OPENF_ERR_WRITE_FAILED;
+    // Workers drain everything before exiting; anything submitted during shutdown runs here
+    for (unsigned int i = 0; i < s->count; i++) {
+        OpenF__Task* task;
+        while ((task = openf__deque_steal(&s->workers[i].deque)) != NULL) openf__run_task(task);
     }
-
-    if (fwrite(&info_header, sizeof(info_header), 1, f) != 1) {
-        fclose(f);
-        return OPENF_ERR_WRITE_FAILED;
+    while (s->inject_head) {
+        OpenF__Task* task = s->inject_head;
+        s->inject_head = task->next;
+        openf__run_task(task);
     }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+    free(s->workers);
+    memset(s, 0, sizeof(*s));
+}
 
-    unsigned char* row_data = (unsigned char*)malloc(row_size);
-    if (!row_data) {
-        fclose(f);
-        return OPENF_ERR_MEM_ALLOC;
+static inline OpenF_Error openf__scheduler_start(const OpenF_InitOptions* options) {
+    OpenF__Scheduler* s = openf__scheduler();
+    if (s->running) return OPENF_OK;
+    unsigned int cpus = openf_cpu_count();
+    unsigned int count = options && options->num_threads ? options->num_threads : cpus;
+
+    memset(s, 0, sizeof(*s));
+    s->workers = (OpenF__Worker*)calloc(count, sizeof(OpenF__Worker));
+    if (!s->workers) return OPENF_ERR_MEM_ALLOC;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    for (unsigned int i = 0; i < count; i++) {
+        s->workers[i].index = i;
+        s->workers[i].seed = 0x9E3779B9u * (i + 1);
     }
+    s->count = count;
 
-    for (unsigned int y = 0; y < height; y++) {
-        memset(row_data, 0, row_size);
-        unsigned int src_y = height - 1 - y;
-        for (unsigned int x = 0; x < width; x++) {
-            size_t dst_idx = x * 3;
-            size_t src_idx = (src_y * width + x) * 3;
-            // Convert RGB to BGR for BMP
-            row_data[dst_idx + 0] = image->pixels[src_idx + 2];
-            row_data[dst_idx + 1] = image->pixels[src_idx + 1];
-            row_data[dst_idx + 2] = image->pixels[src_idx + 0];
+    OpenF_Error err = OPENF_OK;
+    unsigned int started = 0;
+    __atomic_store_n(&s->running, 1, __ATOMIC_RELEASE);
+    for (; started < count; started++) {
+        OpenF__WorkerStart* start = (OpenF__WorkerStart*)malloc(sizeof(OpenF__WorkerStart));
+        if (!start) {
+            err = OPENF_ERR_MEM_ALLOC;
+            break;
         }
-        if (fwrite(row_data, 1, row_size, f) != row_size) {
-            free(row_data);
-            fclose(f);
-            return OPENF_ERR_WRITE_FAILED;
+        start->worker = &s->workers[started];
+        start->pin = options && options->pin_threads;
+        start->cpu = ((options ? options->first_cpu : 0) + started) % cpus;
+        if (pthread_create(&s->workers[started].thread, NULL, openf__scheduler_thread, start) != 0) {
+            free(start);
+            err = OPENF_ERR_GENERAL_FAILURE;
+            break;
         }
     }
+    s->started = started;
+    if (err != OPENF_OK) openf__scheduler_stop();
+    return err;
+}
 
-    free(row_data);
-
-    if (fclose(f) != 0) return OPENF_ERR_CLOSE_FAILED;
+#endif
 
-    OPENF_DBG_PRINT("openf_save_bmp: saved '%s' %ux%u pixels", path, width, height);
+/* Queue a filled-in task without allocating (runs it immediately when no scheduler is running) */
+static inline void openf__submit_task(OpenF__Task* task) {
+#if OPENF_THREADS
+    OpenF__Scheduler* s = openf__scheduler();
+    if (!openf__scheduler_running()) {
+        openf__run_task(task);
+        return;
+    }
+    task->next = NULL;
+    if (task->group) __atomic_add_fetch(&task->group->pending, 1, __ATOMIC_RELAXED);
 
-    return OPENF_OK;
+    OpenF__Worker* self = *openf__current_worker();
+    if (!self || !openf__deque_push(&self->deque, task)) {
+        if (self) {
+            // Own deque is full: running it now keeps the queue bounded
+            openf__run_task(task);
+            return;
+        }
+        pthread_mutex_lock(&s->lock);
+        if (s->inject_tail) {
+            s->inject_tail->next = task;
+        } else {
+            s->inject_head = task;
+        }
+        s->inject_tail = task;
+        __atomic_add_fetch(&s->inject_count, 1, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&s->lock);
+    }
+    openf__wake_worker(s);
+#else
+    openf__run_task(task);
+#endif
 }
 
-/* Free image struct */
+/* Queue fn(ctx) on the scheduler started by openf_init_ex (runs it immediately when none is running).
+   group, if given, counts the task until it finishes. */
+static inline OpenF_Error openf_submit(OpenF_TaskGroup* group, OpenF_TaskFn fn, void* ctx) {
+    if (!fn) return OPENF_ERR_NULL_ARG;
+#if OPENF_THREADS
+    OpenF__Task* task = openf__scheduler_running() ? (OpenF__Task*)malloc(sizeof(OpenF__Task)) : NULL;
+#else
+    OpenF__Task* task = NULL;
+#endif
+    if (!task) {
+        fn(ctx);
+        return OPENF_OK;
+    }
+    task->fn = fn;
+    task->ctx = ctx;
+    task->group = group;
+    task->heap = 1;
+    openf__submit_task(task);
+    return OPENF_OK;
+}
+
+/* Wait until every task in group has finished, running queued tasks meanwhile */
+static inline void openf_wait(OpenF_TaskGroup* group) {
+    if (!group) return;
+#if OPENF_THREADS
+    OpenF__Scheduler* s = openf__scheduler();
+    unsigned int idle = 0;
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        OpenF__Task* task = openf__scheduler_running() ? openf__find_task(s, *openf__current_worker()) : NULL;
+        if (task) {
+            openf__run_task(task);
+            idle = 0;
+        } else if (++idle < 64) {
+            sched_yield();
+        } else {
+            // The remaining tasks are running elsewhere: back off instead of spinning
+            struct timespec ts = {0, 50000};
+            nanosleep(&ts, NULL);
+        }
+    }
+#endif
+}
+
+typedef struct {
+    OpenF_RangeFn fn;
+    void* ctx;
+    size_t count;
+    size_t next;
+} OpenF__ParallelJob;
+
+static inline void* openf__parallel_worker(void* arg) {
+    OpenF__ParallelJob* job = (OpenF__ParallelJob*)arg;
+#if OPENF_THREADS
+    for (;;) {
+        size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->count) break;
+        job->fn(job->ctx, i);
+    }
+#else
+    for (size_t i = 0; i < job->count; i++) job->fn(job->ctx, i);
+#endif
+    return NULL;
+}
+
+static inline void openf__parallel_task(void* ctx) {
+    openf__parallel_worker(ctx);
+}
+
+/* Run fn(ctx, i) for i in [0, count) on up to num_threads threads (0 = one per CPU); the caller takes part.
+   Uses the scheduler's workers when openf_init_ex started them, otherwise short-lived threads. */
+static inline void openf__parallel_for(size_t count, unsigned int num_threads, OpenF_RangeFn fn, void* ctx) {
+    if (count == 0) return;
+    if (num_threads == 0) num_threads = openf_cpu_count();
+    if (num_threads > count) num_threads = (unsigned int)count;
+
+    OpenF__ParallelJob job = {fn, ctx, count, 0};
+
+#if OPENF_THREADS
+    OpenF__Scheduler* s = openf__scheduler();
+    if (openf__scheduler_running()) {
+        // Helpers go through the shared scheduler instead of fresh threads
+        if (num_threads > s->count + 1) num_threads = s->count + 1;
+        OpenF_TaskGroup group = {0};
+        for (unsigned int t = 0; t < num_threads - 1; t++) openf_submit(&group, openf__parallel_task, &job);
+        openf__parallel_worker(&job);
+        openf_wait(&group);
+        return;
+    }
+
+    pthread_t* threads = NULL;
+    unsigned int started = 0;
+    if (num_threads > 1) threads = (pthread_t*)malloc(sizeof(pthread_t) * (num_threads - 1));
+    if (threads) {
+        for (unsigned int t = 0; t < num_threads - 1; t++) {
+            if (pthread_create(&threads[started], NULL, openf__parallel_worker, &job) != 0) break;
+            started++;
+        }
+    }
+    openf__parallel_worker(&job);
+    for (unsigned int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+    free(threads);
+#else
+    (void)num_threads;
+    openf__parallel_worker(&job);
+#endif
+}
+
+/*-----------------------------------
+  Parallel multi-file merge
+------------------------------------*/
+
+typedef struct {
+    unsigned int num_threads;   // Copy workers, 0 = CPU count
+} OpenF_MergeOptions;
+
+#define OPENF__MERGE_CHUNK ((size_t)64 << 20)     // Large inputs are split so one file does not serialize the merge
+
+#if OPENF_POSIX
+typedef struct {
+    size_t input;               // Index into paths
+    off_t src_offset;
+    off_t dst_offset;
+    size_t length;
+} OpenF__MergePiece;
+
+typedef struct {
+    const char* const* paths;
+    const OpenF__MergePiece* pieces;
+    int out_fd;
+    OpenF_Error* errors;        // One per piece
+} OpenF__MergeJob;
+
+/* Copy one range between descriptors: copy_file_range in the kernel where available, else pread/pwrite */
+static inline OpenF_Error openf__copy_range(int in, off_t src_offset, int out, off_t dst_offset, size_t length) {
+#if defined(__linux__) && defined(SYS_copy_file_range)
+    long long in_off = src_offset, out_off = dst_offset;
+    while (length > 0) {
+        long n = syscall(SYS_copy_file_range, in, &in_off, out, &out_off, length, 0u);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;  // Unsupported here (ENOSYS, EXDEV, EINVAL) or unexpected EOF: finish by hand
+        length -= (size_t)n;
+    }
+    src_offset = (off_t)in_off;
+    dst_offset = (off_t)out_off;
+    if (length == 0) return OPENF_OK;
+#endif
+    const size_t chunk = (size_t)1 << 20;
+    char* buffer = (char*)malloc(length < chunk ? length : chunk);
+    if (!buffer) return OPENF_ERR_MEM_ALLOC;
+    OpenF_Error err = OPENF_OK;
+    while (length > 0 && err == OPENF_OK) {
+        ssize_t got = pread(in, buffer, length < chunk ? length : chunk, src_offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            err = OPENF_ERR_READ_FAILED;  // Input shrank since it was sized
+        } else if (openf__pwrite_all(out, buffer, (size_t)got, dst_offset) != 0) {
+            err = OPENF_ERR_WRITE_FAILED;
+        } else {
+            src_offset += got;
+            dst_offset += got;
+            length -= (size_t)got;
+        }
+    }
+    free(buffer);
+    return err;
+}
+
+static inline void openf__merge_piece(void* ctx, size_t i) {
+    OpenF__MergeJob* job = (OpenF__MergeJob*)ctx;
+    const OpenF__MergePiece* piece = &job->pieces[i];
+    int in = open(job->paths[piece->input], O_RDONLY);
+    if (in < 0) {
+        job->errors[i] = OPENF_ERR_FILE_NOT_FOUND;
+        return;
+    }
+    job->errors[i] = openf__copy_range(in, piece->src_offset, job->out_fd, piece->dst_offset, piece->length);
+    close(in);
+}
+#endif
+
+/* Concatenate n files into out. Inputs are sized up front, the output is preallocated, and every input
+   is copied straight to its final offset by a pool of workers. Inputs must be regular files (pipes and devices
+   have no size to plan with): anything else fails with OPENF_ERR_INVALID_ARG. */
+static inline OpenF_Error openf_merge_many(const char* out, const char* const* paths, size_t n, const OpenF_MergeOptions* options) {
+    if (!out || (!paths && n > 0)) return OPENF_ERR_NULL_ARG;
+    for (size_t i = 0; i < n; i++) {
+        if (!paths[i]) return OPENF_ERR_NULL_ARG;
+    }
+#if OPENF_POSIX
+    off_t* sizes = (off_t*)malloc(sizeof(off_t) * (n ? n : 1));
+    if (!sizes) return OPENF_ERR_MEM_ALLOC;
+    off_t total = 0;
+    size_t piece_count = 0;
+    for (size_t i = 0; i < n; i++) {
+        struct stat st;
+        if (stat(paths[i], &st) != 0) {
+            free(sizes);
+            return OPENF_ERR_FILE_NOT_FOUND;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            OPENF_DBG_PRINT("openf_merge_many: '%s' is not a regular file", paths[i]);
+            free(sizes);
+            return OPENF_ERR_INVALID_ARG;
+        }
+        sizes[i] = st.st_size;
+        total += st.st_size;
+        piece_count += ((size_t)st.st_size + OPENF__MERGE_CHUNK - 1) / OPENF__MERGE_CHUNK;
+    }
+
+    OpenF__MergePiece* pieces = (OpenF__MergePiece*)malloc(sizeof(OpenF__MergePiece) * (piece_count ? piece_count : 1));
+    OpenF_Error* errors = (OpenF_Error*)malloc(sizeof(OpenF_Error) * (piece_count ? piece_count : 1));
+    if (!pieces || !errors) {
+        free(sizes);
+        free(pieces);
+        free(errors);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    size_t k = 0;
+    off_t dst = 0;
+    for (size_t i = 0; i < n; i++) {
+        for (off_t pos = 0; pos < sizes[i]; pos += (off_t)OPENF__MERGE_CHUNK, k++) {
+            pieces[k].input = i;
+            pieces[k].src_offset = pos;
+            pieces[k].dst_offset = dst + pos;
+            pieces[k].length = (size_t)(sizes[i] - pos) < OPENF__MERGE_CHUNK ? (size_t)(sizes[i] - pos) : OPENF__MERGE_CHUNK;
+        }
+        dst += sizes[i];
+    }
+    free(sizes);
+
+    int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        free(pieces);
+        free(errors);
+        return OPENF_ERR_OPEN_FAILED;
+    }
+    // Reserve the whole output so concurrent writers do not fragment it; size it even where fallocate is missing
+#if defined(__linux__)
+    if (total > 0) (void)posix_fallocate(fd, 0, total);
+#endif
+    OpenF_Error err = ftruncate(fd, total) == 0 ? OPENF_OK : OPENF_ERR_WRITE_FAILED;
+
+    if (err == OPENF_OK) {
+        OpenF__MergeJob job = {paths, pieces, fd, errors};
+        openf__parallel_for(piece_count, options ? options->num_threads : 0, openf__merge_piece, &job);
+        for (size_t i = 0; i < piece_count && err == OPENF_OK; i++) err = errors[i];
+    }
+    free(pieces);
+    free(errors);
+    if (close(fd) != 0 && err == OPENF_OK) err = OPENF_ERR_CLOSE_FAILED;
+    if (err != OPENF_OK) return err;
+
+    OPENF_DBG_PRINT("openf_merge_many: merged %zu files (%lld bytes) into '%s'", n, (long long)total, out);
+
+    return OPENF_OK;
+#else
+    (void)options;
+    FILE* fout = fopen(out, "wb");
+    if (!fout) return OPENF_ERR_OPEN_FAILED;
+    char buffer[8192];
+    for (size_t i = 0; i < n; i++) {
+        FILE* fin = fopen(paths[i], "rb");
+        if (!fin) {
+            fclose(fout);
+            return OPENF_ERR_FILE_NOT_FOUND;
+        }
+        size_t bytes;
+        while ((bytes = fread(buffer, 1, sizeof(buffer), fin)) > 0) {
+            if (fwrite(buffer, 1, bytes, fout) != bytes) {
+                fclose(fin);
+                fclose(fout);
+                return OPENF_ERR_WRITE_FAILED;
+            }
+        }
+        int failed = ferror(fin);
+        fclose(fin);
+        if (failed) {
+            fclose(fout);
+            return OPENF_ERR_READ_FAILED;
+        }
+    }
+    if (fclose(fout) != 0) return OPENF_ERR_CLOSE_FAILED;
+    return OPENF_OK;
+#endif
+}
+
+/*-----------------------------------
+  CPU feature detection
+------------------------------------*/
+
+typedef enum {
+    OPENF_SIMD_AUTO = -1,       // Best level the CPU supports (openf_set_simd_level only)
+    OPENF_SIMD_SCALAR = 0,      // Plain C kernels
+    OPENF_SIMD_SSE2,
+    OPENF_SIMD_SSE4_2,          // SSE4.2 and SSSE3
+    OPENF_SIMD_AVX2,
+    OPENF_SIMD_AVX512           // Detected only; runs the AVX2 kernels
+} OpenF_SimdLevel;
+
+struct OpenF__ResizeCoeffs;
+
+/* Hot kernels with several implementations. The SIMD entries return how many pixels (or bytes) they handled
+   so callers finish the remainder with their own scalar loop. */
+typedef struct {
+    int state;                  // 0 = not selected, 1 = selecting, 2 = ready
+    OpenF_SimdLevel level;      // Active level
+    OpenF_SimdLevel detected;   // What the CPU supports
+    unsigned int (*swap_rb24)(const unsigned char* OPENF_RESTRICT src, unsigned char* OPENF_RESTRICT dst, unsigned int width);
+    unsigned int (*halve_rgba)(const unsigned char* a, const unsigned char* b, unsigned int src_w, unsigned char* out,
+                               unsigned int out_w);
+    size_t (*compare)(const unsigned char* a, const unsigned char* b, size_t n, unsigned int ch, unsigned char* mask,
+                      unsigned int* io_max, unsigned long long* io_sse);
+    unsigned int (*crc32c)(unsigned int crc, const unsigned char* p, size_t len);
+    // Fixed-point weighted sum of n byte rows (convolution and the vertical resize pass); returns bytes done
+    size_t (*taps)(const unsigned char* const* rows, const short* w, unsigned int n, size_t len, unsigned char* out);
+    unsigned int (*resize_h)(const unsigned char* src, unsigned int src_width, unsigned char* dst, unsigned int out_width,
+                             const struct OpenF__ResizeCoeffs* c, unsigned int channels);
+    // Pixel format conversion through RGBA rows; which = 0 gray, 1 Y, 2 U, 3 V; chroma returns samples done
+    unsigned int (*rgb24_to_rgba)(const unsigned char* src, unsigned char* rgba, unsigned int width, int bgr);
+    unsigned int (*rgba_to_rgb24)(const unsigned char* rgba, unsigned char* dst, unsigned int width, int bgr);
+    unsigned int (*rgba_to_plane)(const unsigned char* rgba, unsigned char* out, unsigned int width, int which);
+    unsigned int (*rgba_to_chroma)(const unsigned char* row0, const unsigned char* row1, unsigned int width,
+                                   unsigned char* u, unsigned char* v);
+    unsigned int (*yuv_to_rgba)(const unsigned char* y, const unsigned char* u, const unsigned char* v, int layout,
+                                unsigned char* rgba, unsigned int width);
+} OpenF__Dispatch;
+
+/* Static like the scheduler, so each translation unit that includes openf.h selects (and can override) its own table */
+static inline OpenF__Dispatch* openf__dispatch_state(void) {
+    static OpenF__Dispatch dispatch;
+    return &dispatch;
+}
+
+/* Fill the table for level; defined with the kernels near the end of the header */
+static inline void openf__dispatch_select(OpenF__Dispatch* d, OpenF_SimdLevel level);
+
+static inline OpenF_SimdLevel openf__simd_detect(void) {
+#if OPENF__X86_DISPATCH
+    // libgcc/compiler-rt also check that the OS saves the wider registers (XGETBV) before reporting AVX
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return OPENF_SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2")) return OPENF_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("ssse3")) return OPENF_SIMD_SSE4_2;
+    return OPENF_SIMD_SSE2;
+#elif defined(__SSE2__) || defined(_M_X64)
+    return OPENF_SIMD_SSE2;
+#else
+    return OPENF_SIMD_SCALAR;
+#endif
+}
+
+/* OPENF_SIMD=scalar|sse2|sse4.2|avx2|avx512 caps the level; anything else is ignored */
+static inline OpenF_SimdLevel openf__simd_env_level(OpenF_SimdLevel detected) {
+    static const char* const names[] = {"scalar", "sse2", "sse4.2", "avx2", "avx512"};
+    const char* env = getenv("OPENF_SIMD");
+    if (!env || !*env) return detected;
+    for (int i = 0; i < 5; i++) {
+        if (strcmp(env, names[i]) == 0) return (OpenF_SimdLevel)i < detected ? (OpenF_SimdLevel)i : detected;
+    }
+    OPENF_DBG_PRINT("OPENF_SIMD: unknown level '%s' ignored", env);
+    return detected;
+}
+
+/* Kernel table, selected on first use (or by openf_init); racing first callers wait for the winner */
+static inline const OpenF__Dispatch* openf__dispatch(void) {
+    OpenF__Dispatch* d = openf__dispatch_state();
+    if (__atomic_load_n(&d->state, __ATOMIC_ACQUIRE) == 2) return d;
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&d->state, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        d->detected = openf__simd_detect();
+        openf__dispatch_select(d, openf__simd_env_level(d->detected));
+        OPENF_DBG_PRINT("openf: SIMD level %d (detected %d)", (int)d->level, (int)d->detected);
+        __atomic_store_n(&d->state, 2, __ATOMIC_RELEASE);
+    } else {
+        while (__atomic_load_n(&d->state, __ATOMIC_ACQUIRE) != 2) {
+        }
+    }
+    return d;
+}
+
+/*-----------------------------------
+  BMP 24-bit image support
+------------------------------------*/
+
+#pragma pack(push,1)
+typedef struct {
+    unsigned short bfType;      // 'BM'
+    unsigned int bfSize;
+    unsigned short bfReserved1;
+    unsigned short bfReserved2;
+    unsigned int bfOffBits;
+} OpenF_BMPFileHeader;
+
+typedef struct {
+    unsigned int biSize;
+    int biWidth;
+    int biHeight;
+    unsigned short biPlanes;
+    unsigned short biBitCount;
+    unsigned int biCompression;
+    unsigned int biSizeImage;
+    int biXPelsPerMeter;
+    int biYPelsPerMeter;
+    unsigned int biClrUsed;
+    unsigned int biClrImportant;
+} OpenF_BMPInfoHeader;
+#pragma pack(pop)
+
+typedef enum {
+    OPENF_FORMAT_RGB24 = 0,     // Packed R,G,B
+    OPENF_FORMAT_BGR24,         // Packed B,G,R (BMP byte order)
+    OPENF_FORMAT_RGBA32,        // Packed R,G,B,A
+    OPENF_FORMAT_GRAY8,         // Single full-range luma channel
+    OPENF_FORMAT_YUV444,        // Planar Y, U, V at full resolution (BT.601, limited range)
+    OPENF_FORMAT_YUV420,        // Planar Y, then U and V at half resolution (I420)
+    OPENF_FORMAT_NV12,          // Planar Y, then interleaved U/V at half resolution
+    OPENF_FORMAT_RGB_PLANAR     // Planar R, G, B at full resolution
+} OpenF_PixelFormat;
+
+typedef struct {
+    unsigned int width;
+    unsigned int height;
+    unsigned char* pixels; // Row-major, top row first; planes follow each other for planar formats
+    OpenF_PixelFormat format; // Zero-initialized images are RGB24
+} OpenF_Image;
+
+/* Bytes per pixel for packed formats, 0 for planar ones */
+static inline unsigned int openf_format_bytes_per_pixel(OpenF_PixelFormat format) {
+    switch (format) {
+        case OPENF_FORMAT_RGB24:
+        case OPENF_FORMAT_BGR24: return 3;
+        case OPENF_FORMAT_RGBA32: return 4;
+        case OPENF_FORMAT_GRAY8: return 1;
+        default: return 0;
+    }
+}
+
+/* Size of the pixel buffer for an image of the given dimensions and format (0 for unknown formats) */
+static inline size_t openf_image_buffer_size(unsigned int width, unsigned int height, OpenF_PixelFormat format) {
+    size_t luma = (size_t)width * height;
+    size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    switch (format) {
+        case OPENF_FORMAT_YUV444:
+        case OPENF_FORMAT_RGB_PLANAR: return luma * 3;
+        case OPENF_FORMAT_YUV420:
+        case OPENF_FORMAT_NV12: return luma + chroma * 2;
+        default: return luma * openf_format_bytes_per_pixel(format);
+    }
+}
+
+/* Free image struct */
 static inline void openf_free_image(OpenF_Image** image) {
     if (!image || !*image) return;
     if ((*image)->pixels) free((*image)->pixels);
@@ -536,19 +1385,6496 @@ static inline void openf_free_image(OpenF_Image** image) {
     OPENF_DBG_PRINT("openf_free_image: image freed");
 }
 
+/* Allocate an uninitialized image of the given size and format, freed with openf_free_image */
+static inline OpenF_Error openf_create_image(unsigned int width, unsigned int height, OpenF_PixelFormat format,
+                                             OpenF_Image** out_image) {
+    if (!out_image) return OPENF_ERR_NULL_ARG;
+    size_t size = openf_image_buffer_size(width, height, format);
+    if (width == 0 || height == 0 || size == 0) return OPENF_ERR_INVALID_ARG;
+
+    OpenF_Image* img = (OpenF_Image*)malloc(sizeof(OpenF_Image));
+    if (!img) return OPENF_ERR_MEM_ALLOC;
+    img->pixels = (unsigned char*)malloc(size);
+    if (!img->pixels) {
+        free(img);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    img->width = width;
+    img->height = height;
+    img->format = format;
+    *out_image = img;
+    return OPENF_OK;
+}
+
+/* BMP row kernels: one function per pixel format, stamped out with constant strides and channel offsets so
+   the compiler emits a tight (and vectorizable) loop for each instead of indexing per pixel at runtime */
+typedef void (*OpenF__RowKernel)(const unsigned char* OPENF_RESTRICT src, unsigned char* OPENF_RESTRICT dst, unsigned int width);
+
+#define OPENF__ROW_KERNEL(name, SRC_BYTES, DST_BYTES, BODY)                                                   \
+    static inline void name(const unsigned char* OPENF_RESTRICT src, unsigned char* OPENF_RESTRICT dst,     \
+                            unsigned int width) {                                                            \
+        for (unsigned int x = 0; x < width; x++, src += SRC_BYTES, dst += DST_BYTES) { BODY }               \
+    }
+
+static inline void openf__row_copy_bgr24(const unsigned char* OPENF_RESTRICT src, unsigned char* OPENF_RESTRICT dst, unsigned int width) {
+    memcpy(dst, src, (size_t)width * 3);
+}
+
+static inline unsigned int openf__swap_rb24_none(const unsigned char* OPENF_RESTRICT src, unsigned char* OPENF_RESTRICT dst, unsigned int width) {
+    (void)src;
+    (void)dst;
+    (void)width;
+    return 0;
+}
+
+#if OPENF__X86_DISPATCH
+/* Five pixels per 16-byte shuffle; the 16th byte is stored unswapped and rewritten by the next step */
+OPENF__TARGET("ssse3")
+static inline unsigned int openf__swap_rb24_ssse3(const unsigned char* OPENF_RESTRICT src, unsigned char* OPENF_RESTRICT dst, unsigned int width) {
+    const __m128i shuf = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    unsigned int x = 0;
+    for (; x + 6 <= width; x += 5) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 3 * (size_t)x));
+        _mm_storeu_si128((__m128i*)(dst + 3 * (size_t)x), _mm_shuffle_epi8(v, shuf));
+    }
+    return x;
+}
+
+/* Ten pixels per step: the same shuffle on two 15-byte runs, one per 128-bit lane */
+OPENF__TARGET("avx2")
+static inline unsigned int openf__swap_rb24_avx2(const unsigned char* OPENF_RESTRICT src, unsigned char* OPENF_RESTRICT dst, unsigned int width) {
+    const __m256i shuf = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15,
+                                          2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    unsigned int x = 0;
+    for (; x + 11 <= width; x += 10) {
+        const unsigned char* s = src + 3 * (size_t)x;
+        unsigned char* d = dst + 3 * (size_t)x;
+        __m256i v = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)s));
+        v = _mm256_shuffle_epi8(_mm256_inserti128_si256(v, _mm_loadu_si128((const __m128i*)(s + 15)), 1), shuf);
+        _mm_storeu_si128((__m128i*)d, _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i*)(d + 15), _mm256_extracti128_si256(v, 1));
+    }
+    return x;
+}
+#endif
+
+// BMP (BGR24) -> image format, and swapping RGB24 <-> BGR24 in either direction
+static inline void openf__row_swap_rb24(const unsigned char* OPENF_RESTRICT src, unsigned char* OPENF_RESTRICT dst, unsigned int width) {
+    unsigned int x = openf__dispatch()->swap_rb24(src, dst, width);
+    for (src += 3 * (size_t)x, dst += 3 * (size_t)x; x < width; x++, src += 3, dst += 3) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+    }
+}
+OPENF__ROW_KERNEL(openf__row_bgr24_to_rgba32, 3, 4, dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0]; dst[3] = 255;)
+OPENF__ROW_KERNEL(openf__row_bgr24_to_gray8, 3, 1, dst[0] = (unsigned char)((77 * src[2] + 150 * src[1] + 29 * src[0] + 128) >> 8);)
+// Image format -> BMP (BGR24)
+OPENF__ROW_KERNEL(openf__row_rgba32_to_bgr24, 4, 3, dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0];)
+OPENF__ROW_KERNEL(openf__row_gray8_to_bgr24, 1, 3, dst[0] = src[0]; dst[1] = src[0]; dst[2] = src[0];)
+
+/* Kernel converting BMP rows into format (to_bmp = 0) or format rows into BMP rows (to_bmp = 1); NULL if unsupported */
+static inline OpenF__RowKernel openf__bmp_row_kernel(OpenF_PixelFormat format, int to_bmp) {
+    switch (format) {
+        case OPENF_FORMAT_RGB24:
+            return openf__row_swap_rb24;
+        case OPENF_FORMAT_BGR24:
+            return openf__row_copy_bgr24;
+        case OPENF_FORMAT_RGBA32:
+            return to_bmp ? openf__row_rgba32_to_bgr24 : openf__row_bgr24_to_rgba32;
+        case OPENF_FORMAT_GRAY8:
+            return to_bmp ? openf__row_gray8_to_bgr24 : openf__row_bgr24_to_gray8;
+        default:
+            return NULL;
+    }
+}
+
+/* Load uncompressed 24-bit BMP as format (RGB24, BGR24, RGBA32 or GRAY8), converting while reading */
+static inline OpenF_Error openf_load_bmp_as(const char* path, OpenF_PixelFormat format, OpenF_Image** out_image) {
+    if (!path || !out_image) return OPENF_ERR_NULL_ARG;
+    OpenF__RowKernel kernel = openf__bmp_row_kernel(format, 0);
+    if (!kernel) return OPENF_ERR_UNSUPPORTED;
+
+    FILE* f = fopen(path, "rb");
+    if (!f) return OPENF_ERR_FILE_NOT_FOUND;
+
+    OpenF_BMPFileHeader file_header;
+    if (fread(&file_header, sizeof(file_header), 1, f) != 1) {
+        fclose(f);
+        return OPENF_ERR_READ_FAILED;
+    }
+
+    if (file_header.bfType != 0x4D42) { // 'BM'
+        fclose(f);
+        return OPENF_ERR_INVALID_FORMAT;
+    }
+
+    OpenF_BMPInfoHeader info_header;
+    if (fread(&info_header, sizeof(info_header), 1, f) != 1) {
+        fclose(f);
+        return OPENF_ERR_READ_FAILED;
+    }
+
+    if (info_header.biBitCount != 24 || info_header.biCompression != 0) {
+        fclose(f);
+        return OPENF_ERR_UNSUPPORTED;
+    }
+
+    if (info_header.biWidth <= 0 || info_header.biHeight == 0) {
+        fclose(f);
+        return OPENF_ERR_INVALID_FORMAT;
+    }
+
+    unsigned int width = (unsigned int)info_header.biWidth;
+    unsigned int height = (unsigned int)(info_header.biHeight < 0 ? -info_header.biHeight : info_header.biHeight);
+
+    size_t row_size = ((width * 3 + 3) / 4) * 4;
+
+    OpenF_Image* img;
+    OpenF_Error err = openf_create_image(width, height, format, &img);
+    if (err != OPENF_OK) {
+        fclose(f);
+        return err;
+    }
+
+    if (fseek(f, file_header.bfOffBits, SEEK_SET) != 0) {
+        openf_free_image(&img);
+        fclose(f);
+        return OPENF_ERR_SEEK_FAILED;
+    }
+
+    unsigned char* row_data = (unsigned char*)malloc(row_size);
+    if (!row_data) {
+        openf_free_image(&img);
+        fclose(f);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+
+    // Bottom-up files fill the image from its last row; the orientation is resolved once, not per pixel
+    ptrdiff_t stride = (ptrdiff_t)width * openf_format_bytes_per_pixel(format);
+    unsigned char* dst = img->pixels;
+    if (info_header.biHeight > 0) {
+        dst += (ptrdiff_t)(height - 1) * stride;
+        stride = -stride;
+    }
+
+    for (unsigned int y = 0; y < height; y++, dst += stride) {
+        if (fread(row_data, 1, row_size, f) != row_size) {
+            free(row_data);
+            openf_free_image(&img);
+            fclose(f);
+            return OPENF_ERR_READ_FAILED;
+        }
+        kernel(row_data, dst, width);
+    }
+
+    free(row_data);
+    fclose(f);
+    *out_image = img;
+
+    OPENF_DBG_PRINT("openf_load_bmp: loaded '%s' %ux%u pixels", path, width, height);
+
+    return OPENF_OK;
+}
+
+/* Load uncompressed 24-bit BMP */
+static inline OpenF_Error openf_load_bmp(const char* path, OpenF_Image** out_image) {
+    return openf_load_bmp_as(path, OPENF_FORMAT_RGB24, out_image);
+}
+
+/* Save 24-bit BMP (uncompressed) from an RGB24, BGR24, RGBA32 (alpha dropped) or GRAY8 image */
+static inline OpenF_Error openf_save_bmp(const char* path, const OpenF_Image* image) {
+    if (!path || !image || !image->pixels) return OPENF_ERR_NULL_ARG;
+    OpenF__RowKernel kernel = openf__bmp_row_kernel(image->format, 1);
+    if (!kernel) return OPENF_ERR_UNSUPPORTED;
+
+    FILE* f = fopen(path, "wb");
+    if (!f) return OPENF_ERR_OPEN_FAILED;
+
+    unsigned int width = image->width;
+    unsigned int height = image->height;
+
+    size_t row_size = ((width * 3 + 3) / 4) * 4;
+    size_t pixel_data_size = row_size * height;
+    size_t file_size = sizeof(OpenF_BMPFileHeader) + sizeof(OpenF_BMPInfoHeader) + pixel_data_size;
+
+    OpenF_BMPFileHeader file_header = {0};
+    file_header.bfType = 0x4D42; // 'BM'
+    file_header.bfSize = (unsigned int)file_size;
+    file_header.bfOffBits = sizeof(OpenF_BMPFileHeader) + sizeof(OpenF_BMPInfoHeader);
+
+    OpenF_BMPInfoHeader info_header = {0};
+    info_header.biSize = sizeof(OpenF_BMPInfoHeader);
+    info_header.biWidth = (int)width;
+    info_header.biHeight = (int)height;
+    info_header.biPlanes = 1;
+    info_header.biBitCount = 24;
+    info_header.biCompression = 0;
+    info_header.biSizeImage = (unsigned int)pixel_data_size;
+    info_header.biXPelsPerMeter = 0;
+    info_header.biYPelsPerMeter = 0;
+
+    if (fwrite(&file_header, sizeof(file_header), 1, f) != 1) {
+        fclose(f);
+        return OPENF_ERR_WRITE_FAILED;
+    }
+
+    if (fwrite(&info_header, sizeof(info_header), 1, f) != 1) {
+        fclose(f);
+        return OPENF_ERR_WRITE_FAILED;
+    }
+
+    // Padding bytes are zeroed once; kernels only ever write the pixel part of the row
+    unsigned char* row_data = (unsigned char*)calloc(1, row_size);
+    if (!row_data) {
+        fclose(f);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+
+    // Rows are written bottom-up, starting from the image's last row
+    ptrdiff_t stride = (ptrdiff_t)width * openf_format_bytes_per_pixel(image->format);
+    const unsigned char* src = image->pixels + (ptrdiff_t)(height - 1) * stride;
+
+    for (unsigned int y = 0; y < height; y++, src -= stride) {
+        kernel(src, row_data, width);
+        if (fwrite(row_data, 1, row_size, f) != row_size) {
+            free(row_data);
+            fclose(f);
+            return OPENF_ERR_WRITE_FAILED;
+        }
+    }
+
+    free(row_data);
+
+    if (fclose(f) != 0) return OPENF_ERR_CLOSE_FAILED;
+
+    OPENF_DBG_PRINT("openf_save_bmp: saved '%s' %ux%u pixels", path, width, height);
+
+    return OPENF_OK;
+}
+
+/*-----------------------------------
+  QOI (Quite OK Image)
+------------------------------------*/
+
+#define OPENF__QOI_OP_INDEX 0x00
+#define OPENF__QOI_OP_DIFF 0x40
+#define OPENF__QOI_OP_LUMA 0x80
+#define OPENF__QOI_OP_RUN 0xC0
+#define OPENF__QOI_OP_RGB 0xFE
+#define OPENF__QOI_OP_RGBA 0xFF
+#define OPENF__QOI_HEADER_SIZE 14
+#define OPENF__QOI_PADDING 8                    // End marker: seven 0x00 then 0x01
+#define OPENF__QOI_PIXELS_MAX 400000000u        // Same limit as the reference implementation
+#define OPENF__QOI_BUFFER (64 * 1024)           // Encoder output is flushed in chunks of this size
+
+#define OPENF__QOI_HASH(r, g, b, a) (((r) * 3 + (g) * 5 + (b) * 7 + (a) * 11) & 63)
+
+static inline void openf__qoi_write32(unsigned char* p, unsigned int v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static inline unsigned int openf__qoi_read32(const unsigned char* p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+/* Decode a QOI byte stream into an RGB24 or RGBA32 image, matching the channel count in the header */
+static inline OpenF_Error openf__qoi_decode(const unsigned char* data, size_t size, OpenF_Image** out_image) {
+    if (size < OPENF__QOI_HEADER_SIZE + OPENF__QOI_PADDING || memcmp(data, "qoif", 4) != 0) return OPENF_ERR_INVALID_FORMAT;
+    unsigned int width = openf__qoi_read32(data + 4);
+    unsigned int height = openf__qoi_read32(data + 8);
+    unsigned int channels = data[12];
+    if (width == 0 || height == 0 || (channels != 3 && channels != 4) || data[13] > 1 ||
+        height >= OPENF__QOI_PIXELS_MAX / width) {
+        return OPENF_ERR_INVALID_FORMAT;
+    }
+
+    OpenF_Image* img = NULL;
+    OpenF_Error err = openf_create_image(width, height, channels == 4 ? OPENF_FORMAT_RGBA32 : OPENF_FORMAT_RGB24, &img);
+    if (err != OPENF_OK) return err;
+
+    // Ops are at most 5 bytes and the stream ends with 8 bytes of padding, so checking p against end suffices
+    const unsigned char* p = data + OPENF__QOI_HEADER_SIZE;
+    const unsigned char* end = data + size - OPENF__QOI_PADDING;
+    unsigned char* out = img->pixels;
+    unsigned char* out_end = out + (size_t)width * height * channels;
+    unsigned char index[64 * 4];
+    memset(index, 0, sizeof(index));
+    unsigned int r = 0, g = 0, b = 0, a = 255;
+
+    while (out < out_end) {
+        if (p >= end) {
+            openf_free_image(&img);
+            return OPENF_ERR_INVALID_FORMAT;
+        }
+        unsigned int op = *p++;
+        size_t run = 1;
+        if (op == OPENF__QOI_OP_RGB) {
+            r = p[0];
+            g = p[1];
+            b = p[2];
+            p += 3;
+        } else if (op == OPENF__QOI_OP_RGBA) {
+            r = p[0];
+            g = p[1];
+            b = p[2];
+            a = p[3];
+            p += 4;
+        } else {
+            switch (op & 0xC0) {
+                case OPENF__QOI_OP_INDEX: {
+                    const unsigned char* e = index + op * 4;
+                    r = e[0];
+                    g = e[1];
+                    b = e[2];
+                    a = e[3];
+                    break;
+                }
+                case OPENF__QOI_OP_DIFF:
+                    r = (r + ((op >> 4) & 3) - 2) & 0xFF;
+                    g = (g + ((op >> 2) & 3) - 2) & 0xFF;
+                    b = (b + (op & 3) - 2) & 0xFF;
+                    break;
+                case OPENF__QOI_OP_LUMA: {
+                    unsigned int next = *p++;
+                    unsigned int dg = (op & 0x3F) - 32;
+                    r = (r + dg + ((next >> 4) & 0x0F) - 8) & 0xFF;
+                    g = (g + dg) & 0xFF;
+                    b = (b + dg + (next & 0x0F) - 8) & 0xFF;
+                    break;
+                }
+                default:
+                    run = (op & 0x3F) + 1;
+                    break;
+            }
+        }
+
+        unsigned char* e = index + OPENF__QOI_HASH(r, g, b, a) * 4;
+        e[0] = (unsigned char)r;
+        e[1] = (unsigned char)g;
+        e[2] = (unsigned char)b;
+        e[3] = (unsigned char)a;
+
+        if ((size_t)(out_end - out) < run * channels) run = (size_t)(out_end - out) / channels;
+        if (channels == 4) {
+            for (size_t i = 0; i < run; i++, out += 4) {
+                out[0] = (unsigned char)r;
+                out[1] = (unsigned char)g;
+                out[2] = (unsigned char)b;
+                out[3] = (unsigned char)a;
+            }
+        } else {
+            for (size_t i = 0; i < run; i++, out += 3) {
+                out[0] = (unsigned char)r;
+                out[1] = (unsigned char)g;
+                out[2] = (unsigned char)b;
+            }
+        }
+    }
+
+    *out_image = img;
+    return OPENF_OK;
+}
+
+/* Load a QOI image as RGB24 or RGBA32 */
+static inline OpenF_Error openf_load_qoi(const char* path, OpenF_Image** out_image) {
+    if (!path || !out_image) return OPENF_ERR_NULL_ARG;
+
+    OpenF_File file;
+    OpenF_Error err = openf_read(path, &file);
+    if (err != OPENF_OK) return err;
+
+    err = openf__qoi_decode((const unsigned char*)file.data, file.size, out_image);
+    openf_free_file(&file);
+    if (err != OPENF_OK) return err;
+
+    OPENF_DBG_PRINT("openf_load_qoi: loaded '%s' %ux%u pixels", path, (*out_image)->width, (*out_image)->height);
+
+    return OPENF_OK;
+}
+
+/* Save an RGB24 or RGBA32 image as QOI, encoding into a fixed buffer that is flushed as it fills */
+static inline OpenF_Error openf_save_qoi(const char* path, const OpenF_Image* image) {
+    if (!path || !image || !image->pixels) return OPENF_ERR_NULL_ARG;
+    if (image->format != OPENF_FORMAT_RGB24 && image->format != OPENF_FORMAT_RGBA32) return OPENF_ERR_UNSUPPORTED;
+    unsigned int width = image->width, height = image->height;
+    if (width == 0 || height == 0 || height >= OPENF__QOI_PIXELS_MAX / width) return OPENF_ERR_INVALID_ARG;
+    unsigned int channels = image->format == OPENF_FORMAT_RGBA32 ? 4 : 3;
+
+    unsigned char* buf = (unsigned char*)malloc(OPENF__QOI_BUFFER);
+    if (!buf) return OPENF_ERR_MEM_ALLOC;
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        free(buf);
+        return OPENF_ERR_OPEN_FAILED;
+    }
+
+    memcpy(buf, "qoif", 4);
+    openf__qoi_write32(buf + 4, width);
+    openf__qoi_write32(buf + 8, height);
+    buf[12] = (unsigned char)channels;
+    buf[13] = 0;  // sRGB with linear alpha
+    size_t pos = OPENF__QOI_HEADER_SIZE;
+
+    unsigned char index[64 * 4];
+    memset(index, 0, sizeof(index));
+    unsigned int pr = 0, pg = 0, pb = 0, pa = 255;
+    unsigned int run = 0;
+    const unsigned char* px = image->pixels;
+    const unsigned char* px_end = px + (size_t)width * height * channels;
+
+    for (; px < px_end; px += channels) {
+        unsigned int r = px[0], g = px[1], b = px[2];
+        unsigned int a = channels == 4 ? px[3] : 255;
+
+        if (r == pr && g == pg && b == pb && a == pa) {
+            if (++run == 62) {
+                buf[pos++] = (unsigned char)(OPENF__QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+        } else {
+            if (run > 0) {
+                buf[pos++] = (unsigned char)(OPENF__QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+            unsigned int h = OPENF__QOI_HASH(r, g, b, a);
+            unsigned char* e = index + h * 4;
+            if (e[0] == r && e[1] == g && e[2] == b && e[3] == a) {
+                buf[pos++] = (unsigned char)(OPENF__QOI_OP_INDEX | h);
+            } else {
+                e[0] = (unsigned char)r;
+                e[1] = (unsigned char)g;
+                e[2] = (unsigned char)b;
+                e[3] = (unsigned char)a;
+                if (a == pa) {
+                    int dr = (signed char)(unsigned char)(r - pr);
+                    int dg = (signed char)(unsigned char)(g - pg);
+                    int db = (signed char)(unsigned char)(b - pb);
+                    int dr_dg = dr - dg, db_dg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        buf[pos++] = (unsigned char)(OPENF__QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+                    } else if (dr_dg >= -8 && dr_dg <= 7 && dg >= -32 && dg <= 31 && db_dg >= -8 && db_dg <= 7) {
+                        buf[pos++] = (unsigned char)(OPENF__QOI_OP_LUMA | (dg + 32));
+                        buf[pos++] = (unsigned char)(((dr_dg + 8) << 4) | (db_dg + 8));
+                    } else {
+                        buf[pos++] = OPENF__QOI_OP_RGB;
+                        buf[pos++] = (unsigned char)r;
+                        buf[pos++] = (unsigned char)g;
+                        buf[pos++] = (unsigned char)b;
+                    }
+                } else {
+                    buf[pos++] = OPENF__QOI_OP_RGBA;
+                    buf[pos++] = (unsigned char)r;
+                    buf[pos++] = (unsigned char)g;
+                    buf[pos++] = (unsigned char)b;
+                    buf[pos++] = (unsigned char)a;
+                }
+            }
+            pr = r;
+            pg = g;
+            pb = b;
+            pa = a;
+        }
+
+        // Room for a pending run byte plus the largest op
+        if (pos > OPENF__QOI_BUFFER - 6) {
+            if (fwrite(buf, 1, pos, f) != pos) {
+                free(buf);
+                fclose(f);
+                return OPENF_ERR_WRITE_FAILED;
+            }
+            pos = 0;
+        }
+    }
+    if (run > 0) buf[pos++] = (unsigned char)(OPENF__QOI_OP_RUN | (run - 1));
+    static const unsigned char padding[OPENF__QOI_PADDING] = {0, 0, 0, 0, 0, 0, 0, 1};
+    memcpy(buf + pos, padding, sizeof(padding));
+    pos += sizeof(padding);
+
+    int write_failed = fwrite(buf, 1, pos, f) != pos;
+    free(buf);
+    if (write_failed) {
+        fclose(f);
+        return OPENF_ERR_WRITE_FAILED;
+    }
+    if (fclose(f) != 0) return OPENF_ERR_CLOSE_FAILED;
+
+    OPENF_DBG_PRINT("openf_save_qoi: saved '%s' %ux%u pixels", path, width, height);
+
+    return OPENF_OK;
+}
+
+/*-----------------------------------
+  Batch image loading
+------------------------------------*/
+
+typedef struct {
+    unsigned int num_threads;   // Worker count, 0 = two per CPU so I/O waits overlap with decoding
+    OpenF_Error* errors;        // Optional, receives one result code per path
+} OpenF_BatchOptions;
+
+typedef struct {
+    const char* const* paths;
+    OpenF_Image** images;
+    OpenF_Error* errors;
+} OpenF__BmpBatch;
+
+static inline void openf__load_bmp_batch_one(void* ctx, size_t i) {
+    OpenF__BmpBatch* batch = (OpenF__BmpBatch*)ctx;
+    batch->images[i] = NULL;
+    batch->errors[i] = openf_load_bmp(batch->paths[i], &batch->images[i]);
+}
+
+/* Load many BMPs concurrently; failed entries are left NULL. Returns the first failure in path order, if any */
+static inline OpenF_Error openf_load_bmp_batch(const char* const* paths, size_t n, OpenF_Image** out_images,
+                                               const OpenF_BatchOptions* opts) {
+    if ((!paths || !out_images) && n > 0) return OPENF_ERR_NULL_ARG;
+    if (n == 0) return OPENF_OK;
+
+    OpenF_Error* errors = opts ? opts->errors : NULL;
+    OpenF_Error* owned_errors = NULL;
+    if (!errors) {
+        owned_errors = (OpenF_Error*)malloc(sizeof(OpenF_Error) * n);
+        if (!owned_errors) return OPENF_ERR_MEM_ALLOC;
+        errors = owned_errors;
+    }
+
+    unsigned int num_threads = opts ? opts->num_threads : 0;
+    if (num_threads == 0) num_threads = openf_cpu_count() * 2;
+
+    OpenF__BmpBatch batch = {paths, out_images, errors};
+    openf__parallel_for(n, num_threads, openf__load_bmp_batch_one, &batch);
+
+    OpenF_Error result = OPENF_OK;
+    for (size_t i = 0; i < n; i++) {
+        if (errors[i] != OPENF_OK) {
+            result = errors[i];
+            break;
+        }
+    }
+
+    free(owned_errors);
+
+    OPENF_DBG_PRINT("openf_load_bmp_batch: loaded %zu files on %u threads", n, num_threads);
+
+    return result;
+}
+
+/*-----------------------------------
+  Zero-copy image views
+------------------------------------*/
+
+typedef struct {
+    const unsigned char* data;  // First (top) row of pixels
+    unsigned int width;
+    unsigned int height;
+    ptrdiff_t stride;           // Bytes from one row to the next, negative for bottom-up storage
+    OpenF_PixelFormat format;
+    void* map_base;             // Backing mapping, released by openf_release_view
+    size_t map_size;
+} OpenF_ImageView;
+
+/* Map an uncompressed 24-bit BMP read-only and describe its pixels in place (BGR, padded rows) */
+static inline OpenF_Error openf_view_bmp(const char* path, OpenF_ImageView* out_view) {
+    if (!path || !out_view) return OPENF_ERR_NULL_ARG;
+    memset(out_view, 0, sizeof(*out_view));
+#if OPENF_POSIX
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return OPENF_ERR_FILE_NOT_FOUND;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return OPENF_ERR_SEEK_FAILED;
+    }
+
+    size_t map_size = (size_t)st.st_size;
+    if (map_size < sizeof(OpenF_BMPFileHeader) + sizeof(OpenF_BMPInfoHeader)) {
+        close(fd);
+        return OPENF_ERR_INVALID_FORMAT;
+    }
+
+    void* base = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return OPENF_ERR_READ_FAILED;
+
+    OpenF_BMPFileHeader file_header;
+    OpenF_BMPInfoHeader info_header;
+    memcpy(&file_header, base, sizeof(file_header));
+    memcpy(&info_header, (const unsigned char*)base + sizeof(file_header), sizeof(info_header));
+
+    OpenF_Error err = OPENF_OK;
+    if (file_header.bfType != 0x4D42) {
+        err = OPENF_ERR_INVALID_FORMAT;
+    } else if (info_header.biBitCount != 24 || info_header.biCompression != 0) {
+        err = OPENF_ERR_UNSUPPORTED;
+    } else if (info_header.biWidth <= 0 || info_header.biHeight == 0) {
+        err = OPENF_ERR_INVALID_FORMAT;
+    }
+
+    unsigned int width = 0, height = 0;
+    size_t row_size = 0;
+    if (err == OPENF_OK) {
+        width = (unsigned int)info_header.biWidth;
+        height = (unsigned int)(info_header.biHeight < 0 ? -info_header.biHeight : info_header.biHeight);
+        row_size = (((size_t)width * 3 + 3) / 4) * 4;
+        if (file_header.bfOffBits > map_size ||
+            (map_size - file_header.bfOffBits) / row_size < height) {
+            err = OPENF_ERR_INVALID_FORMAT;
+        }
+    }
+
+    if (err != OPENF_OK) {
+        munmap(base, map_size);
+        return err;
+    }
+
+    const unsigned char* pixels = (const unsigned char*)base + file_header.bfOffBits;
+    int top_down = info_header.biHeight < 0 ? 1 : 0;
+
+    out_view->width = width;
+    out_view->height = height;
+    out_view->format = OPENF_FORMAT_BGR24;
+    if (top_down) {
+        out_view->data = pixels;
+        out_view->stride = (ptrdiff_t)row_size;
+    } else {
+        out_view->data = pixels + (height - 1) * row_size;
+        out_view->stride = -(ptrdiff_t)row_size;
+    }
+    out_view->map_base = base;
+    out_view->map_size = map_size;
+
+    OPENF_DBG_PRINT("openf_view_bmp: mapped '%s' %ux%u pixels", path, width, height);
+
+    return OPENF_OK;
+#else
+    return OPENF_ERR_UNSUPPORTED;
+#endif
+}
+
+/* Release the mapping behind a view returned by openf_view_bmp */
+static inline void openf_release_view(OpenF_ImageView* view) {
+    if (!view) return;
+#if OPENF_POSIX
+    if (view->map_base) munmap(view->map_base, view->map_size);
+#endif
+    memset(view, 0, sizeof(*view));
+    OPENF_DBG_PRINT("openf_release_view: view released");
+}
+
+/*-----------------------------------
+  Image resizing
+------------------------------------*/
+
+typedef enum {
+    OPENF_FILTER_NEAREST = 0,
+    OPENF_FILTER_BILINEAR,
+    OPENF_FILTER_AREA,
+    OPENF_FILTER_LANCZOS3
+} OpenF_ResizeFilter;
+
+#define OPENF__RESIZE_BITS 14
+#define OPENF__RESIZE_BAND 32
+
+static inline double openf__filter_weight(OpenF_ResizeFilter filter, double x) {
+    if (x < 0) x = -x;
+    switch (filter) {
+        case OPENF_FILTER_BILINEAR:
+            return x < 1.0 ? 1.0 - x : 0.0;
+        case OPENF_FILTER_AREA:
+            return x < 0.5 ? 1.0 : 0.0;
+        case OPENF_FILTER_LANCZOS3: {
+            if (x >= 3.0) return 0.0;
+            if (x < 1e-8) return 1.0;
+            double px = 3.14159265358979323846 * x;
+            return 3.0 * sin(px) * sin(px / 3.0) / (px * px);
+        }
+        default:
+            return 0.0;
+    }
+}
+
+static inline double openf__filter_support(OpenF_ResizeFilter filter) {
+    switch (filter) {
+        case OPENF_FILTER_BILINEAR: return 1.0;
+        case OPENF_FILTER_AREA: return 0.5;
+        case OPENF_FILTER_LANCZOS3: return 3.0;
+        default: return 0.5;
+    }
+}
+
+/* Fixed-point coefficient table for one axis: output i reads count[i] taps starting at start[i] */
+typedef struct OpenF__ResizeCoeffs {
+    unsigned int* start;
+    unsigned int* count;
+    short* weights;        // taps entries per output coordinate
+    unsigned int taps;
+} OpenF__ResizeCoeffs;
+
+static inline void openf__free_coeffs(OpenF__ResizeCoeffs* c) {
+    free(c->start);
+    free(c->count);
+    free(c->weights);
+    c->start = NULL;
+    c->count = NULL;
+    c->weights = NULL;
+}
+
+static inline OpenF_Error openf__build_coeffs(unsigned int in_size, unsigned int out_size, OpenF_ResizeFilter filter,
+                                              OpenF__ResizeCoeffs* c) {
+    double scale = (double)in_size / out_size;
+    double filter_scale = scale > 1.0 ? scale : 1.0;
+    double support = openf__filter_support(filter) * filter_scale;
+
+    c->taps = (unsigned int)ceil(support) * 2 + 1;
+    c->start = (unsigned int*)malloc(sizeof(unsigned int) * out_size);
+    c->count = (unsigned int*)malloc(sizeof(unsigned int) * out_size);
+    c->weights = (short*)calloc((size_t)out_size * c->taps, sizeof(short));
+    double* w = (double*)malloc(sizeof(double) * c->taps);
+    if (!c->start || !c->count || !c->weights || !w) {
+        openf__free_coeffs(c);
+        free(w);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+
+    for (unsigned int i = 0; i < out_size; i++) {
+        double center = (i + 0.5) * scale;
+        long lo = (long)floor(center - support + 0.5);
+        long hi = (long)floor(center + support + 0.5);
+        if (lo < 0) lo = 0;
+        if (hi > (long)in_size) hi = (long)in_size;
+        if (hi - lo > (long)c->taps) hi = lo + c->taps;
+
+        double total = 0.0;
+        unsigned int n = 0;
+        for (long x = lo; x < hi; x++, n++) {
+            w[n] = openf__filter_weight(filter, (x - center + 0.5) / filter_scale);
+            total += w[n];
+        }
+        if (n == 0 || total == 0.0) {
+            // Degenerate window: fall back to the nearest source sample
+            long nearest = (long)center;
+            if (nearest >= (long)in_size) nearest = (long)in_size - 1;
+            lo = nearest;
+            n = 1;
+            w[0] = total = 1.0;
+        }
+
+        short* out = c->weights + (size_t)i * c->taps;
+        int sum = 0, peak = 0;
+        for (unsigned int k = 0; k < n; k++) {
+            out[k] = (short)floor(w[k] / total * (1 << OPENF__RESIZE_BITS) + 0.5);
+            sum += out[k];
+            if (out[k] > out[peak]) peak = (int)k;
+        }
+        out[peak] = (short)(out[peak] + ((1 << OPENF__RESIZE_BITS) - sum)); // weights sum to exactly 1.0
+
+        c->start[i] = (unsigned int)lo;
+        c->count[i] = n;
+    }
+
+    free(w);
+    return OPENF_OK;
+}
+
+static inline unsigned char openf__clamp_fixed(int acc) {
+    acc = (acc + (1 << (OPENF__RESIZE_BITS - 1))) >> OPENF__RESIZE_BITS;
+    return (unsigned char)(acc < 0 ? 0 : (acc > 255 ? 255 : acc));
+}
+
+/* Gather a 3- or 4-byte pixel into the low bytes of an int without reading past it */
+static inline int openf__load_pixel(const unsigned char* p, unsigned int channels) {
+    unsigned int v = (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16);
+    if (channels == 4) v |= (unsigned int)p[3] << 24;
+    return (int)v;
+}
+
+static inline unsigned int openf__resize_h_none(const unsigned char* src, unsigned int src_width, unsigned char* dst,
+                                                unsigned int out_width, const OpenF__ResizeCoeffs* c, unsigned int channels) {
+    (void)src;
+    (void)src_width;
+    (void)dst;
+    (void)out_width;
+    (void)c;
+    (void)channels;
+    return 0;
+}
+
+/* Store the low 3 or 4 bytes of a packed pixel */
+static inline void openf__store_pixel(unsigned char* d, unsigned int v, unsigned int channels) {
+    d[0] = (unsigned char)v;
+    d[1] = (unsigned char)(v >> 8);
+    d[2] = (unsigned char)(v >> 16);
+    if (channels == 4) d[3] = (unsigned char)(v >> 24);
+}
+
+#if defined(__SSE2__)
+/* Two taps per step: interleave both pixels as 16-bit lanes and multiply-add against paired weights */
+static inline unsigned int openf__resize_h_sse2(const unsigned char* src, unsigned int src_width, unsigned char* dst,
+                                                unsigned int out_width, const OpenF__ResizeCoeffs* c, unsigned int channels) {
+    (void)src_width;
+    if (channels != 3 && channels != 4) return 0;
+    const __m128i zero = _mm_setzero_si128();
+    for (unsigned int x = 0; x < out_width; x++) {
+        const unsigned char* s = src + (size_t)c->start[x] * channels;
+        const short* w = c->weights + (size_t)x * c->taps;
+        unsigned int n = c->count[x], k = 0;
+        __m128i acc = _mm_set1_epi32(1 << (OPENF__RESIZE_BITS - 1));
+        for (; k + 1 < n; k += 2) {
+            int p0 = openf__load_pixel(s + k * channels, channels);
+            int p1 = openf__load_pixel(s + (k + 1) * channels, channels);
+            __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p0), zero);
+            __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p1), zero);
+            int pair = (int)((unsigned int)(unsigned short)w[k] | ((unsigned int)(unsigned short)w[k + 1] << 16));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), _mm_set1_epi32(pair)));
+        }
+        if (k < n) {
+            int p0 = openf__load_pixel(s + k * channels, channels);
+            __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p0), zero);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), _mm_set1_epi32((unsigned short)w[k])));
+        }
+        acc = _mm_srai_epi32(acc, OPENF__RESIZE_BITS);
+        acc = _mm_packs_epi32(acc, acc);
+        openf__store_pixel(dst + (size_t)x * channels, (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(acc, acc)), channels);
+    }
+    return out_width;
+}
+#endif
+
+#if OPENF__X86_DISPATCH
+/* Four taps per step: one 16-byte load holds pixels k..k+3, pshufb pairs them up per channel and the two 128-bit
+   lanes multiply-add (w0, w1) and (w2, w3); the lanes are summed once per output pixel */
+OPENF__TARGET("avx2")
+static inline unsigned int openf__resize_h_avx2(const unsigned char* src, unsigned int src_width, unsigned char* dst,
+                                                unsigned int out_width, const OpenF__ResizeCoeffs* c, unsigned int channels) {
+    if (channels != 3 && channels != 4) return 0;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i pairs = channels == 4 ? _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15)
+                                        : _mm_setr_epi8(0, 3, 1, 4, 2, 5, -1, -1, 6, 9, 7, 10, 8, 11, -1, -1);
+    size_t row_end = (size_t)src_width * channels;
+    for (unsigned int x = 0; x < out_width; x++) {
+        size_t first = (size_t)c->start[x] * channels;
+        const unsigned char* s = src + first;
+        const short* w = c->weights + (size_t)x * c->taps;
+        unsigned int n = c->count[x], k = 0;
+        __m256i acc4 = _mm256_setzero_si256();
+        // RGB24 reads 4 bytes past the fourth pixel, so stop while the load still ends inside the row
+        for (; k + 4 <= n && first + (size_t)k * channels + 16 <= row_end; k += 4) {
+            __m128i p = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(s + k * channels)), pairs);
+            unsigned int w01 = (unsigned int)(unsigned short)w[k] | ((unsigned int)(unsigned short)w[k + 1] << 16);
+            unsigned int w23 = (unsigned int)(unsigned short)w[k + 2] | ((unsigned int)(unsigned short)w[k + 3] << 16);
+            __m256i wp = _mm256_setr_epi32((int)w01, (int)w01, (int)w01, (int)w01, (int)w23, (int)w23, (int)w23, (int)w23);
+            acc4 = _mm256_add_epi32(acc4, _mm256_madd_epi16(_mm256_cvtepu8_epi16(p), wp));
+        }
+        __m128i acc = _mm_add_epi32(_mm256_castsi256_si128(acc4), _mm256_extracti128_si256(acc4, 1));
+        acc = _mm_add_epi32(acc, _mm_set1_epi32(1 << (OPENF__RESIZE_BITS - 1)));
+        for (; k + 1 < n; k += 2) {
+            int p0 = openf__load_pixel(s + k * channels, channels);
+            int p1 = openf__load_pixel(s + (k + 1) * channels, channels);
+            __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p0), zero);
+            __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p1), zero);
+            int pair = (int)((unsigned int)(unsigned short)w[k] | ((unsigned int)(unsigned short)w[k + 1] << 16));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), _mm_set1_epi32(pair)));
+        }
+        if (k < n) {
+            int p0 = openf__load_pixel(s + k * channels, channels);
+            __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(p0), zero);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), _mm_set1_epi32((unsigned short)w[k])));
+        }
+        acc = _mm_srai_epi32(acc, OPENF__RESIZE_BITS);
+        acc = _mm_packs_epi32(acc, acc);
+        openf__store_pixel(dst + (size_t)x * channels, (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(acc, acc)), channels);
+    }
+    return out_width;
+}
+#endif
+
+/* Horizontal pass over one row; channels is a constant at each call site so the scalar tap loop unrolls */
+static inline void openf__resize_row_h(const unsigned char* src, unsigned int src_width, unsigned char* dst,
+                                       unsigned int out_width, const OpenF__ResizeCoeffs* c, unsigned int channels) {
+    for (unsigned int x = openf__dispatch()->resize_h(src, src_width, dst, out_width, c, channels); x < out_width; x++) {
+        const unsigned char* s = src + (size_t)c->start[x] * channels;
+        const short* w = c->weights + (size_t)x * c->taps;
+        int acc[4] = {0, 0, 0, 0};
+        for (unsigned int k = 0; k < c->count[x]; k++) {
+            for (unsigned int ch = 0; ch < channels; ch++) acc[ch] += w[k] * s[k * channels + ch];
+        }
+        for (unsigned int ch = 0; ch < channels; ch++) dst[(size_t)x * channels + ch] = openf__clamp_fixed(acc[ch]);
+    }
+}
+
+#define OPENF__RESIZE_V_TAPS 64
+
+/* Vertical pass for one output row. Windows up to OPENF__RESIZE_V_TAPS rows (every upscale and downscales to
+   about 1/30) go through the dispatched taps kernel; longer ones accumulate whole rows in stack-sized chunks. */
+static inline void openf__resize_row_v(const unsigned char* src, size_t src_stride, unsigned char* dst, size_t row_bytes,
+                                       const OpenF__ResizeCoeffs* c, unsigned int y) {
+    const short* w = c->weights + (size_t)y * c->taps;
+    const unsigned char* s = src + (size_t)c->start[y] * src_stride;
+    unsigned int n = c->count[y];
+    if (n <= OPENF__RESIZE_V_TAPS) {
+        const unsigned char* rows[OPENF__RESIZE_V_TAPS];
+        for (unsigned int k = 0; k < n; k++) rows[k] = s + k * src_stride;
+        for (size_t i = openf__dispatch()->taps(rows, w, n, row_bytes, dst); i < row_bytes; i++) {
+            int acc = 0;
+            for (unsigned int k = 0; k < n; k++) acc += w[k] * rows[k][i];
+            dst[i] = openf__clamp_fixed(acc);
+        }
+        return;
+    }
+    int acc[1024];
+    for (size_t base = 0; base < row_bytes; base += 1024) {
+        size_t len = row_bytes - base < 1024 ? row_bytes - base : 1024;
+        for (size_t i = 0; i < len; i++) acc[i] = 0;
+        for (unsigned int k = 0; k < n; k++) {
+            const unsigned char* row = s + k * src_stride + base;
+            int wk = w[k];
+            for (size_t i = 0; i < len; i++) acc[i] += wk * row[i];
+        }
+        for (size_t i = 0; i < len; i++) dst[base + i] = openf__clamp_fixed(acc[i]);
+    }
+}
+
+typedef struct {
+    const OpenF_Image* src;
+    OpenF_Image* dst;
+    unsigned char* tmp;            // src->height rows of dst->width pixels
+    OpenF__ResizeCoeffs* hc;
+    OpenF__ResizeCoeffs* vc;
+    const unsigned int* nearest_x; // Source column per output column (nearest only)
+    OpenF_ResizeFilter filter;
+    unsigned int channels;
+} OpenF__ResizeJob;
+
+static inline void openf__resize_band_nearest(void* ctx, size_t band) {
+    OpenF__ResizeJob* job = (OpenF__ResizeJob*)ctx;
+    unsigned int ch = job->channels;
+    unsigned int y_end = (unsigned int)((band + 1) * OPENF__RESIZE_BAND);
+    if (y_end > job->dst->height) y_end = job->dst->height;
+    for (unsigned int y = (unsigned int)(band * OPENF__RESIZE_BAND); y < y_end; y++) {
+        unsigned int sy = (unsigned int)(((unsigned long long)y * 2 + 1) * job->src->height / (2ULL * job->dst->height));
+        const unsigned char* s = job->src->pixels + (size_t)sy * job->src->width * ch;
+        unsigned char* d = job->dst->pixels + (size_t)y * job->dst->width * ch;
+        for (unsigned int x = 0; x < job->dst->width; x++) {
+            memcpy(d + (size_t)x * ch, s + (size_t)job->nearest_x[x] * ch, ch);
+        }
+    }
+}
+
+static inline void openf__resize_band_h(void* ctx, size_t band) {
+    OpenF__ResizeJob* job = (OpenF__ResizeJob*)ctx;
+    size_t src_stride = (size_t)job->src->width * job->channels;
+    size_t tmp_stride = (size_t)job->dst->width * job->channels;
+    unsigned int y_end = (unsigned int)((band + 1) * OPENF__RESIZE_BAND);
+    if (y_end > job->src->height) y_end = job->src->height;
+    for (unsigned int y = (unsigned int)(band * OPENF__RESIZE_BAND); y < y_end; y++) {
+        const unsigned char* s = job->src->pixels + y * src_stride;
+        unsigned char* d = job->tmp + y * tmp_stride;
+        switch (job->channels) {
+            case 1: openf__resize_row_h(s, job->src->width, d, job->dst->width, job->hc, 1); break;
+            case 3: openf__resize_row_h(s, job->src->width, d, job->dst->width, job->hc, 3); break;
+            default: openf__resize_row_h(s, job->src->width, d, job->dst->width, job->hc, 4); break;
+        }
+    }
+}
+
+static inline void openf__resize_band_v(void* ctx, size_t band) {
+    OpenF__ResizeJob* job = (OpenF__ResizeJob*)ctx;
+    size_t row_bytes = (size_t)job->dst->width * job->channels;
+    unsigned int y_end = (unsigned int)((band + 1) * OPENF__RESIZE_BAND);
+    if (y_end > job->dst->height) y_end = job->dst->height;
+    for (unsigned int y = (unsigned int)(band * OPENF__RESIZE_BAND); y < y_end; y++) {
+        openf__resize_row_v(job->tmp, row_bytes, job->dst->pixels + y * row_bytes, row_bytes, job->vc, y);
+    }
+}
+
+/* Resize into a newly allocated image using separable fixed-point filtering on all CPUs */
+static inline OpenF_Error openf_image_resize(const OpenF_Image* src, unsigned int dst_width, unsigned int dst_height,
+                                             OpenF_ResizeFilter filter, OpenF_Image** out_image) {
+    if (!src || !src->pixels || !out_image) return OPENF_ERR_NULL_ARG;
+    if (src->width == 0 || src->height == 0 || dst_width == 0 || dst_height == 0) return OPENF_ERR_INVALID_ARG;
+    if ((int)filter < (int)OPENF_FILTER_NEAREST || (int)filter > (int)OPENF_FILTER_LANCZOS3) return OPENF_ERR_INVALID_ARG;
+    unsigned int channels = openf_format_bytes_per_pixel(src->format);
+    if (channels == 0) return OPENF_ERR_UNSUPPORTED;
+
+    OpenF_Image* dst = NULL;
+    OpenF_Error err = openf_create_image(dst_width, dst_height, src->format, &dst);
+    if (err != OPENF_OK) return err;
+
+    OpenF__ResizeJob job;
+    memset(&job, 0, sizeof(job));
+    job.src = src;
+    job.dst = dst;
+    job.filter = filter;
+    job.channels = channels;
+
+    size_t dst_bands = (dst_height + OPENF__RESIZE_BAND - 1) / OPENF__RESIZE_BAND;
+
+    if (filter == OPENF_FILTER_NEAREST) {
+        unsigned int* map = (unsigned int*)malloc(sizeof(unsigned int) * dst_width);
+        if (!map) {
+            openf_free_image(&dst);
+            return OPENF_ERR_MEM_ALLOC;
+        }
+        for (unsigned int x = 0; x < dst_width; x++) {
+            map[x] = (unsigned int)(((unsigned long long)x * 2 + 1) * src->width / (2ULL * dst_width));
+        }
+        job.nearest_x = map;
+        openf__parallel_for(dst_bands, 0, openf__resize_band_nearest, &job);
+        free(map);
+    } else {
+        OpenF__ResizeCoeffs hc, vc;
+        memset(&hc, 0, sizeof(hc));
+        memset(&vc, 0, sizeof(vc));
+        job.tmp = (unsigned char*)malloc((size_t)dst_width * job.channels * src->height);
+        if (!job.tmp ||
+            openf__build_coeffs(src->width, dst_width, filter, &hc) != OPENF_OK ||
+            openf__build_coeffs(src->height, dst_height, filter, &vc) != OPENF_OK) {
+            free(job.tmp);
+            openf__free_coeffs(&hc);
+            openf__free_coeffs(&vc);
+            openf_free_image(&dst);
+            return OPENF_ERR_MEM_ALLOC;
+        }
+        job.hc = &hc;
+        job.vc = &vc;
+
+        size_t src_bands = (src->height + OPENF__RESIZE_BAND - 1) / OPENF__RESIZE_BAND;
+        openf__parallel_for(src_bands, 0, openf__resize_band_h, &job);
+        openf__parallel_for(dst_bands, 0, openf__resize_band_v, &job);
+
+        free(job.tmp);
+        openf__free_coeffs(&hc);
+        openf__free_coeffs(&vc);
+    }
+
+    *out_image = dst;
+
+    OPENF_DBG_PRINT("openf_image_resize: %ux%u -> %ux%u (filter %d)", src->width, src->height, dst_width, dst_height, (int)filter);
+
+    return OPENF_OK;
+}
+
+/*-----------------------------------
+  Pixel format conversion
+------------------------------------*/
+
+#define OPENF__CONVERT_BAND 16  // Row pairs per parallel task
+
+/* Plane pointers and strides of an image or view; packed formats only use plane 0 */
+typedef struct {
+    const unsigned char* plane[3];
+    ptrdiff_t stride[3];
+} OpenF__Planes;
+
+static inline void openf__image_planes(const unsigned char* base, unsigned int width, unsigned int height,
+                                       OpenF_PixelFormat format, OpenF__Planes* p) {
+    size_t luma = (size_t)width * height;
+    size_t cw = (width + 1) / 2, chroma = cw * ((height + 1) / 2);
+    memset(p, 0, sizeof(*p));
+    p->plane[0] = base;
+    switch (format) {
+        case OPENF_FORMAT_YUV444:
+        case OPENF_FORMAT_RGB_PLANAR:
+            p->plane[1] = base + luma;
+            p->plane[2] = base + luma * 2;
+            p->stride[0] = p->stride[1] = p->stride[2] = (ptrdiff_t)width;
+            break;
+        case OPENF_FORMAT_YUV420:
+            p->plane[1] = base + luma;
+            p->plane[2] = base + luma + chroma;
+            p->stride[0] = (ptrdiff_t)width;
+            p->stride[1] = p->stride[2] = (ptrdiff_t)cw;
+            break;
+        case OPENF_FORMAT_NV12:
+            p->plane[1] = base + luma;
+            p->stride[0] = (ptrdiff_t)width;
+            p->stride[1] = (ptrdiff_t)(cw * 2);
+            break;
+        default:
+            p->stride[0] = (ptrdiff_t)width * openf_format_bytes_per_pixel(format);
+            break;
+    }
+}
+
+static inline unsigned char openf__clamp_u8(int v) {
+    return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+/* BT.601 limited-range RGB -> YUV in 8.8 fixed point */
+static inline unsigned char openf__rgb_to_y(int r, int g, int b) {
+    return (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+static inline unsigned char openf__rgb_to_u(int r, int g, int b) {
+    return (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+static inline unsigned char openf__rgb_to_v(int r, int g, int b) {
+    return (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+static inline void openf__yuv_to_rgba(int y, int u, int v, unsigned char* out) {
+    int c = 298 * (y - 16) + 128, d = u - 128, e = v - 128;
+    out[0] = openf__clamp_u8((c + 409 * e) >> 8);
+    out[1] = openf__clamp_u8((c - 100 * d - 208 * e) >> 8);
+    out[2] = openf__clamp_u8((c + 516 * d) >> 8);
+    out[3] = 255;
+}
+
+/* Scalar stand-ins for the dispatched conversion kernels; the callers' own loops do all the work */
+static inline unsigned int openf__rgb24_to_rgba_none(const unsigned char* src, unsigned char* rgba, unsigned int width,
+                                                     int bgr) {
+    (void)src;
+    (void)rgba;
+    (void)width;
+    (void)bgr;
+    return 0;
+}
+static inline unsigned int openf__rgba_to_rgb24_none(const unsigned char* rgba, unsigned char* dst, unsigned int width,
+                                                     int bgr) {
+    (void)rgba;
+    (void)dst;
+    (void)width;
+    (void)bgr;
+    return 0;
+}
+static inline unsigned int openf__rgba_to_plane_none(const unsigned char* rgba, unsigned char* out, unsigned int width,
+                                                     int which) {
+    (void)rgba;
+    (void)out;
+    (void)width;
+    (void)which;
+    return 0;
+}
+static inline unsigned int openf__rgba_to_chroma_none(const unsigned char* row0, const unsigned char* row1,
+                                                      unsigned int width, unsigned char* u, unsigned char* v) {
+    (void)row0;
+    (void)row1;
+    (void)width;
+    (void)u;
+    (void)v;
+    return 0;
+}
+static inline unsigned int openf__yuv_to_rgba_none(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+                                                   int layout, unsigned char* rgba, unsigned int width) {
+    (void)y;
+    (void)u;
+    (void)v;
+    (void)layout;
+    (void)rgba;
+    (void)width;
+    return 0;
+}
+
+#if defined(__SSE2__)
+/* Coefficients and offset per plane for openf__rgba_to_plane_*: gray, Y, U, V (matching the scalar formulas) */
+static const short openf__plane_coeffs[4][4] = {{77, 150, 29, 0}, {66, 129, 25, 16}, {-38, -74, 112, 128}, {112, -94, -18, 128}};
+
+/* Byte c of every 32-bit pixel, as 32-bit lanes */
+static inline __m128i openf__channel_sse2(__m128i px, int c) {
+    return _mm_and_si128(_mm_srli_epi32(px, 8 * c), _mm_set1_epi32(0xFF));
+}
+
+/* One plane from 16-bit R, G, B lanes. Gray and Y sums stay below 65536 and U/V within int16, so wrapping 16-bit
+   multiplies give exact results once shifted the way the scalar code does. */
+static inline __m128i openf__plane16_sse2(__m128i r, __m128i g, __m128i b, int which) {
+    const short* k = openf__plane_coeffs[which];
+    __m128i acc = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(k[0])), _mm_mullo_epi16(g, _mm_set1_epi16(k[1])));
+    acc = _mm_add_epi16(acc, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(k[2])), _mm_set1_epi16(128)));
+    acc = which < 2 ? _mm_srli_epi16(acc, 8) : _mm_srai_epi16(acc, 8);
+    return _mm_add_epi16(acc, _mm_set1_epi16(k[3]));
+}
+
+/* 16 pixels per step */
+static inline unsigned int openf__rgba_to_plane_sse2(const unsigned char* rgba, unsigned char* out, unsigned int width,
+                                                     int which) {
+    unsigned int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i p[4], lo[3], hi[3];
+        for (int i = 0; i < 4; i++) p[i] = _mm_loadu_si128((const __m128i*)(rgba + 4 * (size_t)x + 16 * i));
+        for (int c = 0; c < 3; c++) {
+            lo[c] = _mm_packs_epi32(openf__channel_sse2(p[0], c), openf__channel_sse2(p[1], c));
+            hi[c] = _mm_packs_epi32(openf__channel_sse2(p[2], c), openf__channel_sse2(p[3], c));
+        }
+        __m128i a = openf__plane16_sse2(lo[0], lo[1], lo[2], which);
+        __m128i b = openf__plane16_sse2(hi[0], hi[1], hi[2], which);
+        _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(a, b));
+    }
+    return x;
+}
+
+/* Eight chroma samples (16 luma columns) per step; returns chroma samples done. v == NULL writes interleaved NV12 to u. */
+static inline unsigned int openf__rgba_to_chroma_sse2(const unsigned char* row0, const unsigned char* row1,
+                                                      unsigned int width, unsigned char* u, unsigned char* v) {
+    const __m128i ones = _mm_set1_epi16(1), two = _mm_set1_epi32(2);
+    unsigned int cx = 0;
+    for (; cx + 8 <= width / 2; cx += 8) {
+        __m128i p[4], q[4], avg[3];
+        for (int i = 0; i < 4; i++) {
+            p[i] = _mm_loadu_si128((const __m128i*)(row0 + 8 * (size_t)cx + 16 * i));
+            q[i] = _mm_loadu_si128((const __m128i*)(row1 + 8 * (size_t)cx + 16 * i));
+        }
+        for (int c = 0; c < 3; c++) {
+            // Vertical sums per pixel, then pmaddwd against ones adds horizontal neighbours
+            __m128i h[2];
+            for (int half = 0; half < 2; half++) {
+                __m128i s0 = _mm_add_epi32(openf__channel_sse2(p[2 * half], c), openf__channel_sse2(q[2 * half], c));
+                __m128i s1 = _mm_add_epi32(openf__channel_sse2(p[2 * half + 1], c), openf__channel_sse2(q[2 * half + 1], c));
+                h[half] = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_packs_epi32(s0, s1), ones), two), 2);
+            }
+            avg[c] = _mm_packs_epi32(h[0], h[1]);
+        }
+        __m128i cu = openf__plane16_sse2(avg[0], avg[1], avg[2], 2);
+        __m128i cv = openf__plane16_sse2(avg[0], avg[1], avg[2], 3);
+        if (v) {
+            __m128i uv = _mm_packus_epi16(cu, cv);
+            _mm_storel_epi64((__m128i*)(u + cx), uv);
+            _mm_storel_epi64((__m128i*)(v + cx), _mm_srli_si128(uv, 8));
+        } else {
+            _mm_storeu_si128((__m128i*)(u + 2 * (size_t)cx), _mm_or_si128(cu, _mm_slli_epi16(cv, 8)));
+        }
+    }
+    return cx;
+}
+
+/* Red, green and blue for eight pixels from 16-bit y - 16, u - 128 and v - 128 lanes, clamped to 0..255 */
+static inline void openf__yuv16_to_rgb_sse2(__m128i y, __m128i d, __m128i e, __m128i* r, __m128i* g, __m128i* b) {
+    const __m128i round = _mm_set1_epi32(128), zero = _mm_setzero_si128(), c255 = _mm_set1_epi16(255);
+    const __m128i kr = _mm_set1_epi32(298 | (409 << 16));
+    const __m128i kg = _mm_set1_epi32(298 | (int)((unsigned int)(unsigned short)-100 << 16));
+    const __m128i kge = _mm_set1_epi32((int)(unsigned short)-208 | (128 << 16)); // (e, 1) also adds the rounding
+    const __m128i kb = _mm_set1_epi32(298 | (516 << 16));
+    __m128i ye_lo = _mm_unpacklo_epi16(y, e), ye_hi = _mm_unpackhi_epi16(y, e);
+    __m128i yd_lo = _mm_unpacklo_epi16(y, d), yd_hi = _mm_unpackhi_epi16(y, d);
+    __m128i e1_lo = _mm_unpacklo_epi16(e, _mm_set1_epi16(1)), e1_hi = _mm_unpackhi_epi16(e, _mm_set1_epi16(1));
+    __m128i rl = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ye_lo, kr), round), 8);
+    __m128i rh = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ye_hi, kr), round), 8);
+    __m128i gl = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yd_lo, kg), _mm_madd_epi16(e1_lo, kge)), 8);
+    __m128i gh = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yd_hi, kg), _mm_madd_epi16(e1_hi, kge)), 8);
+    __m128i bl = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yd_lo, kb), round), 8);
+    __m128i bh = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yd_hi, kb), round), 8);
+    *r = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(rl, rh), zero), c255);
+    *g = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(gl, gh), zero), c255);
+    *b = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(bl, bh), zero), c255);
+}
+
+static inline __m128i openf__load32_sse2(const unsigned char* p) {
+    int v;
+    memcpy(&v, p, 4);
+    return _mm_cvtsi32_si128(v);
+}
+
+/* Eight pixels per step. layout: 0 = full-resolution u/v (YUV444), 1 = half-width u/v rows (YUV420),
+   2 = interleaved half-width UV in u (NV12) */
+static inline unsigned int openf__yuv_to_rgba_sse2(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+                                                   int layout, unsigned char* rgba, unsigned int width) {
+    const __m128i zero = _mm_setzero_si128(), c16 = _mm_set1_epi16(16), c128 = _mm_set1_epi16(128);
+    const __m128i lo16 = _mm_set1_epi32(0xFFFF), alpha = _mm_set1_epi16((short)0xFF00);
+    unsigned int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i yy = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y + x)), zero), c16);
+        __m128i uu, vv;
+        if (layout == 0) {
+            uu = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(u + x)), zero);
+            vv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(v + x)), zero);
+        } else if (layout == 1) {
+            uu = _mm_unpacklo_epi8(openf__load32_sse2(u + x / 2), zero);
+            vv = _mm_unpacklo_epi8(openf__load32_sse2(v + x / 2), zero);
+            uu = _mm_unpacklo_epi16(uu, uu);
+            vv = _mm_unpacklo_epi16(vv, vv);
+        } else {
+            // 32-bit lanes hold U | V << 16; duplicate each half into both words
+            __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(u + x)), zero);
+            uu = _mm_and_si128(uv, lo16);
+            vv = _mm_srli_epi32(uv, 16);
+            uu = _mm_or_si128(uu, _mm_slli_epi32(uu, 16));
+            vv = _mm_or_si128(vv, _mm_slli_epi32(vv, 16));
+        }
+        __m128i r, g, b;
+        openf__yuv16_to_rgb_sse2(yy, _mm_sub_epi16(uu, c128), _mm_sub_epi16(vv, c128), &r, &g, &b);
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8)), ba = _mm_or_si128(b, alpha);
+        _mm_storeu_si128((__m128i*)(rgba + 4 * (size_t)x), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i*)(rgba + 4 * (size_t)x + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+    return x;
+}
+#endif
+
+#if OPENF__X86_DISPATCH
+/* Four pixels per 16-byte shuffle; the load reads two pixels ahead, so stop six short of the end */
+OPENF__TARGET("ssse3")
+static inline unsigned int openf__rgb24_to_rgba_ssse3(const unsigned char* src, unsigned char* rgba, unsigned int width,
+                                                      int bgr) {
+    const __m128i shuf = bgr ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+                             : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+    unsigned int x = 0;
+    for (; x + 6 <= width; x += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 3 * (size_t)x));
+        _mm_storeu_si128((__m128i*)(rgba + 4 * (size_t)x), _mm_or_si128(_mm_shuffle_epi8(v, shuf), alpha));
+    }
+    return x;
+}
+
+/* Four pixels per step; the 16-byte store spills four bytes that the next step (or the scalar tail) overwrites */
+OPENF__TARGET("ssse3")
+static inline unsigned int openf__rgba_to_rgb24_ssse3(const unsigned char* rgba, unsigned char* dst, unsigned int width,
+                                                      int bgr) {
+    const __m128i shuf = bgr ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+                             : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    unsigned int x = 0;
+    for (; x + 6 <= width; x += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(rgba + 4 * (size_t)x));
+        _mm_storeu_si128((__m128i*)(dst + 3 * (size_t)x), _mm_shuffle_epi8(v, shuf));
+    }
+    return x;
+}
+
+/* Eight pixels per step: two 12-byte runs, one per 128-bit lane */
+OPENF__TARGET("avx2")
+static inline unsigned int openf__rgb24_to_rgba_avx2(const unsigned char* src, unsigned char* rgba, unsigned int width,
+                                                     int bgr) {
+    const __m256i shuf = bgr ? _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+                                                2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+                             : _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                                0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+    unsigned int x = 0;
+    for (; x + 10 <= width; x += 8) {
+        const unsigned char* s = src + 3 * (size_t)x;
+        __m256i v = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)s));
+        v = _mm256_inserti128_si256(v, _mm_loadu_si128((const __m128i*)(s + 12)), 1);
+        _mm256_storeu_si256((__m256i*)(rgba + 4 * (size_t)x), _mm256_or_si256(_mm256_shuffle_epi8(v, shuf), alpha));
+    }
+    return x;
+}
+
+/* Eight pixels per step: pack 12 bytes within each lane, then close the gap with a dword permute */
+OPENF__TARGET("avx2")
+static inline unsigned int openf__rgba_to_rgb24_avx2(const unsigned char* rgba, unsigned char* dst, unsigned int width,
+                                                     int bgr) {
+    const __m256i shuf = bgr ? _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+                             : _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                                0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i gather = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+    unsigned int x = 0;
+    for (; x + 11 <= width; x += 8) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(rgba + 4 * (size_t)x)), shuf);
+        _mm256_storeu_si256((__m256i*)(dst + 3 * (size_t)x), _mm256_permutevar8x32_epi32(v, gather));
+    }
+    return x;
+}
+
+OPENF__TARGET("avx2")
+static inline __m256i openf__channel_avx2(__m256i px, int c) {
+    return _mm256_and_si256(_mm256_srli_epi32(px, 8 * c), _mm256_set1_epi32(0xFF));
+}
+
+OPENF__TARGET("avx2")
+static inline __m256i openf__plane16_avx2(__m256i r, __m256i g, __m256i b, int which) {
+    const short* k = openf__plane_coeffs[which];
+    __m256i acc = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(k[0])), _mm256_mullo_epi16(g, _mm256_set1_epi16(k[1])));
+    acc = _mm256_add_epi16(acc, _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(k[2])), _mm256_set1_epi16(128)));
+    acc = which < 2 ? _mm256_srli_epi16(acc, 8) : _mm256_srai_epi16(acc, 8);
+    return _mm256_add_epi16(acc, _mm256_set1_epi16(k[3]));
+}
+
+/* 32 pixels per step; the in-lane packs leave dwords in 0,2,4,6,1,3,5,7 order, undone by one permute */
+OPENF__TARGET("avx2")
+static inline unsigned int openf__rgba_to_plane_avx2(const unsigned char* rgba, unsigned char* out, unsigned int width,
+                                                     int which) {
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    unsigned int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i p[4], lo[3], hi[3];
+        for (int i = 0; i < 4; i++) p[i] = _mm256_loadu_si256((const __m256i*)(rgba + 4 * (size_t)x + 32 * i));
+        for (int c = 0; c < 3; c++) {
+            lo[c] = _mm256_packs_epi32(openf__channel_avx2(p[0], c), openf__channel_avx2(p[1], c));
+            hi[c] = _mm256_packs_epi32(openf__channel_avx2(p[2], c), openf__channel_avx2(p[3], c));
+        }
+        __m256i a = openf__plane16_avx2(lo[0], lo[1], lo[2], which);
+        __m256i b = openf__plane16_avx2(hi[0], hi[1], hi[2], which);
+        _mm256_storeu_si256((__m256i*)(out + x), _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), order));
+    }
+    return x;
+}
+
+/* 16 chroma samples (32 luma columns) per step, same arithmetic as the SSE2 kernel */
+OPENF__TARGET("avx2")
+static inline unsigned int openf__rgba_to_chroma_avx2(const unsigned char* row0, const unsigned char* row1,
+                                                      unsigned int width, unsigned char* u, unsigned char* v) {
+    const __m256i ones = _mm256_set1_epi16(1), two = _mm256_set1_epi32(2);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    unsigned int cx = 0;
+    for (; cx + 16 <= width / 2; cx += 16) {
+        __m256i p[4], q[4], avg[3];
+        for (int i = 0; i < 4; i++) {
+            p[i] = _mm256_loadu_si256((const __m256i*)(row0 + 8 * (size_t)cx + 32 * i));
+            q[i] = _mm256_loadu_si256((const __m256i*)(row1 + 8 * (size_t)cx + 32 * i));
+        }
+        for (int c = 0; c < 3; c++) {
+            __m256i h[2];
+            for (int half = 0; half < 2; half++) {
+                __m256i s0 = _mm256_add_epi32(openf__channel_avx2(p[2 * half], c), openf__channel_avx2(q[2 * half], c));
+                __m256i s1 = _mm256_add_epi32(openf__channel_avx2(p[2 * half + 1], c), openf__channel_avx2(q[2 * half + 1], c));
+                h[half] = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_packs_epi32(s0, s1), ones), two), 2);
+            }
+            avg[c] = _mm256_permutevar8x32_epi32(_mm256_packs_epi32(h[0], h[1]), order);
+        }
+        __m256i cu = openf__plane16_avx2(avg[0], avg[1], avg[2], 2);
+        __m256i cv = openf__plane16_avx2(avg[0], avg[1], avg[2], 3);
+        if (v) {
+            __m256i uv = _mm256_permute4x64_epi64(_mm256_packus_epi16(cu, cv), 0xD8);
+            _mm_storeu_si128((__m128i*)(u + cx), _mm256_castsi256_si128(uv));
+            _mm_storeu_si128((__m128i*)(v + cx), _mm256_extracti128_si256(uv, 1));
+        } else {
+            _mm256_storeu_si256((__m256i*)(u + 2 * (size_t)cx), _mm256_or_si256(cu, _mm256_slli_epi16(cv, 8)));
+        }
+    }
+    return cx;
+}
+
+/* 16 pixels per step with the SSE2 kernel's multiply-adds; operands are widened in pixel order so only the final
+   interleave needs a cross-lane fix-up */
+OPENF__TARGET("avx2")
+static inline unsigned int openf__yuv_to_rgba_avx2(const unsigned char* y, const unsigned char* u, const unsigned char* v,
+                                                   int layout, unsigned char* rgba, unsigned int width) {
+    const __m256i c16 = _mm256_set1_epi16(16), c128 = _mm256_set1_epi16(128), lo16 = _mm256_set1_epi32(0xFFFF);
+    const __m256i round = _mm256_set1_epi32(128), zero = _mm256_setzero_si256(), c255 = _mm256_set1_epi16(255);
+    const __m256i alpha = _mm256_set1_epi16((short)0xFF00), one = _mm256_set1_epi16(1);
+    const __m256i kr = _mm256_set1_epi32(298 | (409 << 16));
+    const __m256i kg = _mm256_set1_epi32(298 | (int)((unsigned int)(unsigned short)-100 << 16));
+    const __m256i kge = _mm256_set1_epi32((int)(unsigned short)-208 | (128 << 16));
+    const __m256i kb = _mm256_set1_epi32(298 | (516 << 16));
+    unsigned int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i yy = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x))), c16);
+        __m256i uu, vv;
+        if (layout == 0) {
+            uu = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(u + x)));
+            vv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(v + x)));
+        } else if (layout == 1) {
+            __m128i su = _mm_loadl_epi64((const __m128i*)(u + x / 2)), sv = _mm_loadl_epi64((const __m128i*)(v + x / 2));
+            uu = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(su, su));
+            vv = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(sv, sv));
+        } else {
+            __m256i uv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(u + x)));
+            uu = _mm256_and_si256(uv, lo16);
+            vv = _mm256_srli_epi32(uv, 16);
+            uu = _mm256_or_si256(uu, _mm256_slli_epi32(uu, 16));
+            vv = _mm256_or_si256(vv, _mm256_slli_epi32(vv, 16));
+        }
+        __m256i d = _mm256_sub_epi16(uu, c128), e = _mm256_sub_epi16(vv, c128);
+        __m256i ye_lo = _mm256_unpacklo_epi16(yy, e), ye_hi = _mm256_unpackhi_epi16(yy, e);
+        __m256i yd_lo = _mm256_unpacklo_epi16(yy, d), yd_hi = _mm256_unpackhi_epi16(yy, d);
+        __m256i e1_lo = _mm256_unpacklo_epi16(e, one), e1_hi = _mm256_unpackhi_epi16(e, one);
+        __m256i r = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(ye_lo, kr), round), 8),
+                                       _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(ye_hi, kr), round), 8));
+        __m256i g = _mm256_packs_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yd_lo, kg), _mm256_madd_epi16(e1_lo, kge)), 8),
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yd_hi, kg), _mm256_madd_epi16(e1_hi, kge)), 8));
+        __m256i b = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yd_lo, kb), round), 8),
+                                       _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yd_hi, kb), round), 8));
+        r = _mm256_min_epi16(_mm256_max_epi16(r, zero), c255);
+        g = _mm256_min_epi16(_mm256_max_epi16(g, zero), c255);
+        b = _mm256_min_epi16(_mm256_max_epi16(b, zero), c255);
+        __m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8)), ba = _mm256_or_si256(b, alpha);
+        __m256i lo = _mm256_unpacklo_epi16(rg, ba), hi = _mm256_unpackhi_epi16(rg, ba);
+        _mm256_storeu_si256((__m256i*)(rgba + 4 * (size_t)x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(rgba + 4 * (size_t)x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return x;
+}
+#endif
+
+/* Expand source row y into an RGBA scratch row */
+static inline void openf__decode_row(const OpenF__Planes* p, OpenF_PixelFormat format, unsigned int width,
+                                     unsigned int y, unsigned char* OPENF_RESTRICT rgba) {
+    const unsigned char* OPENF_RESTRICT s0 = p->plane[0] + (ptrdiff_t)y * p->stride[0];
+    switch (format) {
+        case OPENF_FORMAT_RGB24:
+            for (unsigned int x = openf__dispatch()->rgb24_to_rgba(s0, rgba, width, 0); x < width; x++) {
+                rgba[4 * x + 0] = s0[3 * x + 0];
+                rgba[4 * x + 1] = s0[3 * x + 1];
+                rgba[4 * x + 2] = s0[3 * x + 2];
+                rgba[4 * x + 3] = 255;
+            }
+            break;
+        case OPENF_FORMAT_BGR24:
+            for (unsigned int x = openf__dispatch()->rgb24_to_rgba(s0, rgba, width, 1); x < width; x++) {
+                rgba[4 * x + 0] = s0[3 * x + 2];
+                rgba[4 * x + 1] = s0[3 * x + 1];
+                rgba[4 * x + 2] = s0[3 * x + 0];
+                rgba[4 * x + 3] = 255;
+            }
+            break;
+        case OPENF_FORMAT_RGBA32:
+            memcpy(rgba, s0, (size_t)width * 4);
+            break;
+        case OPENF_FORMAT_GRAY8:
+            for (unsigned int x = 0; x < width; x++) {
+                rgba[4 * x + 0] = rgba[4 * x + 1] = rgba[4 * x + 2] = s0[x];
+                rgba[4 * x + 3] = 255;
+            }
+            break;
+        case OPENF_FORMAT_RGB_PLANAR: {
+            const unsigned char* g = p->plane[1] + (ptrdiff_t)y * p->stride[1];
+            const unsigned char* b = p->plane[2] + (ptrdiff_t)y * p->stride[2];
+            for (unsigned int x = 0; x < width; x++) {
+                rgba[4 * x + 0] = s0[x];
+                rgba[4 * x + 1] = g[x];
+                rgba[4 * x + 2] = b[x];
+                rgba[4 * x + 3] = 255;
+            }
+            break;
+        }
+        case OPENF_FORMAT_YUV444: {
+            const unsigned char* u = p->plane[1] + (ptrdiff_t)y * p->stride[1];
+            const unsigned char* v = p->plane[2] + (ptrdiff_t)y * p->stride[2];
+            for (unsigned int x = openf__dispatch()->yuv_to_rgba(s0, u, v, 0, rgba, width); x < width; x++) {
+                openf__yuv_to_rgba(s0[x], u[x], v[x], rgba + 4 * x);
+            }
+            break;
+        }
+        case OPENF_FORMAT_YUV420: {
+            const unsigned char* u = p->plane[1] + (ptrdiff_t)(y / 2) * p->stride[1];
+            const unsigned char* v = p->plane[2] + (ptrdiff_t)(y / 2) * p->stride[2];
+            for (unsigned int x = openf__dispatch()->yuv_to_rgba(s0, u, v, 1, rgba, width); x < width; x++) {
+                openf__yuv_to_rgba(s0[x], u[x / 2], v[x / 2], rgba + 4 * x);
+            }
+            break;
+        }
+        case OPENF_FORMAT_NV12: {
+            const unsigned char* uv = p->plane[1] + (ptrdiff_t)(y / 2) * p->stride[1];
+            for (unsigned int x = openf__dispatch()->yuv_to_rgba(s0, uv, NULL, 2, rgba, width); x < width; x++) {
+                openf__yuv_to_rgba(s0[x], uv[(x / 2) * 2], uv[(x / 2) * 2 + 1], rgba + 4 * x);
+            }
+            break;
+        }
+    }
+}
+
+/* Write one or two RGBA scratch rows (row1 may be NULL on an odd last row) starting at destination row y */
+static inline void openf__encode_rows(const OpenF__Planes* p, OpenF_PixelFormat format, unsigned int width,
+                                      unsigned int y, const unsigned char* row0, const unsigned char* row1) {
+    const OpenF__Dispatch* k = openf__dispatch();
+    for (int r = 0; r < 2; r++) {
+        const unsigned char* OPENF_RESTRICT rgba = r == 0 ? row0 : row1;
+        if (!rgba) break;
+        unsigned char* OPENF_RESTRICT d0 = (unsigned char*)p->plane[0] + (ptrdiff_t)(y + r) * p->stride[0];
+        switch (format) {
+            case OPENF_FORMAT_RGB24:
+                for (unsigned int x = k->rgba_to_rgb24(rgba, d0, width, 0); x < width; x++) {
+                    d0[3 * x + 0] = rgba[4 * x + 0];
+                    d0[3 * x + 1] = rgba[4 * x + 1];
+                    d0[3 * x + 2] = rgba[4 * x + 2];
+                }
+                break;
+            case OPENF_FORMAT_BGR24:
+                for (unsigned int x = k->rgba_to_rgb24(rgba, d0, width, 1); x < width; x++) {
+                    d0[3 * x + 0] = rgba[4 * x + 2];
+                    d0[3 * x + 1] = rgba[4 * x + 1];
+                    d0[3 * x + 2] = rgba[4 * x + 0];
+                }
+                break;
+            case OPENF_FORMAT_RGBA32:
+                memcpy(d0, rgba, (size_t)width * 4);
+                break;
+            case OPENF_FORMAT_GRAY8:
+                for (unsigned int x = k->rgba_to_plane(rgba, d0, width, 0); x < width; x++) {
+                    d0[x] = (unsigned char)((77 * rgba[4 * x] + 150 * rgba[4 * x + 1] + 29 * rgba[4 * x + 2] + 128) >> 8);
+                }
+                break;
+            case OPENF_FORMAT_RGB_PLANAR: {
+                unsigned char* g = (unsigned char*)p->plane[1] + (ptrdiff_t)(y + r) * p->stride[1];
+                unsigned char* b = (unsigned char*)p->plane[2] + (ptrdiff_t)(y + r) * p->stride[2];
+                for (unsigned int x = 0; x < width; x++) {
+                    d0[x] = rgba[4 * x];
+                    g[x] = rgba[4 * x + 1];
+                    b[x] = rgba[4 * x + 2];
+                }
+                break;
+            }
+            case OPENF_FORMAT_YUV444: {
+                unsigned char* u = (unsigned char*)p->plane[1] + (ptrdiff_t)(y + r) * p->stride[1];
+                unsigned char* v = (unsigned char*)p->plane[2] + (ptrdiff_t)(y + r) * p->stride[2];
+                // One pass per plane, each finished by its own scalar tail
+                for (unsigned int x = k->rgba_to_plane(rgba, d0, width, 1); x < width; x++) {
+                    d0[x] = openf__rgb_to_y(rgba[4 * x], rgba[4 * x + 1], rgba[4 * x + 2]);
+                }
+                for (unsigned int x = k->rgba_to_plane(rgba, u, width, 2); x < width; x++) {
+                    u[x] = openf__rgb_to_u(rgba[4 * x], rgba[4 * x + 1], rgba[4 * x + 2]);
+                }
+                for (unsigned int x = k->rgba_to_plane(rgba, v, width, 3); x < width; x++) {
+                    v[x] = openf__rgb_to_v(rgba[4 * x], rgba[4 * x + 1], rgba[4 * x + 2]);
+                }
+                break;
+            }
+            default: // YUV420 / NV12 luma
+                for (unsigned int x = k->rgba_to_plane(rgba, d0, width, 1); x < width; x++) {
+                    d0[x] = openf__rgb_to_y(rgba[4 * x], rgba[4 * x + 1], rgba[4 * x + 2]);
+                }
+                break;
+        }
+    }
+
+    if (format != OPENF_FORMAT_YUV420 && format != OPENF_FORMAT_NV12) return;
+
+    // Subsampled chroma from the 2x2 RGB average, edges replicate the last row/column
+    const unsigned char* r1 = row1 ? row1 : row0;
+    unsigned char* u = (unsigned char*)p->plane[1] + (ptrdiff_t)(y / 2) * p->stride[1];
+    unsigned char* v = format == OPENF_FORMAT_YUV420 ? (unsigned char*)p->plane[2] + (ptrdiff_t)(y / 2) * p->stride[2] : NULL;
+    unsigned int cw = (width + 1) / 2;
+    for (unsigned int cx = k->rgba_to_chroma(row0, r1, width, u, v); cx < cw; cx++) {
+        unsigned int x0 = cx * 2, x1 = x0 + 1 < width ? x0 + 1 : x0;
+        int R = (row0[4 * x0] + row0[4 * x1] + r1[4 * x0] + r1[4 * x1] + 2) >> 2;
+        int G = (row0[4 * x0 + 1] + row0[4 * x1 + 1] + r1[4 * x0 + 1] + r1[4 * x1 + 1] + 2) >> 2;
+        int B = (row0[4 * x0 + 2] + row0[4 * x1 + 2] + r1[4 * x0 + 2] + r1[4 * x1 + 2] + 2) >> 2;
+        if (v) {
+            u[cx] = openf__rgb_to_u(R, G, B);
+            v[cx] = openf__rgb_to_v(R, G, B);
+        } else {
+            u[2 * cx] = openf__rgb_to_u(R, G, B);
+            u[2 * cx + 1] = openf__rgb_to_v(R, G, B);
+        }
+    }
+}
+
+typedef struct {
+    OpenF__Planes src;
+    OpenF__Planes dst;
+    OpenF_PixelFormat src_format;
+    OpenF_PixelFormat dst_format;
+    unsigned int width;
+    unsigned int height;
+    int failed;
+} OpenF__ConvertJob;
+
+static inline void openf__convert_band(void* ctx, size_t band) {
+    OpenF__ConvertJob* job = (OpenF__ConvertJob*)ctx;
+    unsigned int y_begin = (unsigned int)(band * OPENF__CONVERT_BAND * 2);
+    unsigned int y_end = y_begin + OPENF__CONVERT_BAND * 2;
+    if (y_end > job->height) y_end = job->height;
+
+    // Two RGBA scratch rows stay in cache between the decode and encode halves of each step
+    unsigned char* scratch = (unsigned char*)malloc((size_t)job->width * 8);
+    if (!scratch) {
+        job->failed = 1;
+        return;
+    }
+    unsigned char* row0 = scratch;
+    unsigned char* row1 = scratch + (size_t)job->width * 4;
+
+    for (unsigned int y = y_begin; y < y_end; y += 2) {
+        int pair = y + 1 < y_end;
+        openf__decode_row(&job->src, job->src_format, job->width, y, row0);
+        if (pair) openf__decode_row(&job->src, job->src_format, job->width, y + 1, row1);
+        openf__encode_rows(&job->dst, job->dst_format, job->width, y, row0, pair ? row1 : NULL);
+    }
+
+    free(scratch);
+}
+
+static inline OpenF_Error openf__convert_planes(const OpenF__Planes* src, OpenF_PixelFormat src_format,
+                                                unsigned int width, unsigned int height,
+                                                OpenF_PixelFormat dst_format, OpenF_Image** out_image) {
+    if (openf_image_buffer_size(1, 1, src_format) == 0 || openf_image_buffer_size(1, 1, dst_format) == 0) {
+        return OPENF_ERR_UNSUPPORTED;
+    }
+
+    OpenF_Image* dst = NULL;
+    OpenF_Error err = openf_create_image(width, height, dst_format, &dst);
+    if (err != OPENF_OK) return err;
+
+    OpenF__ConvertJob job;
+    memset(&job, 0, sizeof(job));
+    job.src = *src;
+    openf__image_planes(dst->pixels, width, height, dst_format, &job.dst);
+    job.src_format = src_format;
+    job.dst_format = dst_format;
+    job.width = width;
+    job.height = height;
+
+    if (src_format == dst_format && openf_format_bytes_per_pixel(src_format) != 0) {
+        size_t row_bytes = (size_t)width * openf_format_bytes_per_pixel(src_format);
+        for (unsigned int y = 0; y < height; y++) {
+            memcpy(dst->pixels + y * row_bytes, src->plane[0] + (ptrdiff_t)y * src->stride[0], row_bytes);
+        }
+    } else {
+        size_t bands = ((height + 1) / 2 + OPENF__CONVERT_BAND - 1) / OPENF__CONVERT_BAND;
+        openf__parallel_for(bands, 0, openf__convert_band, &job);
+    }
+
+    if (job.failed) {
+        openf_free_image(&dst);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+
+    *out_image = dst;
+    return OPENF_OK;
+}
+
+/* Convert an image to another pixel format in one fused pass, returning a new image */
+static inline OpenF_Error openf_image_convert(const OpenF_Image* src, OpenF_PixelFormat dst_format, OpenF_Image** out_image) {
+    if (!src || !src->pixels || !out_image) return OPENF_ERR_NULL_ARG;
+    if (src->width == 0 || src->height == 0) return OPENF_ERR_INVALID_ARG;
+
+    OpenF__Planes planes;
+    openf__image_planes(src->pixels, src->width, src->height, src->format, &planes);
+    OpenF_Error err = openf__convert_planes(&planes, src->format, src->width, src->height, dst_format, out_image);
+
+    OPENF_DBG_PRINT("openf_image_convert: %ux%u format %d -> %d (%d)", src->width, src->height,
+                    (int)src->format, (int)dst_format, (int)err);
+
+    return err;
+}
+
+/* Convert a mapped view (e.g. from openf_view_bmp) straight into a new image, reading each source pixel once */
+static inline OpenF_Error openf_view_convert(const OpenF_ImageView* view, OpenF_PixelFormat dst_format, OpenF_Image** out_image) {
+    if (!view || !view->data || !out_image) return OPENF_ERR_NULL_ARG;
+    if (openf_format_bytes_per_pixel(view->format) == 0) return OPENF_ERR_UNSUPPORTED;
+
+    OpenF__Planes planes;
+    memset(&planes, 0, sizeof(planes));
+    planes.plane[0] = view->data;
+    planes.stride[0] = view->stride;
+    return openf__convert_planes(&planes, view->format, view->width, view->height, dst_format, out_image);
+}
+
+/*-----------------------------------
+  Rotation, flipping and transposition
+------------------------------------*/
+
+typedef enum {
+    OPENF_FLIP_HORIZONTAL = 1,
+    OPENF_FLIP_VERTICAL = 2,
+    OPENF_FLIP_BOTH = 3
+} OpenF_FlipMode;
+
+#define OPENF__TILE 16  // Pixels per tile side; small tiles keep the rows a tile touches within the TLB
+
+typedef struct {
+    const unsigned char* src;
+    unsigned char* dst;
+    unsigned int width;     // Source dimensions; the destination is height x width
+    unsigned int height;
+    unsigned int bpp;
+    int flip_x;             // Reverse destination columns after transposing
+    int flip_y;             // Reverse destination rows after transposing
+} OpenF__OrientJob;
+
+static inline void openf__transpose_scalar(const OpenF__OrientJob* j, unsigned int x0, unsigned int y0,
+                                           unsigned int x1, unsigned int y1, unsigned int bpp) {
+    // Locals rather than job fields: byte stores may alias the job, which would force reloads per pixel
+    const unsigned char* src = j->src;
+    unsigned char* dst = j->dst;
+    unsigned int width = j->width, height = j->height;
+    int flip_x = j->flip_x, flip_y = j->flip_y;
+    size_t sstride = (size_t)width * bpp, dstride = (size_t)height * bpp;
+    for (unsigned int x = x0; x < x1; x++) {
+        unsigned int dy = flip_y ? width - 1 - x : x;
+        unsigned char* drow = dst + dy * dstride;
+        const unsigned char* scol = src + (size_t)x * bpp;
+        if (flip_x) {
+            for (unsigned int y = y0; y < y1; y++) {
+                memcpy(drow + (size_t)(height - 1 - y) * bpp, scol + y * sstride, bpp);
+            }
+        } else {
+            for (unsigned int y = y0; y < y1; y++) memcpy(drow + (size_t)y * bpp, scol + y * sstride, bpp);
+        }
+    }
+}
+
+static inline void openf__transpose_tile(const OpenF__OrientJob* j, unsigned int x0, unsigned int y0,
+                                         unsigned int x1, unsigned int y1) {
+#if defined(__SSE2__)
+    if (j->bpp == 4) {
+        // 4x4 blocks of 32-bit pixels transposed in registers, remainder strips fall through to scalar
+        unsigned char* dst = j->dst;
+        unsigned int width = j->width, height = j->height;
+        int flip_x = j->flip_x, flip_y = j->flip_y;
+        size_t sstride = (size_t)width * 4, dstride = (size_t)height * 4;
+        unsigned int xe = x0 + ((x1 - x0) & ~3u), ye = y0 + ((y1 - y0) & ~3u);
+        for (unsigned int y = y0; y < ye; y += 4) {
+            const unsigned char* s = j->src + y * sstride;
+            unsigned int dx = flip_x ? height - 4 - y : y;
+            for (unsigned int x = x0; x < xe; x += 4) {
+                __m128i r0 = _mm_loadu_si128((const __m128i*)(s + x * 4));
+                __m128i r1 = _mm_loadu_si128((const __m128i*)(s + sstride + x * 4));
+                __m128i r2 = _mm_loadu_si128((const __m128i*)(s + sstride * 2 + x * 4));
+                __m128i r3 = _mm_loadu_si128((const __m128i*)(s + sstride * 3 + x * 4));
+                __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+                __m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+                __m128i c[4];
+                c[0] = _mm_unpacklo_epi64(t0, t1);
+                c[1] = _mm_unpackhi_epi64(t0, t1);
+                c[2] = _mm_unpacklo_epi64(t2, t3);
+                c[3] = _mm_unpackhi_epi64(t2, t3);
+                for (int i = 0; i < 4; i++) {
+                    __m128i v = flip_x ? _mm_shuffle_epi32(c[i], 0x1B) : c[i];
+                    unsigned int dy = flip_y ? width - 1 - (x + i) : x + i;
+                    _mm_storeu_si128((__m128i*)(dst + dy * dstride + (size_t)dx * 4), v);
+                }
+            }
+        }
+        openf__transpose_scalar(j, xe, y0, x1, ye, 4);
+        openf__transpose_scalar(j, x0, ye, x1, y1, 4);
+        return;
+    }
+#endif
+    switch (j->bpp) {
+        case 1: openf__transpose_scalar(j, x0, y0, x1, y1, 1); break;
+        case 3: openf__transpose_scalar(j, x0, y0, x1, y1, 3); break;
+        default: openf__transpose_scalar(j, x0, y0, x1, y1, 4); break;
+    }
+}
+
+/* One task per band of tile rows, walking the tiles left to right */
+static inline void openf__transpose_band(void* ctx, size_t band) {
+    const OpenF__OrientJob* j = (const OpenF__OrientJob*)ctx;
+    unsigned int y0 = (unsigned int)(band * OPENF__TILE);
+    unsigned int y1 = y0 + OPENF__TILE < j->height ? y0 + OPENF__TILE : j->height;
+    for (unsigned int x0 = 0; x0 < j->width; x0 += OPENF__TILE) {
+        unsigned int x1 = x0 + OPENF__TILE < j->width ? x0 + OPENF__TILE : j->width;
+        openf__transpose_tile(j, x0, y0, x1, y1);
+    }
+}
+
+static inline void openf__reverse_row(unsigned char* row, unsigned int width, unsigned int bpp) {
+    unsigned char* a = row;
+    unsigned char* b = row + (size_t)(width - 1) * bpp;
+    for (; a < b; a += bpp, b -= bpp) {
+        for (unsigned int i = 0; i < bpp; i++) {
+            unsigned char t = a[i];
+            a[i] = b[i];
+            b[i] = t;
+        }
+    }
+}
+
+static inline void openf__reverse_pixels(unsigned char* row, unsigned int width, unsigned int bpp) {
+    switch (bpp) {
+        case 1: openf__reverse_row(row, width, 1); break;
+        case 3: openf__reverse_row(row, width, 3); break;
+        default: openf__reverse_row(row, width, 4); break;
+    }
+}
+
+/* Vertical flips give rows y and height-1-y to the same task, so swaps happen in place without races */
+static inline void openf__flip_row(void* ctx, size_t y) {
+    const OpenF__OrientJob* j = (const OpenF__OrientJob*)ctx;
+    size_t stride = (size_t)j->width * j->bpp;
+    unsigned char* top = j->dst + y * stride;
+    unsigned char* bottom = j->dst + (j->height - 1 - y) * stride;
+
+    if (!j->flip_y) {
+        openf__reverse_pixels(top, j->width, j->bpp);
+        return;
+    }
+    if (j->flip_x) {
+        openf__reverse_pixels(top, j->width, j->bpp);
+        if (bottom != top) openf__reverse_pixels(bottom, j->width, j->bpp);
+    }
+    // Swap through a small stack buffer so no allocation is needed
+    unsigned char tmp[1024];
+    for (size_t off = 0; bottom != top && off < stride; off += sizeof(tmp)) {
+        size_t n = stride - off < sizeof(tmp) ? stride - off : sizeof(tmp);
+        memcpy(tmp, top + off, n);
+        memcpy(top + off, bottom + off, n);
+        memcpy(bottom + off, tmp, n);
+    }
+}
+
+/* Flip a packed image in place */
+static inline OpenF_Error openf_image_flip(OpenF_Image* image, OpenF_FlipMode mode) {
+    if (!image || !image->pixels) return OPENF_ERR_NULL_ARG;
+    if ((int)mode < 1 || (int)mode > 3) return OPENF_ERR_INVALID_ARG;
+    unsigned int bpp = openf_format_bytes_per_pixel(image->format);
+    if (bpp == 0) return OPENF_ERR_UNSUPPORTED;
+
+    OpenF__OrientJob job;
+    memset(&job, 0, sizeof(job));
+    job.dst = image->pixels;
+    job.width = image->width;
+    job.height = image->height;
+    job.bpp = bpp;
+    job.flip_x = (mode & OPENF_FLIP_HORIZONTAL) != 0;
+    job.flip_y = (mode & OPENF_FLIP_VERTICAL) != 0;
+
+    // Vertical flips pair rows up, so only the top half is scheduled (plus the middle row if it needs mirroring)
+    size_t rows = image->height;
+    if (job.flip_y) rows = job.flip_x ? (image->height + 1) / 2 : image->height / 2;
+    openf__parallel_for(rows, 0, openf__flip_row, &job);
+
+    OPENF_DBG_PRINT("openf_image_flip: %ux%u mode %d", image->width, image->height, (int)mode);
+
+    return OPENF_OK;
+}
+
+/* Apply an EXIF orientation (1-8) and return the upright image */
+static inline OpenF_Error openf_image_orient(const OpenF_Image* src, int exif_orientation, OpenF_Image** out_image) {
+    if (!src || !src->pixels || !out_image) return OPENF_ERR_NULL_ARG;
+    if (exif_orientation < 1 || exif_orientation > 8) return OPENF_ERR_INVALID_ARG;
+    unsigned int bpp = openf_format_bytes_per_pixel(src->format);
+    if (bpp == 0) return OPENF_ERR_UNSUPPORTED;
+
+    OpenF_Image* dst = NULL;
+    OpenF_Error err;
+
+    if (exif_orientation <= 4) {
+        // Same dimensions: copy once, then flip in place
+        err = openf_create_image(src->width, src->height, src->format, &dst);
+        if (err != OPENF_OK) return err;
+        memcpy(dst->pixels, src->pixels, (size_t)src->width * src->height * bpp);
+        static const int flips[5] = {0, 0, OPENF_FLIP_HORIZONTAL, OPENF_FLIP_BOTH, OPENF_FLIP_VERTICAL};
+        if (flips[exif_orientation]) openf_image_flip(dst, (OpenF_FlipMode)flips[exif_orientation]);
+    } else {
+        err = openf_create_image(src->height, src->width, src->format, &dst);
+        if (err != OPENF_OK) return err;
+
+        OpenF__OrientJob job;
+        memset(&job, 0, sizeof(job));
+        job.src = src->pixels;
+        job.dst = dst->pixels;
+        job.width = src->width;
+        job.height = src->height;
+        job.bpp = bpp;
+        job.flip_x = exif_orientation == 6 || exif_orientation == 7;  // 90 CW, transverse
+        job.flip_y = exif_orientation == 7 || exif_orientation == 8;  // transverse, 270 CW
+        openf__parallel_for((src->height + OPENF__TILE - 1) / OPENF__TILE, 0, openf__transpose_band, &job);
+    }
+
+    *out_image = dst;
+
+    OPENF_DBG_PRINT("openf_image_orient: %ux%u orientation %d", src->width, src->height, exif_orientation);
+
+    return OPENF_OK;
+}
+
+/* Swap rows and columns (main-diagonal mirror) into a new image */
+static inline OpenF_Error openf_image_transpose(const OpenF_Image* src, OpenF_Image** out_image) {
+    return openf_image_orient(src, 5, out_image);
+}
+
+/* Rotate clockwise by a multiple of 90 degrees into a new image */
+static inline OpenF_Error openf_image_rotate(const OpenF_Image* src, int degrees, OpenF_Image** out_image) {
+    if (degrees % 90 != 0) return OPENF_ERR_INVALID_ARG;
+    static const int orientations[4] = {1, 6, 3, 8};
+    return openf_image_orient(src, orientations[((degrees / 90) % 4 + 4) % 4], out_image);
+}
+
+/*-----------------------------------
+  Convolution and blur
+------------------------------------*/
+
+#define OPENF__CONV_TILE_W 256  // Tile width in pixels
+#define OPENF__CONV_TILE_H 64
+#define OPENF__MAX_TAPS 255
+
+typedef struct {
+    const OpenF_Image* src;
+    OpenF_Image* dst;
+    unsigned int channels;
+    unsigned int rx;        // Horizontal radius (kernel has 2*rx+1 taps)
+    unsigned int ry;        // Vertical radius
+    const short* kx;        // Fixed-point taps, OPENF__RESIZE_BITS fraction bits
+    const short* ky;
+    unsigned int tiles_x;
+    unsigned int tile_h;
+    int failed;
+} OpenF__ConvolveJob;
+
+static inline size_t openf__taps_none(const unsigned char* const* rows, const short* w, unsigned int n, size_t len,
+                                      unsigned char* out) {
+    (void)rows;
+    (void)w;
+    (void)n;
+    (void)len;
+    (void)out;
+    return 0;
+}
+
+#if defined(__SSE2__)
+/* 16 bytes per step: taps are taken in pairs so one multiply-add covers two rows per 16-bit lane */
+static inline size_t openf__taps_sse2(const unsigned char* const* rows, const short* w, unsigned int n, size_t len,
+                                      unsigned char* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (OPENF__RESIZE_BITS - 1));
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+        for (unsigned int k = 0; k < n; k += 2) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(rows[k] + i));
+            __m128i b = k + 1 < n ? _mm_loadu_si128((const __m128i*)(rows[k + 1] + i)) : zero;
+            short wb = k + 1 < n ? w[k + 1] : 0;
+            __m128i wp = _mm_set1_epi32((int)((unsigned int)(unsigned short)w[k] | ((unsigned int)(unsigned short)wb << 16)));
+            __m128i alo = _mm_unpacklo_epi8(a, zero), ahi = _mm_unpackhi_epi8(a, zero);
+            __m128i blo = _mm_unpacklo_epi8(b, zero), bhi = _mm_unpackhi_epi8(b, zero);
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), wp));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), wp));
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), wp));
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), wp));
+        }
+        __m128i lo = _mm_packs_epi32(_mm_srai_epi32(acc0, OPENF__RESIZE_BITS), _mm_srai_epi32(acc1, OPENF__RESIZE_BITS));
+        __m128i hi = _mm_packs_epi32(_mm_srai_epi32(acc2, OPENF__RESIZE_BITS), _mm_srai_epi32(acc3, OPENF__RESIZE_BITS));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+    }
+    return i;
+}
+#endif
+
+#if OPENF__X86_DISPATCH
+/* 32 bytes per step; unpacking and packing both stay within 128-bit lanes, so bytes come out in order */
+OPENF__TARGET("avx2")
+static inline size_t openf__taps_avx2(const unsigned char* const* rows, const short* w, unsigned int n, size_t len,
+                                      unsigned char* out) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(1 << (OPENF__RESIZE_BITS - 1));
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+        for (unsigned int k = 0; k < n; k += 2) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(rows[k] + i));
+            __m256i b = k + 1 < n ? _mm256_loadu_si256((const __m256i*)(rows[k + 1] + i)) : zero;
+            short wb = k + 1 < n ? w[k + 1] : 0;
+            __m256i wp = _mm256_set1_epi32((int)((unsigned int)(unsigned short)w[k] | ((unsigned int)(unsigned short)wb << 16)));
+            __m256i alo = _mm256_unpacklo_epi8(a, zero), ahi = _mm256_unpackhi_epi8(a, zero);
+            __m256i blo = _mm256_unpacklo_epi8(b, zero), bhi = _mm256_unpackhi_epi8(b, zero);
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(alo, blo), wp));
+            acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(alo, blo), wp));
+            acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi16(ahi, bhi), wp));
+            acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi16(ahi, bhi), wp));
+        }
+        __m256i lo = _mm256_packs_epi32(_mm256_srai_epi32(acc0, OPENF__RESIZE_BITS), _mm256_srai_epi32(acc1, OPENF__RESIZE_BITS));
+        __m256i hi = _mm256_packs_epi32(_mm256_srai_epi32(acc2, OPENF__RESIZE_BITS), _mm256_srai_epi32(acc3, OPENF__RESIZE_BITS));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_packus_epi16(lo, hi));
+    }
+    return i;
+}
+#endif
+
+/* out[i] = sum_k w[k] * rows[k][i]; every tap is a contiguous byte run */
+static inline void openf__convolve_taps(const unsigned char* const* rows, const short* w, unsigned int n,
+                                        size_t len, unsigned char* out) {
+    size_t i = openf__dispatch()->taps(rows, w, n, len, out);
+    for (; i < len; i++) {
+        int acc = 0;
+        for (unsigned int k = 0; k < n; k++) acc += w[k] * rows[k][i];
+        out[i] = openf__clamp_fixed(acc);
+    }
+}
+
+static inline void openf__convolve_tile(void* ctx, size_t tile) {
+    OpenF__ConvolveJob* job = (OpenF__ConvolveJob*)ctx;
+    const OpenF_Image* src = job->src;
+    unsigned int ch = job->channels, rx = job->rx, ry = job->ry;
+    unsigned int x0 = (unsigned int)(tile % job->tiles_x) * OPENF__CONV_TILE_W;
+    unsigned int y0 = (unsigned int)(tile / job->tiles_x) * job->tile_h;
+    unsigned int tw = src->width - x0 < OPENF__CONV_TILE_W ? src->width - x0 : OPENF__CONV_TILE_W;
+    unsigned int th = src->height - y0 < job->tile_h ? src->height - y0 : job->tile_h;
+    unsigned int rows = th + 2 * ry;
+    size_t src_stride = (size_t)src->width * ch;
+    size_t line = (size_t)tw * ch;
+
+    // Horizontal pass over the tile plus its halo rows into a private buffer
+    unsigned char* padded = (unsigned char*)malloc((size_t)(tw + 2 * rx) * ch);
+    unsigned char* inter = (unsigned char*)malloc(line * rows);
+    if (!padded || !inter) {
+        free(padded);
+        free(inter);
+        job->failed = 1;
+        return;
+    }
+
+    const unsigned char* taps[OPENF__MAX_TAPS];
+    for (unsigned int j = 0; j < rows; j++) {
+        long sy = (long)y0 - (long)ry + (long)j;
+        if (sy < 0) sy = 0;
+        if (sy >= (long)src->height) sy = (long)src->height - 1;
+        const unsigned char* srow = src->pixels + (size_t)sy * src_stride;
+
+        // Copy the in-bounds span in one go and replicate edge pixels into the halo columns
+        long first = (long)x0 - (long)rx, last = (long)x0 + (long)tw + (long)rx;  // [first, last)
+        long in_lo = first < 0 ? 0 : first, in_hi = last > (long)src->width ? (long)src->width : last;
+        memcpy(padded + (size_t)(in_lo - first) * ch, srow + (size_t)in_lo * ch, (size_t)(in_hi - in_lo) * ch);
+        for (long sx = first; sx < in_lo; sx++) {
+            memcpy(padded + (size_t)(sx - first) * ch, srow, ch);
+        }
+        for (long sx = in_hi; sx < last; sx++) {
+            memcpy(padded + (size_t)(sx - first) * ch, srow + (src->width - 1) * (size_t)ch, ch);
+        }
+
+        for (unsigned int k = 0; k < 2 * rx + 1; k++) taps[k] = padded + (size_t)k * ch;
+        openf__convolve_taps(taps, job->kx, 2 * rx + 1, line, inter + j * line);
+    }
+
+    // Vertical pass into the destination tile
+    unsigned char* dst = job->dst->pixels + (size_t)y0 * src_stride + (size_t)x0 * ch;
+    for (unsigned int y = 0; y < th; y++) {
+        for (unsigned int k = 0; k < 2 * ry + 1; k++) taps[k] = inter + (y + k) * line;
+        openf__convolve_taps(taps, job->ky, 2 * ry + 1, line, dst + y * src_stride);
+    }
+
+    free(padded);
+    free(inter);
+}
+
+static inline OpenF_Error openf__convolve_run(OpenF__ConvolveJob* job, const OpenF_Image* src, OpenF_Image** out_image) {
+    OpenF_Image* dst = NULL;
+    OpenF_Error err = openf_create_image(src->width, src->height, src->format, &dst);
+    if (err != OPENF_OK) return err;
+
+    job->src = src;
+    job->dst = dst;
+    job->channels = openf_format_bytes_per_pixel(src->format);
+    job->tiles_x = (src->width + OPENF__CONV_TILE_W - 1) / OPENF__CONV_TILE_W;
+    // Keep the halo at most as tall as the tile so large radii do not multiply the horizontal work
+    job->tile_h = job->ry * 2 > OPENF__CONV_TILE_H ? job->ry * 2 : OPENF__CONV_TILE_H;
+    size_t tiles_y = (src->height + job->tile_h - 1) / job->tile_h;
+    openf__parallel_for(job->tiles_x * tiles_y, 0, openf__convolve_tile, job);
+
+    if (job->failed) {
+        openf_free_image(&dst);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    *out_image = dst;
+    return OPENF_OK;
+}
+
+static inline OpenF_Error openf__convolve_check(const OpenF_Image* src, OpenF_Image** out_image) {
+    if (!src || !src->pixels || !out_image) return OPENF_ERR_NULL_ARG;
+    if (src->width == 0 || src->height == 0) return OPENF_ERR_INVALID_ARG;
+    if (openf_format_bytes_per_pixel(src->format) == 0) return OPENF_ERR_UNSUPPORTED;
+    return OPENF_OK;
+}
+
+/* Convert float taps to signed 1.14 fixed point; normalized kernels keep an exact 1.0 sum. Fails with
+   OPENF_ERR_INVALID_ARG if a tap (before or after that adjustment) does not fit in a short, or is not a number. */
+static inline OpenF_Error openf__kernel_to_fixed(const float* kernel, unsigned int len, short* out) {
+    int fixed[OPENF__MAX_TAPS];
+    double total = 0.0;
+    int sum = 0, peak = 0;
+    for (unsigned int i = 0; i < len; i++) {
+        double v = floor(kernel[i] * (double)(1 << OPENF__RESIZE_BITS) + 0.5);
+        if (!(v >= -32768.0 && v <= 32767.0)) return OPENF_ERR_INVALID_ARG;
+        total += kernel[i];
+        fixed[i] = (int)v;
+        sum += fixed[i];
+        if (fixed[i] > fixed[peak]) peak = (int)i;
+    }
+    if (fabs(total - 1.0) < 1e-3) fixed[peak] += (1 << OPENF__RESIZE_BITS) - sum;
+    if (fixed[peak] > 32767 || fixed[peak] < -32768) return OPENF_ERR_INVALID_ARG;
+    for (unsigned int i = 0; i < len; i++) out[i] = (short)fixed[i];
+    return OPENF_OK;
+}
+
+/* Apply a separable kernel (odd lengths up to 255 taps, centered, edges replicated) */
+static inline OpenF_Error openf_image_convolve(const OpenF_Image* src, const float* kx, unsigned int kx_len,
+                                               const float* ky, unsigned int ky_len, OpenF_Image** out_image) {
+    OpenF_Error err = openf__convolve_check(src, out_image);
+    if (err != OPENF_OK) return err;
+    if (!kx || !ky) return OPENF_ERR_NULL_ARG;
+    if (kx_len % 2 == 0 || ky_len % 2 == 0 || kx_len > OPENF__MAX_TAPS || ky_len > OPENF__MAX_TAPS) {
+        return OPENF_ERR_INVALID_ARG;
+    }
+
+    // Fixed-point taps are signed 1.14, so each must lie within [-2.0, 32767 / 16384]
+    short fx[OPENF__MAX_TAPS], fy[OPENF__MAX_TAPS];
+    if (openf__kernel_to_fixed(kx, kx_len, fx) != OPENF_OK || openf__kernel_to_fixed(ky, ky_len, fy) != OPENF_OK) {
+        return OPENF_ERR_INVALID_ARG;
+    }
+
+    OpenF__ConvolveJob job;
+    memset(&job, 0, sizeof(job));
+    job.rx = kx_len / 2;
+    job.ry = ky_len / 2;
+    job.kx = fx;
+    job.ky = fy;
+    return openf__convolve_run(&job, src, out_image);
+}
+
+/* Running box sums never materialize the edge padding: window indices are clamped instead, so work and memory
+   depend on the image size only, whatever the radius. Both passes divide by the same 32.32 reciprocal. */
+#define OPENF__BOX_STRIP 1024   // Column strip of the vertical pass in bytes (one sums[] entry per byte)
+#define OPENF__BOX_ROWS 16      // Rows per horizontal work item
+
+typedef struct {
+    const OpenF_Image* src;
+    unsigned char* tmp;         // Horizontal pass output, same layout as src
+    OpenF_Image* dst;
+    unsigned int channels;
+    unsigned int rx;
+    unsigned int ry;
+    size_t strip;               // Bytes per vertical strip (a multiple of 16)
+} OpenF__BoxJob;
+
+static inline unsigned long long openf__box_reciprocal(unsigned int radius) {
+    unsigned int n = radius * 2 + 1;
+    return ((1ULL << 32) + n / 2) / n;
+}
+
+/* Horizontal box average of one row with edge pixels replicated (channels is 1, 3 or 4) */
+static inline void openf__box_row_ch(const unsigned char* row, unsigned int width, unsigned int channels,
+                                     unsigned int radius, unsigned char* out) {
+    // Scalar int/float conversions stall on false dependencies, so divide by a 32.32 reciprocal instead
+    const unsigned long long mul = openf__box_reciprocal(radius);
+    const unsigned long long half = 1ULL << 31;
+    const unsigned int last = width - 1;
+    const unsigned int span = radius < last ? radius : last;
+    const unsigned char* lp = row + (size_t)last * channels;
+    // Window at x = 0: radius + 1 copies of the first pixel, the next span pixels, then copies of the last
+    unsigned int s0 = (radius + 1) * row[0] + (radius - span) * lp[0], s1 = 0, s2 = 0, s3 = 0;
+    if (channels > 1) {
+        s1 = (radius + 1) * row[1] + (radius - span) * lp[1];
+        s2 = (radius + 1) * row[2] + (radius - span) * lp[2];
+    }
+    if (channels > 3) s3 = (radius + 1) * row[3] + (radius - span) * lp[3];
+    for (unsigned int i = 1; i <= span; i++) {
+        const unsigned char* p = row + (size_t)i * channels;
+        s0 += p[0];
+        if (channels > 1) {
+            s1 += p[1];
+            s2 += p[2];
+        }
+        if (channels > 3) s3 += p[3];
+    }
+    for (unsigned int x = 0;; x++) {
+        unsigned char* o = out + (size_t)x * channels;
+        o[0] = (unsigned char)((s0 * mul + half) >> 32);
+        if (channels > 1) {
+            o[1] = (unsigned char)((s1 * mul + half) >> 32);
+            o[2] = (unsigned char)((s2 * mul + half) >> 32);
+        }
+        if (channels > 3) o[3] = (unsigned char)((s3 * mul + half) >> 32);
+        if (x == last) break;
+        const unsigned char* in = row + (size_t)(x + radius + 1 < last ? x + radius + 1 : last) * channels;
+        const unsigned char* outgoing = row + (size_t)(x > radius ? x - radius : 0) * channels;
+        s0 += (unsigned int)in[0] - outgoing[0];
+        if (channels > 1) {
+            s1 += (unsigned int)in[1] - outgoing[1];
+            s2 += (unsigned int)in[2] - outgoing[2];
+        }
+        if (channels > 3) s3 += (unsigned int)in[3] - outgoing[3];
+    }
+}
+
+static inline void openf__box_rows(void* ctx, size_t band) {
+    const OpenF__BoxJob* job = (const OpenF__BoxJob*)ctx;
+    unsigned int width = job->src->width, ch = job->channels;
+    size_t stride = (size_t)width * ch;
+    unsigned int y0 = (unsigned int)band * OPENF__BOX_ROWS;
+    unsigned int y1 = y0 + OPENF__BOX_ROWS < job->src->height ? y0 + OPENF__BOX_ROWS : job->src->height;
+    for (unsigned int y = y0; y < y1; y++) {
+        const unsigned char* row = job->src->pixels + y * stride;
+        unsigned char* out = job->tmp + y * stride;
+        switch (ch) {
+            case 1: openf__box_row_ch(row, width, 1, job->rx, out); break;
+            case 3: openf__box_row_ch(row, width, 3, job->rx, out); break;
+            default: openf__box_row_ch(row, width, 4, job->rx, out); break;
+        }
+    }
+}
+
+/* Emit sums * mul (rounded, >> 32) as bytes, then slide the window: add in, drop outgoing (skipped when in is NULL) */
+static inline void openf__box_slide(unsigned int* sums, const unsigned char* in, const unsigned char* outgoing,
+                                    size_t len, unsigned long long mul, unsigned char* out) {
+    const unsigned long long half = 1ULL << 31;
+    size_t i = 0;
+#if defined(__SSE2__)
+    // mul < 2^32 here (radius > 0); 32x32->64 products on even and odd lanes, high halves recombined
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vmul = _mm_set1_epi32((int)(unsigned int)mul);
+    const __m128i vhalf = _mm_set1_epi64x((long long)half);
+    const __m128i high = _mm_set1_epi64x((long long)0xFFFFFFFF00000000ULL);
+    for (; i + 16 <= len; i += 16) {
+        __m128i r[4];
+        for (int q = 0; q < 4; q++) {
+            __m128i s = _mm_loadu_si128((const __m128i*)(sums + i + q * 4));
+            __m128i even = _mm_srli_epi64(_mm_add_epi64(_mm_mul_epu32(s, vmul), vhalf), 32);
+            __m128i odd = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(s, 32), vmul), vhalf);
+            r[q] = _mm_or_si128(even, _mm_and_si128(odd, high));
+        }
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(r[2], r[3])));
+        if (in) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(in + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(outgoing + i));
+            // Widen both rows to 16 bits; the difference fits in a signed 16-bit lane
+            __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            __m128i d[4];
+            d[0] = _mm_srai_epi32(_mm_unpacklo_epi16(dlo, dlo), 16);
+            d[1] = _mm_srai_epi32(_mm_unpackhi_epi16(dlo, dlo), 16);
+            d[2] = _mm_srai_epi32(_mm_unpacklo_epi16(dhi, dhi), 16);
+            d[3] = _mm_srai_epi32(_mm_unpackhi_epi16(dhi, dhi), 16);
+            for (int q = 0; q < 4; q++) {
+                __m128i s = _mm_loadu_si128((const __m128i*)(sums + i + q * 4));
+                _mm_storeu_si128((__m128i*)(sums + i + q * 4), _mm_add_epi32(s, d[q]));
+            }
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        out[i] = (unsigned char)((sums[i] * mul + half) >> 32);
+        if (in) sums[i] += (unsigned int)in[i] - outgoing[i];
+    }
+}
+
+/* Vertical pass over one column strip, top to bottom with a single running sum per byte */
+static inline void openf__box_columns(void* ctx, size_t strip) {
+    const OpenF__BoxJob* job = (const OpenF__BoxJob*)ctx;
+    unsigned int height = job->src->height, ry = job->ry, last = height - 1;
+    size_t stride = (size_t)job->src->width * job->channels;
+    size_t x0 = strip * job->strip;
+    size_t len = stride - x0 < job->strip ? stride - x0 : job->strip;
+    const unsigned char* col = job->tmp + x0;
+    unsigned char* out = job->dst->pixels + x0;
+    const unsigned long long mul = openf__box_reciprocal(ry);
+    unsigned int sums[OPENF__BOX_STRIP];
+
+    unsigned int span = ry < last ? ry : last;
+    const unsigned char* first = col;
+    const unsigned char* bottom = col + last * stride;
+    for (size_t i = 0; i < len; i++) sums[i] = (ry + 1) * first[i] + (ry - span) * bottom[i];
+    for (unsigned int k = 1; k <= span; k++) {
+        const unsigned char* r = col + k * stride;
+        for (size_t i = 0; i < len; i++) sums[i] += r[i];
+    }
+    for (unsigned int y = 0; y < height; y++) {
+        const unsigned char* in = y < last ? col + (size_t)(y + ry + 1 < last ? y + ry + 1 : last) * stride : NULL;
+        const unsigned char* outgoing = col + (size_t)(y > ry ? y - ry : 0) * stride;
+        openf__box_slide(sums, in, outgoing, len, mul, out + y * stride);
+    }
+}
+
+/* Box blur with a (2*radius+1)^2 window and replicated edges; cost per pixel does not depend on the radius */
+static inline OpenF_Error openf_image_box_blur(const OpenF_Image* src, unsigned int radius, OpenF_Image** out_image) {
+    OpenF_Error err = openf__convolve_check(src, out_image);
+    if (err != OPENF_OK) return err;
+    if (radius > 65535) return OPENF_ERR_INVALID_ARG;  // Keeps the column sums within 32 bits
+
+    OpenF_Image* dst = NULL;
+    err = openf_create_image(src->width, src->height, src->format, &dst);
+    if (err != OPENF_OK) return err;
+    size_t bytes = openf_image_buffer_size(src->width, src->height, src->format);
+    if (radius == 0) {
+        memcpy(dst->pixels, src->pixels, bytes);
+        *out_image = dst;
+        return OPENF_OK;
+    }
+
+    OpenF__BoxJob job;
+    job.src = src;
+    job.dst = dst;
+    job.channels = openf_format_bytes_per_pixel(src->format);
+    job.rx = job.ry = radius;
+    job.tmp = (unsigned char*)malloc(bytes);
+    if (!job.tmp) {
+        openf_free_image(&dst);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+
+    openf__parallel_for((src->height + OPENF__BOX_ROWS - 1) / OPENF__BOX_ROWS, 0, openf__box_rows, &job);
+
+    // Narrow images get thinner strips so every core still has a column range of its own
+    size_t stride = (size_t)src->width * job.channels;
+    size_t per_cpu = (stride / openf_cpu_count() + 15) & ~(size_t)15;
+    job.strip = per_cpu < OPENF__BOX_STRIP ? (per_cpu < 64 ? 64 : per_cpu) : OPENF__BOX_STRIP;
+    openf__parallel_for((stride + job.strip - 1) / job.strip, 0, openf__box_columns, &job);
+
+    free(job.tmp);
+    *out_image = dst;
+
+    OPENF_DBG_PRINT("openf_image_box_blur: %ux%u radius %u", src->width, src->height, radius);
+
+    return OPENF_OK;
+}
+
+/* Gaussian blur with a fixed-point kernel of radius ceil(3 * sigma) (sigma up to 42) */
+static inline OpenF_Error openf_image_gaussian_blur(const OpenF_Image* src, float sigma, OpenF_Image** out_image) {
+    OpenF_Error err = openf__convolve_check(src, out_image);
+    if (err != OPENF_OK) return err;
+    if (!(sigma > 0.0f)) return OPENF_ERR_INVALID_ARG;
+    unsigned int radius = (unsigned int)ceil(3.0 * sigma);
+    if (radius * 2 + 1 > OPENF__MAX_TAPS) return OPENF_ERR_INVALID_ARG;
+
+    float kernel[OPENF__MAX_TAPS];
+    double total = 0.0;
+    for (unsigned int i = 0; i < radius * 2 + 1; i++) {
+        double x = (double)i - radius;
+        kernel[i] = (float)exp(-x * x / (2.0 * sigma * sigma));
+        total += kernel[i];
+    }
+    for (unsigned int i = 0; i < radius * 2 + 1; i++) kernel[i] = (float)(kernel[i] / total);
+
+    err = openf_image_convolve(src, kernel, radius * 2 + 1, kernel, radius * 2 + 1, out_image);
+
+    OPENF_DBG_PRINT("openf_image_gaussian_blur: %ux%u sigma %.2f", src->width, src->height, sigma);
+
+    return err;
+}
+
+typedef struct {
+    const unsigned char* src;
+    unsigned char* blurred;   // Overwritten with the sharpened result
+    size_t size;
+    int amount;               // 8.8 fixed point
+} OpenF__SharpenJob;
+
+static inline void openf__sharpen_chunk(void* ctx, size_t chunk) {
+    OpenF__SharpenJob* job = (OpenF__SharpenJob*)ctx;
+    size_t begin = chunk * 65536, end = begin + 65536 < job->size ? begin + 65536 : job->size;
+    const unsigned char* OPENF_RESTRICT s = job->src;
+    unsigned char* OPENF_RESTRICT b = job->blurred;
+    for (size_t i = begin; i < end; i++) {
+        int v = s[i] + (((s[i] - b[i]) * job->amount + 128) >> 8);
+        b[i] = openf__clamp_u8(v);
+    }
+}
+
+/* Unsharp mask: src + amount * (src - gaussian(src, sigma)) */
+static inline OpenF_Error openf_image_sharpen(const OpenF_Image* src, float sigma, float amount, OpenF_Image** out_image) {
+    if (!(amount >= 0.0f) || amount > 64.0f) return OPENF_ERR_INVALID_ARG;
+    OpenF_Error err = openf_image_gaussian_blur(src, sigma, out_image);
+    if (err != OPENF_OK) return err;
+
+    OpenF__SharpenJob job;
+    job.src = src->pixels;
+    job.blurred = (*out_image)->pixels;
+    job.size = openf_image_buffer_size(src->width, src->height, src->format);
+    job.amount = (int)(amount * 256.0f + 0.5f);
+    openf__parallel_for((job.size + 65535) / 65536, 0, openf__sharpen_chunk, &job);
+    return OPENF_OK;
+}
+
+/*-----------------------------------
+  Histograms and statistics
+------------------------------------*/
+
+typedef struct {
+    unsigned int channels;              // Bytes per pixel of the source image
+    unsigned long long bins[4][256];    // bins[channel][value]
+} OpenF_Histogram;
+
+typedef struct {
+    unsigned int channels;
+    unsigned char min[4];
+    unsigned char max[4];
+    double mean[4];
+    double stddev[4];                   // Population standard deviation
+} OpenF_ImageStats;
+
+#define OPENF__STATS_CHUNK (1u << 18)   // Bytes per parallel task (rounded to whole SIMD blocks)
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    size_t chunk;
+    unsigned int channels;
+    unsigned int* hist;                 // Histogram jobs: channels * 256 counts per chunk
+    unsigned long long* sums;           // Stats jobs: per chunk sum, sum of squares, min, max per channel
+} OpenF__StatsJob;
+
+/* Four sub-histograms per channel so neighbouring pixels never increment the same counter back to back */
+static inline void openf__histogram_count(const unsigned char* p, size_t pixels, unsigned int ch, unsigned int* sub) {
+    unsigned int* h0 = sub;
+    unsigned int* h1 = sub + 4 * 256;
+    unsigned int* h2 = sub + 8 * 256;
+    unsigned int* h3 = sub + 12 * 256;
+    size_t i = 0;
+    for (; i + 4 <= pixels; i += 4, p += 4 * ch) {
+        for (unsigned int c = 0; c < ch; c++) {
+            h0[c * 256 + p[c]]++;
+            h1[c * 256 + p[ch + c]]++;
+            h2[c * 256 + p[2 * ch + c]]++;
+            h3[c * 256 + p[3 * ch + c]]++;
+        }
+    }
+    for (; i < pixels; i++, p += ch) {
+        for (unsigned int c = 0; c < ch; c++) h0[c * 256 + p[c]]++;
+    }
+}
+
+static inline void openf__histogram_chunk(void* ctx, size_t index) {
+    OpenF__StatsJob* job = (OpenF__StatsJob*)ctx;
+    size_t begin = index * job->chunk, end = begin + job->chunk < job->size ? begin + job->chunk : job->size;
+    unsigned int ch = job->channels;
+    const unsigned char* p = job->data + begin;
+    size_t pixels = (end - begin) / ch;
+    unsigned int* out = job->hist + index * ch * 256;
+
+    unsigned int sub[4 * 4 * 256];
+    memset(sub, 0, sizeof(sub));
+    switch (ch) {
+        case 1: openf__histogram_count(p, pixels, 1, sub); break;
+        case 3: openf__histogram_count(p, pixels, 3, sub); break;
+        default: openf__histogram_count(p, pixels, 4, sub); break;
+    }
+
+    for (unsigned int c = 0; c < ch; c++) {
+        for (unsigned int v = 0; v < 256; v++) {
+            out[c * 256 + v] = sub[c * 256 + v] + sub[(4 + c) * 256 + v] + sub[(8 + c) * 256 + v] + sub[(12 + c) * 256 + v];
+        }
+    }
+}
+
+static inline OpenF_Error openf__stats_setup(const OpenF_Image* image, OpenF__StatsJob* job, size_t* chunks) {
+    if (!image || !image->pixels) return OPENF_ERR_NULL_ARG;
+    unsigned int ch = openf_format_bytes_per_pixel(image->format);
+    if (ch == 0) return OPENF_ERR_UNSUPPORTED;
+    if (image->width == 0 || image->height == 0) return OPENF_ERR_INVALID_ARG;
+
+    memset(job, 0, sizeof(*job));
+    job->data = image->pixels;
+    job->size = (size_t)image->width * image->height * ch;
+    job->channels = ch;
+    job->chunk = OPENF__STATS_CHUNK - OPENF__STATS_CHUNK % (16 * ch);  // Whole pixels and whole 16-byte vectors
+    *chunks = (job->size + job->chunk - 1) / job->chunk;
+    return OPENF_OK;
+}
+
+/* Per-channel histogram of a packed image, counted in parallel chunks and merged */
+static inline OpenF_Error openf_image_histogram(const OpenF_Image* image, OpenF_Histogram* out_hist) {
+    if (!out_hist) return OPENF_ERR_NULL_ARG;
+    OpenF__StatsJob job;
+    size_t chunks = 0;
+    OpenF_Error err = openf__stats_setup(image, &job, &chunks);
+    if (err != OPENF_OK) return err;
+
+    job.hist = (unsigned int*)malloc(sizeof(unsigned int) * chunks * job.channels * 256);
+    if (!job.hist) return OPENF_ERR_MEM_ALLOC;
+    openf__parallel_for(chunks, 0, openf__histogram_chunk, &job);
+
+    memset(out_hist, 0, sizeof(*out_hist));
+    out_hist->channels = job.channels;
+    for (size_t k = 0; k < chunks; k++) {
+        const unsigned int* h = job.hist + k * job.channels * 256;
+        for (unsigned int c = 0; c < job.channels; c++) {
+            for (unsigned int v = 0; v < 256; v++) out_hist->bins[c][v] += h[c * 256 + v];
+        }
+    }
+    free(job.hist);
+
+    OPENF_DBG_PRINT("openf_image_histogram: %ux%u, %zu chunks", image->width, image->height, chunks);
+
+    return OPENF_OK;
+}
+
+/* Per-lane partial results of one stats chunk; lane l of vector v belongs to channel (16 * v + l) % channels */
+typedef struct {
+    unsigned long long sum[3][16];
+    unsigned long long sq[3][16];
+    unsigned char min[3][16];
+    unsigned char max[3][16];
+} OpenF__StatsLanes;
+
+static inline void openf__stats_chunk(void* ctx, size_t index) {
+    OpenF__StatsJob* job = (OpenF__StatsJob*)ctx;
+    size_t begin = index * job->chunk, end = begin + job->chunk < job->size ? begin + job->chunk : job->size;
+    unsigned int ch = job->channels;
+    const unsigned char* p = job->data + begin;
+    size_t len = end - begin, i = 0;
+    unsigned long long* out = job->sums + index * 4 * 4;  // [sum, sq, min, max] x channel
+
+    for (unsigned int c = 0; c < 4; c++) {
+        out[c] = out[4 + c] = out[12 + c] = 0;
+        out[8 + c] = 255;
+    }
+
+#if defined(__SSE2__)
+    // A block is the smallest run of whole pixels that is also whole vectors: 48 bytes for RGB, 16 otherwise
+    unsigned int vecs = ch == 3 ? 3 : 1;
+    size_t block = 16 * (size_t)vecs;
+    OpenF__StatsLanes lanes;
+    memset(&lanes, 0, sizeof(lanes));
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vmin[3], vmax[3];
+    for (unsigned int v = 0; v < 3; v++) {
+        vmin[v] = _mm_set1_epi8((char)0xFF);
+        vmax[v] = zero;
+    }
+
+    while (i + block <= len) {
+        // Batches of up to 256 blocks keep 16-bit sums and 32-bit squares from overflowing
+        size_t batch_end = i + block * 256 < len ? i + block * 256 : len - (len - i) % block;
+        __m128i s16[3][2], sq32[3][4];
+        for (unsigned int v = 0; v < vecs; v++) {
+            s16[v][0] = s16[v][1] = zero;
+            sq32[v][0] = sq32[v][1] = sq32[v][2] = sq32[v][3] = zero;
+        }
+        for (; i < batch_end; i += block) {
+            for (unsigned int v = 0; v < vecs; v++) {
+                __m128i x = _mm_loadu_si128((const __m128i*)(p + i + 16 * v));
+                vmin[v] = _mm_min_epu8(vmin[v], x);
+                vmax[v] = _mm_max_epu8(vmax[v], x);
+                __m128i lo = _mm_unpacklo_epi8(x, zero), hi = _mm_unpackhi_epi8(x, zero);
+                s16[v][0] = _mm_add_epi16(s16[v][0], lo);
+                s16[v][1] = _mm_add_epi16(s16[v][1], hi);
+                __m128i qlo = _mm_mullo_epi16(lo, lo), qhi = _mm_mullo_epi16(hi, hi);  // <= 65025, unsigned
+                sq32[v][0] = _mm_add_epi32(sq32[v][0], _mm_unpacklo_epi16(qlo, zero));
+                sq32[v][1] = _mm_add_epi32(sq32[v][1], _mm_unpackhi_epi16(qlo, zero));
+                sq32[v][2] = _mm_add_epi32(sq32[v][2], _mm_unpacklo_epi16(qhi, zero));
+                sq32[v][3] = _mm_add_epi32(sq32[v][3], _mm_unpackhi_epi16(qhi, zero));
+            }
+        }
+        for (unsigned int v = 0; v < vecs; v++) {
+            unsigned short s[16];
+            unsigned int q[16];
+            _mm_storeu_si128((__m128i*)s, s16[v][0]);
+            _mm_storeu_si128((__m128i*)(s + 8), s16[v][1]);
+            for (int k = 0; k < 4; k++) _mm_storeu_si128((__m128i*)(q + 4 * k), sq32[v][k]);
+            for (int l = 0; l < 16; l++) {
+                lanes.sum[v][l] += s[l];
+                lanes.sq[v][l] += q[l];
+            }
+        }
+    }
+
+    for (unsigned int v = 0; v < vecs; v++) {
+        _mm_storeu_si128((__m128i*)lanes.min[v], vmin[v]);
+        _mm_storeu_si128((__m128i*)lanes.max[v], vmax[v]);
+        for (unsigned int l = 0; l < 16; l++) {
+            unsigned int c = (16 * v + l) % ch;
+            out[c] += lanes.sum[v][l];
+            out[4 + c] += lanes.sq[v][l];
+            if (i > 0) {
+                if (lanes.min[v][l] < out[8 + c]) out[8 + c] = lanes.min[v][l];
+                if (lanes.max[v][l] > out[12 + c]) out[12 + c] = lanes.max[v][l];
+            }
+        }
+    }
+#endif
+
+    for (; i < len; i++) {
+        unsigned int c = (unsigned int)(i % ch), v = p[i];
+        out[c] += v;
+        out[4 + c] += v * v;
+        if (v < out[8 + c]) out[8 + c] = v;
+        if (v > out[12 + c]) out[12 + c] = v;
+    }
+}
+
+/* Per-channel min, max, mean and standard deviation using vector reductions over parallel chunks */
+static inline OpenF_Error openf_image_stats(const OpenF_Image* image, OpenF_ImageStats* out_stats) {
+    if (!out_stats) return OPENF_ERR_NULL_ARG;
+    OpenF__StatsJob job;
+    size_t chunks = 0;
+    OpenF_Error err = openf__stats_setup(image, &job, &chunks);
+    if (err != OPENF_OK) return err;
+
+    job.sums = (unsigned long long*)malloc(sizeof(unsigned long long) * chunks * 16);
+    if (!job.sums) return OPENF_ERR_MEM_ALLOC;
+    openf__parallel_for(chunks, 0, openf__stats_chunk, &job);
+
+    unsigned long long sum[4] = {0, 0, 0, 0}, sq[4] = {0, 0, 0, 0};
+    memset(out_stats, 0, sizeof(*out_stats));
+    out_stats->channels = job.channels;
+    for (unsigned int c = 0; c < job.channels; c++) out_stats->min[c] = 255;
+    for (size_t k = 0; k < chunks; k++) {
+        const unsigned long long* r = job.sums + k * 16;
+        for (unsigned int c = 0; c < job.channels; c++) {
+            sum[c] += r[c];
+            sq[c] += r[4 + c];
+            if (r[8 + c] < out_stats->min[c]) out_stats->min[c] = (unsigned char)r[8 + c];
+            if (r[12 + c] > out_stats->max[c]) out_stats->max[c] = (unsigned char)r[12 + c];
+        }
+    }
+    free(job.sums);
+
+    double n = (double)image->width * image->height;
+    for (unsigned int c = 0; c < job.channels; c++) {
+        double mean = sum[c] / n;
+        double var = sq[c] / n - mean * mean;
+        out_stats->mean[c] = mean;
+        out_stats->stddev[c] = var > 0.0 ? sqrt(var) : 0.0;
+    }
+
+    OPENF_DBG_PRINT("openf_image_stats: %ux%u, %zu chunks", image->width, image->height, chunks);
+
+    return OPENF_OK;
+}
+
+/*-----------------------------------
+  Fill, blit and alpha compositing
+------------------------------------*/
+
+typedef struct {
+    int x;
+    int y;
+    unsigned int width;
+    unsigned int height;
+} OpenF_Rect;
+
+typedef enum {
+    OPENF_BLEND_STRAIGHT = 0,       // Source colour is not multiplied by its alpha
+    OPENF_BLEND_PREMULTIPLIED       // Source (and RGBA destination) colour already multiplied by alpha
+} OpenF_BlendMode;
+
+#define OPENF__BLEND_BAND 64
+
+/* a * b / 255, exactly rounded */
+static inline unsigned int openf__mul255(unsigned int a, unsigned int b) {
+    unsigned int t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+/* Clip src_rect (NULL = whole source) placed at (dx, dy) against both images; returns 0 if nothing is left */
+static inline int openf__clip_rects(unsigned int dst_w, unsigned int dst_h, unsigned int src_w, unsigned int src_h,
+                                    int dx, int dy, const OpenF_Rect* src_rect, OpenF_Rect* out_src, int* out_dx, int* out_dy) {
+    long sx0 = src_rect ? src_rect->x : 0, sy0 = src_rect ? src_rect->y : 0;
+    long sx1 = sx0 + (long)(src_rect ? src_rect->width : src_w), sy1 = sy0 + (long)(src_rect ? src_rect->height : src_h);
+    long px = dx, py = dy;
+
+    // Clip to the source image, shifting the destination origin along
+    if (sx0 < 0) { px -= sx0; sx0 = 0; }
+    if (sy0 < 0) { py -= sy0; sy0 = 0; }
+    if (sx1 > (long)src_w) sx1 = (long)src_w;
+    if (sy1 > (long)src_h) sy1 = (long)src_h;
+
+    // Clip to the destination image
+    if (px < 0) { sx0 -= px; px = 0; }
+    if (py < 0) { sy0 -= py; py = 0; }
+    if (px + (sx1 - sx0) > (long)dst_w) sx1 = sx0 + ((long)dst_w - px);
+    if (py + (sy1 - sy0) > (long)dst_h) sy1 = sy0 + ((long)dst_h - py);
+
+    if (sx1 <= sx0 || sy1 <= sy0) return 0;
+    out_src->x = (int)sx0;
+    out_src->y = (int)sy0;
+    out_src->width = (unsigned int)(sx1 - sx0);
+    out_src->height = (unsigned int)(sy1 - sy0);
+    *out_dx = (int)px;
+    *out_dy = (int)py;
+    return 1;
+}
+
+/* Fill a rectangle (NULL = whole image) with one pixel value given in the image's byte order */
+static inline OpenF_Error openf_image_fill(OpenF_Image* image, const OpenF_Rect* rect, const unsigned char* color) {
+    if (!image || !image->pixels || !color) return OPENF_ERR_NULL_ARG;
+    unsigned int bpp = openf_format_bytes_per_pixel(image->format);
+    if (bpp == 0) return OPENF_ERR_UNSUPPORTED;
+
+    long x = 0, y = 0, x1 = image->width, y1 = image->height;
+    if (rect) {
+        x = rect->x > 0 ? rect->x : 0;
+        y = rect->y > 0 ? rect->y : 0;
+        if ((long)rect->x + (long)rect->width < x1) x1 = (long)rect->x + (long)rect->width;
+        if ((long)rect->y + (long)rect->height < y1) y1 = (long)rect->y + (long)rect->height;
+    }
+    if (x1 <= x || y1 <= y) return OPENF_OK;
+
+    size_t stride = (size_t)image->width * bpp;
+    size_t span = (size_t)(x1 - x) * bpp;
+    unsigned char* first = image->pixels + (size_t)y * stride + (size_t)x * bpp;
+
+    // Build the first row by doubling the pattern, then copy it down
+    memcpy(first, color, bpp);
+    for (size_t filled = bpp; filled < span;) {
+        size_t n = filled < span - filled ? filled : span - filled;
+        memcpy(first + filled, first, n);
+        filled += n;
+    }
+    for (long row = y + 1; row < y1; row++) memcpy(image->pixels + (size_t)row * stride + (size_t)x * bpp, first, span);
+
+    return OPENF_OK;
+}
+
+/* Copy a source rectangle (NULL = whole source) to (dx, dy), clipped; formats must match, overlap is allowed */
+static inline OpenF_Error openf_image_blit(OpenF_Image* dst, int dx, int dy, const OpenF_Image* src, const OpenF_Rect* src_rect) {
+    if (!dst || !dst->pixels || !src || !src->pixels) return OPENF_ERR_NULL_ARG;
+    if (dst->format != src->format) return OPENF_ERR_INVALID_ARG;
+    unsigned int bpp = openf_format_bytes_per_pixel(dst->format);
+    if (bpp == 0) return OPENF_ERR_UNSUPPORTED;
+
+    OpenF_Rect r;
+    int x, y;
+    if (!openf__clip_rects(dst->width, dst->height, src->width, src->height, dx, dy, src_rect, &r, &x, &y)) return OPENF_OK;
+
+    size_t dstride = (size_t)dst->width * bpp, sstride = (size_t)src->width * bpp, span = (size_t)r.width * bpp;
+    const unsigned char* s = src->pixels + (size_t)r.y * sstride + (size_t)r.x * bpp;
+    unsigned char* d = dst->pixels + (size_t)y * dstride + (size_t)x * bpp;
+
+    // Walk bottom-up when copying downwards within the same buffer so rows are read before being overwritten
+    if (dst->pixels == src->pixels && d > s) {
+        for (unsigned int row = r.height; row-- > 0;) memmove(d + row * dstride, s + row * sstride, span);
+    } else {
+        for (unsigned int row = 0; row < r.height; row++) memmove(d + row * dstride, s + row * sstride, span);
+    }
+    return OPENF_OK;
+}
+
+typedef struct {
+    unsigned char* dst;
+    const unsigned char* src;
+    size_t dstride;
+    size_t sstride;
+    unsigned int width;
+    unsigned int height;
+    unsigned int dst_bpp;
+    OpenF_BlendMode mode;
+} OpenF__BlendJob;
+
+/* Composite one RGBA source pixel over a destination pixel (dst_bpp 3 = opaque RGB, 4 = RGBA) */
+static inline void openf__blend_pixel(unsigned char* d, const unsigned char* s, unsigned int dst_bpp, OpenF_BlendMode mode) {
+    unsigned int a = s[3], ia = 255 - a;
+    if (mode == OPENF_BLEND_PREMULTIPLIED) {
+        for (unsigned int c = 0; c < dst_bpp; c++) {
+            unsigned int v = s[c] + openf__mul255(d[c], ia);
+            d[c] = (unsigned char)(v > 255 ? 255 : v);
+        }
+        return;
+    }
+    unsigned int da = dst_bpp == 4 ? d[3] : 255;
+    if (da == 255) {
+        for (unsigned int c = 0; c < 3; c++) d[c] = (unsigned char)(openf__mul255(s[c], a) + openf__mul255(d[c], ia));
+        return;
+    }
+    // Straight alpha over a translucent destination needs the full Porter-Duff divide (weights scaled by 255)
+    unsigned int ws = a * 255, wd = da * ia, oa = ws + wd;
+    for (unsigned int c = 0; c < 3; c++) d[c] = oa ? (unsigned char)((s[c] * ws + d[c] * wd + oa / 2) / oa) : 0;
+    d[3] = (unsigned char)((oa + 127) / 255);
+}
+
+#if defined(__SSE2__)
+/* Four RGBA pixels per step; returns how many pixels were handled */
+static inline unsigned int openf__blend_rgba_sse2(unsigned char* d, const unsigned char* s, unsigned int width, OpenF_BlendMode mode) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000u);
+    unsigned int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i vs = _mm_loadu_si128((const __m128i*)(s + 4 * x));
+        __m128i vd = _mm_loadu_si128((const __m128i*)(d + 4 * x));
+        // Straight alpha only vectorizes over opaque destinations; otherwise finish the row in scalar code
+        if (mode == OPENF_BLEND_STRAIGHT && _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(vd, alpha_mask), alpha_mask)) != 0xFFFF) break;
+        __m128i out[2];
+        for (int h = 0; h < 2; h++) {
+            __m128i s16 = h ? _mm_unpackhi_epi8(vs, zero) : _mm_unpacklo_epi8(vs, zero);
+            __m128i d16 = h ? _mm_unpackhi_epi8(vd, zero) : _mm_unpacklo_epi8(vd, zero);
+            __m128i a16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, 0xFF), 0xFF);  // Broadcast alpha per pixel
+            __m128i ia16 = _mm_sub_epi16(c255, a16);
+            // x * y / 255 with rounding: t = x*y + 128; (t + (t >> 8)) >> 8
+            __m128i td = _mm_add_epi16(_mm_mullo_epi16(d16, ia16), c128);
+            td = _mm_srli_epi16(_mm_add_epi16(td, _mm_srli_epi16(td, 8)), 8);
+            if (mode == OPENF_BLEND_PREMULTIPLIED) {
+                out[h] = _mm_add_epi16(s16, td);
+            } else {
+                __m128i ts = _mm_add_epi16(_mm_mullo_epi16(s16, a16), c128);
+                ts = _mm_srli_epi16(_mm_add_epi16(ts, _mm_srli_epi16(ts, 8)), 8);
+                out[h] = _mm_add_epi16(ts, td);
+            }
+        }
+        __m128i res = _mm_packus_epi16(out[0], out[1]);
+        if (mode == OPENF_BLEND_STRAIGHT) res = _mm_or_si128(res, alpha_mask);  // Opaque stays opaque
+        _mm_storeu_si128((__m128i*)(d + 4 * x), res);
+    }
+    return x;
+}
+#endif
+
+static inline void openf__blend_band(void* ctx, size_t band) {
+    OpenF__BlendJob* job = (OpenF__BlendJob*)ctx;
+    unsigned int y0 = (unsigned int)(band * OPENF__BLEND_BAND);
+    unsigned int y1 = y0 + OPENF__BLEND_BAND < job->height ? y0 + OPENF__BLEND_BAND : job->height;
+    for (unsigned int y = y0; y < y1; y++) {
+        unsigned char* d = job->dst + y * job->dstride;
+        const unsigned char* s = job->src + y * job->sstride;
+        unsigned int x = 0;
+        if (job->dst_bpp == 4) {
+#if defined(__SSE2__)
+            x = openf__blend_rgba_sse2(d, s, job->width, job->mode);
+#endif
+            for (; x < job->width; x++) openf__blend_pixel(d + 4 * x, s + 4 * x, 4, job->mode);
+        } else {
+            for (; x < job->width; x++) openf__blend_pixel(d + 3 * x, s + 4 * x, 3, job->mode);
+        }
+    }
+}
+
+/* Composite an RGBA32 source rectangle (NULL = whole source) over an RGBA32 or RGB24 destination at (dx, dy) */
+static inline OpenF_Error openf_image_blend(OpenF_Image* dst, int dx, int dy, const OpenF_Image* src,
+                                            const OpenF_Rect* src_rect, OpenF_BlendMode mode) {
+    if (!dst || !dst->pixels || !src || !src->pixels) return OPENF_ERR_NULL_ARG;
+    if (src->format != OPENF_FORMAT_RGBA32) return OPENF_ERR_UNSUPPORTED;
+    if (dst->format != OPENF_FORMAT_RGBA32 && dst->format != OPENF_FORMAT_RGB24) return OPENF_ERR_UNSUPPORTED;
+    if (mode != OPENF_BLEND_STRAIGHT && mode != OPENF_BLEND_PREMULTIPLIED) return OPENF_ERR_INVALID_ARG;
+
+    OpenF_Rect r;
+    int x, y;
+    if (!openf__clip_rects(dst->width, dst->height, src->width, src->height, dx, dy, src_rect, &r, &x, &y)) return OPENF_OK;
+
+    OpenF__BlendJob job;
+    job.dst_bpp = openf_format_bytes_per_pixel(dst->format);
+    job.dstride = (size_t)dst->width * job.dst_bpp;
+    job.sstride = (size_t)src->width * 4;
+    job.dst = dst->pixels + (size_t)y * job.dstride + (size_t)x * job.dst_bpp;
+    job.src = src->pixels + (size_t)r.y * job.sstride + (size_t)r.x * 4;
+    job.width = r.width;
+    job.height = r.height;
+    job.mode = mode;
+    openf__parallel_for((r.height + OPENF__BLEND_BAND - 1) / OPENF__BLEND_BAND, 0, openf__blend_band, &job);
+
+    return OPENF_OK;
+}
+
+/*-----------------------------------
+  Image pyramids (mip chains)
+------------------------------------*/
+
+typedef struct {
+    unsigned int levels;
+    OpenF_Image* level;     // level[i] is the source halved i+1 times; owned by the pyramid, not openf_free_image
+    void* storage;          // Single allocation holding the level array and all pixels
+} OpenF_Pyramid;
+
+#define OPENF__PYRAMID_FUSED 5      // Levels generated together per band before recursing on the last one
+#define OPENF__PYRAMID_ROWS 8       // Rows of the deepest fused level per band
+
+static inline unsigned int openf__halve_rgba_none(const unsigned char* a, const unsigned char* b, unsigned int src_w,
+                                                 unsigned char* out, unsigned int out_w) {
+    (void)a;
+    (void)b;
+    (void)src_w;
+    (void)out;
+    (void)out_w;
+    return 0;
+}
+
+#if defined(__SSE2__)
+/* Four RGBA output pixels per step; returns how many were produced */
+static inline unsigned int openf__halve_rgba_sse2(const unsigned char* a, const unsigned char* b, unsigned int src_w,
+                                                 unsigned char* out, unsigned int out_w) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    unsigned int x = 0;
+    for (; x + 4 <= out_w && 2 * x + 8 <= src_w; x += 4) {
+        __m128i r[2];
+        for (int h = 0; h < 2; h++) {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + 8 * x + 16 * h));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + 8 * x + 16 * h));
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));  // px0, px1
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));  // px2, px3
+            __m128i s01 = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+            __m128i s23 = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+            r[h] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s01, s23), two), 2);
+        }
+        _mm_storeu_si128((__m128i*)(out + 4 * x), _mm_packus_epi16(r[0], r[1]));
+    }
+    return x;
+}
+#endif
+
+#if OPENF__X86_DISPATCH
+/* Eight RGBA output pixels per step: the SSE2 sequence per 128-bit lane, then one permute to undo the lane split */
+OPENF__TARGET("avx2")
+static inline unsigned int openf__halve_rgba_avx2(const unsigned char* a, const unsigned char* b, unsigned int src_w,
+                                                 unsigned char* out, unsigned int out_w) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i two = _mm256_set1_epi16(2);
+    unsigned int x = 0;
+    for (; x + 8 <= out_w && 2 * x + 16 <= src_w; x += 8) {
+        __m256i r[2];
+        for (int h = 0; h < 2; h++) {
+            __m256i va = _mm256_loadu_si256((const __m256i*)(a + 8 * x + 32 * h));
+            __m256i vb = _mm256_loadu_si256((const __m256i*)(b + 8 * x + 32 * h));
+            __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(va, zero), _mm256_unpacklo_epi8(vb, zero));
+            __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(va, zero), _mm256_unpackhi_epi8(vb, zero));
+            __m256i s01 = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+            __m256i s23 = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+            r[h] = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(s01, s23), two), 2);
+        }
+        // Qwords come out as pixels {0,1}, {4,5}, {2,3}, {6,7}
+        __m256i packed = _mm256_packus_epi16(r[0], r[1]);
+        _mm256_storeu_si256((__m256i*)(out + 4 * x), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    return x;
+}
+#endif
+
+/* One destination row as the rounded 2x2 average of two source rows */
+static inline void openf__halve_row(const unsigned char* a, const unsigned char* b, unsigned int src_w,
+                                    unsigned char* out, unsigned int out_w, unsigned int ch) {
+    unsigned int x = ch == 4 ? openf__dispatch()->halve_rgba(a, b, src_w, out, out_w) : 0;
+    for (; x < out_w; x++) {
+        unsigned int x0 = 2 * x, x1 = 2 * x + 1 < src_w ? 2 * x + 1 : x0;
+        for (unsigned int c = 0; c < ch; c++) {
+            out[x * ch + c] = (unsigned char)((a[x0 * ch + c] + a[x1 * ch + c] + b[x0 * ch + c] + b[x1 * ch + c] + 2) >> 2);
+        }
+    }
+}
+
+typedef struct {
+    const OpenF_Image* base;
+    OpenF_Image* levels;    // Levels derived from base, fused count
+    unsigned int count;
+    unsigned int ch;
+} OpenF__PyramidJob;
+
+/* Produce row r of level k, then cascade into the next level while the rows it needs are still in cache */
+static inline void openf__pyramid_emit(const OpenF__PyramidJob* job, unsigned int k, unsigned int r) {
+    const OpenF_Image* src = k == 0 ? job->base : &job->levels[k - 1];
+    OpenF_Image* dst = &job->levels[k];
+    unsigned int ch = job->ch;
+    size_t sstride = (size_t)src->width * ch;
+    unsigned int r1 = 2 * r + 1 < src->height ? 2 * r + 1 : 2 * r;
+    unsigned char* out = dst->pixels + (size_t)r * dst->width * ch;
+    const unsigned char* a = src->pixels + (size_t)(2 * r) * sstride;
+    const unsigned char* b = src->pixels + (size_t)r1 * sstride;
+
+    switch (ch) {
+        case 1: openf__halve_row(a, b, src->width, out, dst->width, 1); break;
+        case 3: openf__halve_row(a, b, src->width, out, dst->width, 3); break;
+        default: openf__halve_row(a, b, src->width, out, dst->width, 4); break;
+    }
+
+    if (k + 1 < job->count && ((r & 1) || dst->height == 1) && r / 2 < job->levels[k + 1].height) {
+        openf__pyramid_emit(job, k + 1, r / 2);
+    }
+}
+
+static inline void openf__pyramid_band(void* ctx, size_t band) {
+    const OpenF__PyramidJob* job = (const OpenF__PyramidJob*)ctx;
+    unsigned int rows = OPENF__PYRAMID_ROWS << (job->count - 1);  // First-level rows per band
+    unsigned int r0 = (unsigned int)band * rows;
+    unsigned int r1 = r0 + rows < job->levels[0].height ? r0 + rows : job->levels[0].height;
+    for (unsigned int r = r0; r < r1; r++) openf__pyramid_emit(job, 0, r);
+}
+
+/* Build successive 2x downsamples of a packed image into one allocation (levels = 0 builds down to 1x1) */
+static inline OpenF_Error openf_image_build_pyramid(const OpenF_Image* image, unsigned int levels, OpenF_Pyramid* out_pyramid) {
+    if (!image || !image->pixels || !out_pyramid) return OPENF_ERR_NULL_ARG;
+    unsigned int ch = openf_format_bytes_per_pixel(image->format);
+    if (ch == 0) return OPENF_ERR_UNSUPPORTED;
+    if (image->width == 0 || image->height == 0) return OPENF_ERR_INVALID_ARG;
+    memset(out_pyramid, 0, sizeof(*out_pyramid));
+
+    unsigned int max_levels = 0;
+    for (unsigned int w = image->width, h = image->height; w > 1 || h > 1; max_levels++) {
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    if (levels == 0 || levels > max_levels) levels = max_levels;
+    if (levels == 0) return OPENF_ERR_INVALID_ARG;  // Already 1x1
+
+    // Level structs first, then each level's pixels on a 64-byte boundary
+    size_t header = (sizeof(OpenF_Image) * levels + 63) & ~(size_t)63;
+    size_t total = header;
+    unsigned int w = image->width, h = image->height;
+    for (unsigned int i = 0; i < levels; i++) {
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+        total += ((size_t)w * h * ch + 63) & ~(size_t)63;
+    }
+
+    unsigned char* storage = (unsigned char*)malloc(total);
+    if (!storage) return OPENF_ERR_MEM_ALLOC;
+    OpenF_Image* level = (OpenF_Image*)storage;
+    size_t offset = header;
+    w = image->width;
+    h = image->height;
+    for (unsigned int i = 0; i < levels; i++) {
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+        level[i].width = w;
+        level[i].height = h;
+        level[i].format = image->format;
+        level[i].pixels = storage + offset;
+        offset += ((size_t)w * h * ch + 63) & ~(size_t)63;
+    }
+
+    // Generate up to OPENF__PYRAMID_FUSED levels per pass in parallel bands, then continue from the last one
+    const OpenF_Image* base = image;
+    for (unsigned int done = 0; done < levels;) {
+        OpenF__PyramidJob job;
+        job.base = base;
+        job.levels = level + done;
+        job.count = levels - done < OPENF__PYRAMID_FUSED ? levels - done : OPENF__PYRAMID_FUSED;
+        job.ch = ch;
+        unsigned int rows = OPENF__PYRAMID_ROWS << (job.count - 1);
+        openf__parallel_for((job.levels[0].height + rows - 1) / rows, 0, openf__pyramid_band, &job);
+        done += job.count;
+        base = &level[done - 1];
+    }
+
+    out_pyramid->levels = levels;
+    out_pyramid->level = level;
+    out_pyramid->storage = storage;
+
+    OPENF_DBG_PRINT("openf_image_build_pyramid: %ux%u, %u levels in %zu bytes", image->width, image->height, levels, total);
+
+    return OPENF_OK;
+}
+
+/* Release a pyramid built by openf_image_build_pyramid */
+static inline void openf_free_pyramid(OpenF_Pyramid* pyramid) {
+    if (!pyramid) return;
+    free(pyramid->storage);
+    memset(pyramid, 0, sizeof(*pyramid));
+}
+
+typedef struct {
+    const OpenF_Pyramid* pyramid;
+    const char* prefix;
+    OpenF_Error* errors;
+} OpenF__PyramidSaveJob;
+
+static inline void openf__pyramid_save_one(void* ctx, size_t i) {
+    OpenF__PyramidSaveJob* job = (OpenF__PyramidSaveJob*)ctx;
+    size_t len = strlen(job->prefix) + 16;
+    char* path = (char*)malloc(len);
+    if (!path) {
+        job->errors[i] = OPENF_ERR_MEM_ALLOC;
+        return;
+    }
+    snprintf(path, len, "%s%u.bmp", job->prefix, (unsigned int)(i + 1));
+    job->errors[i] = openf_save_bmp(path, &job->pyramid->level[i]);
+    free(path);
+}
+
+/* Write every level (RGB24, BGR24, RGBA32 or GRAY8, as openf_save_bmp accepts) as "<prefix><n>.bmp" (n = 1 for the first halving) concurrently */
+static inline OpenF_Error openf_pyramid_save_bmp(const OpenF_Pyramid* pyramid, const char* prefix) {
+    if (!pyramid || !pyramid->level || !prefix) return OPENF_ERR_NULL_ARG;
+    OpenF_Error* errors = (OpenF_Error*)malloc(sizeof(OpenF_Error) * pyramid->levels);
+    if (!errors) return OPENF_ERR_MEM_ALLOC;
+
+    OpenF__PyramidSaveJob job = {pyramid, prefix, errors};
+    openf__parallel_for(pyramid->levels, 0, openf__pyramid_save_one, &job);
+
+    OpenF_Error result = OPENF_OK;
+    for (unsigned int i = 0; i < pyramid->levels && result == OPENF_OK; i++) result = errors[i];
+    free(errors);
+    return result;
+}
+
+/*-----------------------------------
+  Image comparison
+------------------------------------*/
+
+typedef struct {
+    int identical;              // Non-zero when the pixel buffers are byte-for-byte equal
+    unsigned int max_diff;      // Largest absolute difference of any channel
+    double mse;                 // Mean squared error over all channels
+    double psnr;                // Peak signal-to-noise ratio in dB (INFINITY when identical)
+    double ssim;                // Mean SSIM of 8x8 luma windows (step 4); 1.0 when identical
+} OpenF_CompareResult;
+
+#define OPENF__COMPARE_BAND 64      // Rows per diff task
+#define OPENF__SSIM_BAND 16         // Window rows per SSIM task
+
+typedef struct {
+    const OpenF_Image* a;
+    const OpenF_Image* b;
+    unsigned char* mask;            // Optional GRAY8 output
+    unsigned int ch;
+    unsigned int* band_max;
+    unsigned long long* band_sse;
+} OpenF__CompareJob;
+
+static inline size_t openf__compare_none(const unsigned char* a, const unsigned char* b, size_t n, unsigned int ch,
+                                         unsigned char* mask, unsigned int* io_max, unsigned long long* io_sse) {
+    (void)a;
+    (void)b;
+    (void)n;
+    (void)ch;
+    (void)mask;
+    (void)io_max;
+    (void)io_sse;
+    return 0;
+}
+
+#if defined(__SSE2__)
+/* 16 bytes per step for ch 1 or 4 (or any ch without a mask); returns how many bytes were consumed */
+static inline size_t openf__compare_sse2(const unsigned char* a, const unsigned char* b, size_t n, unsigned int ch,
+                                         unsigned char* mask, unsigned int* io_max, unsigned long long* io_sse) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vmax = zero;
+    size_t i = 0;
+    while (i + 16 <= n) {
+        // A 32-bit lane gains at most 4 * 255^2 per step, so flush before it can overflow
+        size_t stop = n - i < (size_t)16 * 8192 ? n - 15 : i + (size_t)16 * 8192;
+        __m128i acc = zero;
+        for (; i < stop; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+            __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+            vmax = _mm_max_epu8(vmax, d);
+            __m128i lo = _mm_unpacklo_epi8(d, zero), hi = _mm_unpackhi_epi8(d, zero);
+            acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+            if (mask && ch == 1) {
+                _mm_storeu_si128((__m128i*)(mask + i), d);
+            } else if (mask) {
+                d = _mm_max_epu8(d, _mm_srli_epi32(d, 8));
+                d = _mm_max_epu8(d, _mm_srli_epi32(d, 16));
+                d = _mm_and_si128(d, _mm_set1_epi32(0xFF));
+                d = _mm_packs_epi32(d, zero);
+                d = _mm_packus_epi16(d, zero);
+                int packed = _mm_cvtsi128_si32(d);
+                memcpy(mask + i / 4, &packed, 4);
+            }
+        }
+        unsigned int lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        *io_sse += (unsigned long long)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    unsigned char bytes[16];
+    _mm_storeu_si128((__m128i*)bytes, vmax);
+    for (int k = 0; k < 16; k++) {
+        if (bytes[k] > *io_max) *io_max = bytes[k];
+    }
+    return i;
+}
+#endif
+
+#if OPENF__X86_DISPATCH
+/* 32 bytes per step; same contract as openf__compare_sse2 */
+OPENF__TARGET("avx2")
+static inline size_t openf__compare_avx2(const unsigned char* a, const unsigned char* b, size_t n, unsigned int ch,
+                                         unsigned char* mask, unsigned int* io_max, unsigned long long* io_sse) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i vmax = zero;
+    size_t i = 0;
+    while (i + 32 <= n) {
+        size_t stop = n - i < (size_t)32 * 8192 ? n - 31 : i + (size_t)32 * 8192;
+        __m256i acc = zero;
+        for (; i < stop; i += 32) {
+            __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+            __m256i d = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+            vmax = _mm256_max_epu8(vmax, d);
+            __m256i lo = _mm256_unpacklo_epi8(d, zero), hi = _mm256_unpackhi_epi8(d, zero);
+            acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+            if (mask && ch == 1) {
+                _mm256_storeu_si256((__m256i*)(mask + i), d);
+            } else if (mask) {
+                // Per-pixel max lands in byte 0 of each dword; packing keeps lanes apart, so store each half
+                d = _mm256_max_epu8(d, _mm256_srli_epi32(d, 8));
+                d = _mm256_max_epu8(d, _mm256_srli_epi32(d, 16));
+                d = _mm256_and_si256(d, _mm256_set1_epi32(0xFF));
+                d = _mm256_packus_epi16(_mm256_packs_epi32(d, zero), zero);
+                int lo4 = _mm_cvtsi128_si32(_mm256_castsi256_si128(d));
+                int hi4 = _mm_cvtsi128_si32(_mm256_extracti128_si256(d, 1));
+                memcpy(mask + i / 4, &lo4, 4);
+                memcpy(mask + i / 4 + 4, &hi4, 4);
+            }
+        }
+        unsigned int lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        for (int k = 0; k < 8; k++) *io_sse += lanes[k];
+    }
+    unsigned char bytes[32];
+    _mm256_storeu_si256((__m256i*)bytes, vmax);
+    for (int k = 0; k < 32; k++) {
+        if (bytes[k] > *io_max) *io_max = bytes[k];
+    }
+    return i;
+}
+#endif
+
+/* Max abs diff and squared error of one row; writes the per-pixel max abs diff when mask is set */
+static inline void openf__compare_row(const unsigned char* a, const unsigned char* b, unsigned int width, unsigned int ch,
+                                      unsigned char* mask, unsigned int* io_max, unsigned long long* io_sse) {
+    size_t n = (size_t)width * ch, i = 0;
+    unsigned int max = *io_max;
+    unsigned long long sse = 0;
+    if (!mask || ch == 1 || ch == 4) i = openf__dispatch()->compare(a, b, n, ch, mask, &max, &sse);
+    if (!mask) {
+        for (; i < n; i++) {
+            unsigned int ad = (unsigned int)(a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]);
+            sse += ad * ad;
+            if (ad > max) max = ad;
+        }
+    }
+    for (; i < n; i += ch) {
+        unsigned int pixel_max = 0;
+        for (unsigned int c = 0; c < ch; c++) {
+            int d = a[i + c] - b[i + c];
+            unsigned int ad = (unsigned int)(d < 0 ? -d : d);
+            sse += (unsigned long long)(ad * ad);
+            if (ad > pixel_max) pixel_max = ad;
+        }
+        if (pixel_max > max) max = pixel_max;
+        if (mask) mask[i / ch] = (unsigned char)pixel_max;
+    }
+    *io_max = max;
+    *io_sse += sse;
+}
+
+static inline void openf__compare_band(void* ctx, size_t band) {
+    const OpenF__CompareJob* job = (const OpenF__CompareJob*)ctx;
+    unsigned int width = job->a->width, ch = job->ch;
+    unsigned int y0 = (unsigned int)band * OPENF__COMPARE_BAND;
+    unsigned int y1 = y0 + OPENF__COMPARE_BAND < job->a->height ? y0 + OPENF__COMPARE_BAND : job->a->height;
+    size_t stride = (size_t)width * ch;
+    unsigned int max = 0;
+    unsigned long long sse = 0;
+    for (unsigned int y = y0; y < y1; y++) {
+        openf__compare_row(job->a->pixels + y * stride, job->b->pixels + y * stride, width, ch,
+                           job->mask ? job->mask + (size_t)y * width : NULL, &max, &sse);
+    }
+    job->band_max[band] = max;
+    job->band_sse[band] = sse;
+}
+
+/* Full-range BT.601 luma of one packed row */
+static inline void openf__luma_row(const unsigned char* p, unsigned int width, OpenF_PixelFormat format, unsigned char* out) {
+    unsigned int ch = openf_format_bytes_per_pixel(format);
+    if (ch == 1) {
+        memcpy(out, p, width);
+        return;
+    }
+    unsigned int ri = format == OPENF_FORMAT_BGR24 ? 2 : 0, bi = 2 - ri;
+    for (unsigned int x = 0; x < width; x++, p += ch) {
+        out[x] = (unsigned char)((77 * p[ri] + 150 * p[1] + 29 * p[bi] + 128) >> 8);
+    }
+}
+
+/* SSIM of one window from its sums over n samples */
+static inline double openf__ssim_window(double sa, double sb, double saa, double sbb, double sab, double n) {
+    const double c1 = (0.01 * 255) * (0.01 * 255) * n * n;
+    const double c2 = (0.03 * 255) * (0.03 * 255) * n * (n - 1);
+    if (n <= 1) return (2 * sa * sb + c1) / (sa * sa + sb * sb + c1);  // No variance term for a single sample
+    double var = (saa + sbb) * n - sa * sa - sb * sb;
+    double covar = sab * n - sa * sb;
+    return (2 * sa * sb + c1) * (2 * covar + c2) / ((sa * sa + sb * sb + c1) * (var + c2));
+}
+
+typedef struct {
+    const OpenF_Image* a;
+    const OpenF_Image* b;
+    unsigned int blocks_x;          // 4x4 blocks per row
+    unsigned int windows_y;         // Rows of 8x8 windows (blocks_y - 1)
+    double* band_sum;
+    int failed;
+} OpenF__SsimJob;
+
+/* Sums over each 4x4 block of one block row, stored as five planes: a, b, a^2, b^2, ab */
+static inline void openf__ssim_blocks(const OpenF__SsimJob* job, unsigned int by, unsigned char* luma, unsigned int* sums) {
+    unsigned int width = job->a->width, bx_count = job->blocks_x;
+    size_t stride = (size_t)width * openf_format_bytes_per_pixel(job->a->format);
+    memset(sums, 0, sizeof(unsigned int) * 5 * bx_count);
+    for (unsigned int r = 0; r < 4; r++) {
+        size_t y = (size_t)by * 4 + r;
+        openf__luma_row(job->a->pixels + y * stride, width, job->a->format, luma);
+        openf__luma_row(job->b->pixels + y * stride, width, job->b->format, luma + width);
+        const unsigned char* la = luma;
+        const unsigned char* lb = luma + width;
+        unsigned int bx = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi16(1);
+        for (; bx + 4 <= bx_count; bx += 4) {
+            // Four blocks at a time: pair sums from madd, then fold adjacent pairs into block sums
+            __m128i va = _mm_loadu_si128((const __m128i*)(la + 4 * bx));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(lb + 4 * bx));
+            __m128i alo = _mm_unpacklo_epi8(va, zero), ahi = _mm_unpackhi_epi8(va, zero);
+            __m128i blo = _mm_unpacklo_epi8(vb, zero), bhi = _mm_unpackhi_epi8(vb, zero);
+            __m128i lo[5], hi[5];
+            lo[0] = _mm_madd_epi16(alo, one);
+            hi[0] = _mm_madd_epi16(ahi, one);
+            lo[1] = _mm_madd_epi16(blo, one);
+            hi[1] = _mm_madd_epi16(bhi, one);
+            lo[2] = _mm_madd_epi16(alo, alo);
+            hi[2] = _mm_madd_epi16(ahi, ahi);
+            lo[3] = _mm_madd_epi16(blo, blo);
+            hi[3] = _mm_madd_epi16(bhi, bhi);
+            lo[4] = _mm_madd_epi16(alo, blo);
+            hi[4] = _mm_madd_epi16(ahi, bhi);
+            for (int q = 0; q < 5; q++) {
+                __m128i l = _mm_shuffle_epi32(lo[q], _MM_SHUFFLE(3, 1, 2, 0));
+                __m128i h = _mm_shuffle_epi32(hi[q], _MM_SHUFFLE(3, 1, 2, 0));
+                __m128i blocks = _mm_add_epi32(_mm_unpacklo_epi64(l, h), _mm_unpackhi_epi64(l, h));
+                __m128i* o = (__m128i*)(sums + q * bx_count + bx);
+                _mm_storeu_si128(o, _mm_add_epi32(_mm_loadu_si128(o), blocks));
+            }
+        }
+#endif
+        for (; bx < bx_count; bx++) {
+            unsigned int s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0;
+            for (unsigned int x = bx * 4; x < bx * 4 + 4; x++) {
+                unsigned int va = la[x], vb = lb[x];
+                s0 += va;
+                s1 += vb;
+                s2 += va * va;
+                s3 += vb * vb;
+                s4 += va * vb;
+            }
+            sums[bx] += s0;
+            sums[bx_count + bx] += s1;
+            sums[2 * bx_count + bx] += s2;
+            sums[3 * bx_count + bx] += s3;
+            sums[4 * bx_count + bx] += s4;
+        }
+    }
+}
+
+static inline void openf__ssim_band(void* ctx, size_t band) {
+    OpenF__SsimJob* job = (OpenF__SsimJob*)ctx;
+    unsigned int bx_count = job->blocks_x;
+    unsigned int w0 = (unsigned int)band * OPENF__SSIM_BAND;
+    unsigned int w1 = w0 + OPENF__SSIM_BAND < job->windows_y ? w0 + OPENF__SSIM_BAND : job->windows_y;
+
+    unsigned int* sums = (unsigned int*)malloc(sizeof(unsigned int) * 10 * bx_count + (size_t)2 * job->a->width);
+    if (!sums) {
+        job->failed = 1;
+        return;
+    }
+    unsigned int* prev = sums;
+    unsigned int* cur = sums + 5 * bx_count;
+    unsigned char* luma = (unsigned char*)(sums + 10 * bx_count);
+
+    double total = 0;
+    openf__ssim_blocks(job, w0, luma, prev);
+    for (unsigned int wy = w0; wy < w1; wy++) {
+        openf__ssim_blocks(job, wy + 1, luma, cur);
+        for (unsigned int bx = 0; bx + 1 < bx_count; bx++) {
+            double t[5];
+            for (unsigned int q = 0; q < 5; q++) {
+                size_t k = q * bx_count + bx;
+                t[q] = (double)prev[k] + prev[k + 1] + cur[k] + cur[k + 1];
+            }
+            total += openf__ssim_window(t[0], t[1], t[2], t[3], t[4], 64.0);
+        }
+        unsigned int* swap = prev;
+        prev = cur;
+        cur = swap;
+    }
+    job->band_sum[band] = total;
+    free(sums);
+}
+
+/* Whole-image SSIM used when the image is too small for 8x8 windows */
+static inline OpenF_Error openf__ssim_global(const OpenF_Image* a, const OpenF_Image* b, double* out_ssim) {
+    unsigned int width = a->width;
+    size_t stride = (size_t)width * openf_format_bytes_per_pixel(a->format);
+    unsigned char* luma = (unsigned char*)malloc((size_t)2 * width);
+    if (!luma) return OPENF_ERR_MEM_ALLOC;
+    double t[5] = {0, 0, 0, 0, 0};
+    for (unsigned int y = 0; y < a->height; y++) {
+        openf__luma_row(a->pixels + y * stride, width, a->format, luma);
+        openf__luma_row(b->pixels + y * stride, width, b->format, luma + width);
+        for (unsigned int x = 0; x < width; x++) {
+            double va = luma[x], vb = luma[width + x];
+            t[0] += va;
+            t[1] += vb;
+            t[2] += va * va;
+            t[3] += vb * vb;
+            t[4] += va * vb;
+        }
+    }
+    free(luma);
+    double n = (double)width * a->height;
+    *out_ssim = openf__ssim_window(t[0], t[1], t[2], t[3], t[4], n);
+    return OPENF_OK;
+}
+
+/* Compare two packed images of the same size and format. out_mask (optional) receives a GRAY8 image
+   holding the largest channel difference of each pixel. */
+static inline OpenF_Error openf_image_compare(const OpenF_Image* a, const OpenF_Image* b, OpenF_CompareResult* out_result,
+                                              OpenF_Image** out_mask) {
+    if (!a || !b || !a->pixels || !b->pixels || !out_result) return OPENF_ERR_NULL_ARG;
+    unsigned int ch = openf_format_bytes_per_pixel(a->format);
+    if (ch == 0) return OPENF_ERR_UNSUPPORTED;
+    if (a->format != b->format || a->width != b->width || a->height != b->height || a->width == 0 || a->height == 0) {
+        return OPENF_ERR_INVALID_ARG;
+    }
+    if (out_mask) *out_mask = NULL;
+
+    OpenF_Image* mask = NULL;
+    if (out_mask) {
+        OpenF_Error err = openf_create_image(a->width, a->height, OPENF_FORMAT_GRAY8, &mask);
+        if (err != OPENF_OK) return err;
+    }
+
+    size_t size = (size_t)a->width * a->height * ch;
+    if (memcmp(a->pixels, b->pixels, size) == 0) {
+        // Identical buffers: skip every metric
+        out_result->identical = 1;
+        out_result->max_diff = 0;
+        out_result->mse = 0.0;
+        out_result->psnr = INFINITY;
+        out_result->ssim = 1.0;
+        if (mask) {
+            memset(mask->pixels, 0, (size_t)a->width * a->height);
+            *out_mask = mask;
+        }
+        return OPENF_OK;
+    }
+
+    size_t bands = (a->height + OPENF__COMPARE_BAND - 1) / OPENF__COMPARE_BAND;
+    OpenF__CompareJob job;
+    job.a = a;
+    job.b = b;
+    job.mask = mask ? mask->pixels : NULL;
+    job.ch = ch;
+    job.band_max = (unsigned int*)malloc(sizeof(unsigned int) * bands);
+    job.band_sse = (unsigned long long*)malloc(sizeof(unsigned long long) * bands);
+    if (!job.band_max || !job.band_sse) {
+        free(job.band_max);
+        free(job.band_sse);
+        openf_free_image(&mask);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    openf__parallel_for(bands, 0, openf__compare_band, &job);
+
+    unsigned int max = 0;
+    unsigned long long sse = 0;
+    for (size_t i = 0; i < bands; i++) {
+        if (job.band_max[i] > max) max = job.band_max[i];
+        sse += job.band_sse[i];
+    }
+    free(job.band_max);
+    free(job.band_sse);
+
+    double ssim = 0.0;
+    OpenF_Error err = OPENF_OK;
+    if (a->width >= 8 && a->height >= 8) {
+        OpenF__SsimJob sj;
+        sj.a = a;
+        sj.b = b;
+        sj.blocks_x = a->width / 4;
+        sj.windows_y = a->height / 4 - 1;
+        sj.failed = 0;
+        size_t ssim_bands = (sj.windows_y + OPENF__SSIM_BAND - 1) / OPENF__SSIM_BAND;
+        sj.band_sum = (double*)malloc(sizeof(double) * ssim_bands);
+        if (!sj.band_sum) {
+            err = OPENF_ERR_MEM_ALLOC;
+        } else {
+            openf__parallel_for(ssim_bands, 0, openf__ssim_band, &sj);
+            for (size_t i = 0; i < ssim_bands; i++) ssim += sj.band_sum[i];
+            ssim /= (double)(sj.blocks_x - 1) * sj.windows_y;
+            free(sj.band_sum);
+            if (sj.failed) err = OPENF_ERR_MEM_ALLOC;
+        }
+    } else {
+        err = openf__ssim_global(a, b, &ssim);
+    }
+    if (err != OPENF_OK) {
+        openf_free_image(&mask);
+        return err;
+    }
+
+    out_result->identical = 0;
+    out_result->max_diff = max;
+    out_result->mse = (double)sse / (double)size;
+    out_result->psnr = out_result->mse > 0 ? 10.0 * log10(255.0 * 255.0 / out_result->mse) : INFINITY;
+    out_result->ssim = ssim;
+    if (out_mask) *out_mask = mask;
+
+    OPENF_DBG_PRINT("openf_image_compare: max %u, PSNR %.2f dB, SSIM %.4f", max, out_result->psnr, ssim);
+
+    return OPENF_OK;
+}
+
+/*-----------------------------------
+  LZ4 compressed files
+------------------------------------*/
+
+typedef struct {
+    unsigned int num_threads;   // Compression workers, 0 = CPU count
+    size_t block_size;          // 64 KB, 256 KB, 1 MB or 4 MB; 0 = 4 MB
+} OpenF_CompressOptions;
+
+#define OPENF__LZ4_MAGIC 0x184D2204u
+#define OPENF__LZ4_HASH_LOG 12
+#define OPENF__LZ4_MFLIMIT 12           // A match must start this many bytes before the block end
+#define OPENF__LZ4_LAST_LITERALS 5      // ...and end this many bytes before it
+#define OPENF__LZ4_MAX_DISTANCE 65535
+#define OPENF__LZ4_RAW_BLOCK 0x80000000u
+
+#define OPENF__XXH_P1 2654435761u
+#define OPENF__XXH_P2 2246822519u
+#define OPENF__XXH_P3 3266489917u
+#define OPENF__XXH_P4 668265263u
+#define OPENF__XXH_P5 374761393u
+
+static inline unsigned int openf__read_le32(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static inline void openf__write_le32(unsigned char* p, unsigned int v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+/* Streaming xxHash32, used for the frame header and content checksums */
+typedef struct {
+    unsigned int v[4];
+    unsigned long long total;
+    unsigned char mem[16];
+    unsigned int mem_size;
+} OpenF__Xxh32;
+
+static inline unsigned int openf__rotl32(unsigned int x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline unsigned int openf__xxh32_round(unsigned int acc, unsigned int input) {
+    return openf__rotl32(acc + input * OPENF__XXH_P2, 13) * OPENF__XXH_P1;
+}
+
+static inline void openf__xxh32_init(OpenF__Xxh32* st, unsigned int seed) {
+    memset(st, 0, sizeof(*st));
+    st->v[0] = seed + OPENF__XXH_P1 + OPENF__XXH_P2;
+    st->v[1] = seed + OPENF__XXH_P2;
+    st->v[2] = seed;
+    st->v[3] = seed - OPENF__XXH_P1;
+}
+
+static inline void openf__xxh32_update(OpenF__Xxh32* st, const unsigned char* p, size_t len) {
+    st->total += len;
+    if (st->mem_size + len < 16) {
+        memcpy(st->mem + st->mem_size, p, len);
+        st->mem_size += (unsigned int)len;
+        return;
+    }
+    unsigned int v0 = st->v[0], v1 = st->v[1], v2 = st->v[2], v3 = st->v[3];
+    if (st->mem_size) {
+        size_t fill = 16 - st->mem_size;
+        memcpy(st->mem + st->mem_size, p, fill);
+        v0 = openf__xxh32_round(v0, openf__read_le32(st->mem));
+        v1 = openf__xxh32_round(v1, openf__read_le32(st->mem + 4));
+        v2 = openf__xxh32_round(v2, openf__read_le32(st->mem + 8));
+        v3 = openf__xxh32_round(v3, openf__read_le32(st->mem + 12));
+        p += fill;
+        len -= fill;
+        st->mem_size = 0;
+    }
+    for (; len >= 16; p += 16, len -= 16) {
+        v0 = openf__xxh32_round(v0, openf__read_le32(p));
+        v1 = openf__xxh32_round(v1, openf__read_le32(p + 4));
+        v2 = openf__xxh32_round(v2, openf__read_le32(p + 8));
+        v3 = openf__xxh32_round(v3, openf__read_le32(p + 12));
+    }
+    st->v[0] = v0;
+    st->v[1] = v1;
+    st->v[2] = v2;
+    st->v[3] = v3;
+    memcpy(st->mem, p, len);
+    st->mem_size = (unsigned int)len;
+}
+
+static inline unsigned int openf__xxh32_digest(const OpenF__Xxh32* st) {
+    unsigned int h;
+    if (st->total >= 16) {
+        h = openf__rotl32(st->v[0], 1) + openf__rotl32(st->v[1], 7) + openf__rotl32(st->v[2], 12) + openf__rotl32(st->v[3], 18);
+    } else {
+        h = st->v[2] + OPENF__XXH_P5;  // v[2] holds the seed
+    }
+    h += (unsigned int)st->total;
+    const unsigned char* p = st->mem;
+    unsigned int n = st->mem_size;
+    for (; n >= 4; p += 4, n -= 4) h = openf__rotl32(h + openf__read_le32(p) * OPENF__XXH_P3, 17) * OPENF__XXH_P4;
+    for (; n > 0; p++, n--) h = openf__rotl32(h + *p * OPENF__XXH_P5, 11) * OPENF__XXH_P1;
+    h ^= h >> 15;
+    h *= OPENF__XXH_P2;
+    h ^= h >> 13;
+    h *= OPENF__XXH_P3;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline unsigned int openf__xxh32(const unsigned char* p, size_t len, unsigned int seed) {
+    OpenF__Xxh32 st;
+    openf__xxh32_init(&st, seed);
+    openf__xxh32_update(&st, p, len);
+    return openf__xxh32_digest(&st);
+}
+
+/* Worst-case compressed size of one block */
+static inline size_t openf__lz4_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+static inline unsigned char* openf__lz4_length(unsigned char* op, size_t len) {
+    for (; len >= 255; len -= 255) *op++ = 255;
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+/* Emit one sequence; match_len 0 means trailing literals only */
+static inline unsigned char* openf__lz4_sequence(unsigned char* op, const unsigned char* lit, size_t lit_len,
+                                                 size_t offset, size_t match_len) {
+    size_t ml = match_len ? match_len - 4 : 0;
+    *op++ = (unsigned char)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+    if (lit_len >= 15) op = openf__lz4_length(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len) {
+        *op++ = (unsigned char)offset;
+        *op++ = (unsigned char)(offset >> 8);
+        if (ml >= 15) op = openf__lz4_length(op, ml - 15);
+    }
+    return op;
+}
+
+static inline unsigned int openf__lz4_hash(const unsigned char* p) {
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return (v * OPENF__XXH_P1) >> (32 - OPENF__LZ4_HASH_LOG);
+}
+
+/* Greedy single-pass LZ4 block compressor; dst must hold openf__lz4_bound(n) bytes */
+static inline size_t openf__lz4_compress_block(const unsigned char* src, size_t n, unsigned char* dst, unsigned int* table) {
+    unsigned char* op = dst;
+    size_t anchor = 0;
+
+    if (n > OPENF__LZ4_MFLIMIT) {
+        size_t mflimit = n - OPENF__LZ4_MFLIMIT;
+        size_t match_limit = n - OPENF__LZ4_LAST_LITERALS;
+        memset(table, 0, sizeof(unsigned int) << OPENF__LZ4_HASH_LOG);
+        size_t ip = 1;
+
+        for (;;) {
+            // Find a 4-byte match, stepping faster through incompressible data
+            size_t ref;
+            unsigned int searches = 1 << 6;
+            for (;;) {
+                if (ip > mflimit) goto last_literals;
+                unsigned int h = openf__lz4_hash(src + ip);
+                ref = table[h];
+                table[h] = (unsigned int)ip;
+                if (ip - ref <= OPENF__LZ4_MAX_DISTANCE && memcmp(src + ref, src + ip, 4) == 0) break;
+                ip += searches++ >> 6;
+            }
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+            }
+
+            size_t ml = 4;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            while (ip + ml + 8 <= match_limit) {
+                unsigned long long x, y;
+                memcpy(&x, src + ip + ml, 8);
+                memcpy(&y, src + ref + ml, 8);
+                if (x != y) {
+                    ml += (size_t)__builtin_ctzll(x ^ y) >> 3;
+                    goto match_found;
+                }
+                ml += 8;
+            }
+#endif
+            while (ip + ml < match_limit && src[ip + ml] == src[ref + ml]) ml++;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        match_found:
+#endif
+            op = openf__lz4_sequence(op, src + anchor, ip - anchor, ip - ref, ml);
+            ip += ml;
+            anchor = ip;
+            if (ip > mflimit) break;
+            table[openf__lz4_hash(src + ip - 2)] = (unsigned int)(ip - 2);
+        }
+    }
+
+last_literals:
+    op = openf__lz4_sequence(op, src + anchor, n - anchor, 0, 0);
+    return (size_t)(op - dst);
+}
+
+/* Bounds-checked LZ4 block decoder; returns the decoded size or (size_t)-1 on corrupt input */
+static inline size_t openf__lz4_decompress_block(const unsigned char* src, size_t n, unsigned char* dst, size_t cap) {
+    const unsigned char* ip = src;
+    const unsigned char* iend = src + n;
+    unsigned char* op = dst;
+    unsigned char* oend = dst + cap;
+
+    while (ip < iend) {
+        unsigned int token = *ip++;
+        size_t lit = token >> 4;
+        size_t ml = token & 15;
+        size_t offset;
+
+        if (lit < 15 && iend - ip >= 18 && oend - op >= 32) {
+            // Short sequence away from both ends: fixed-size copies that may overrun into space written later
+            memcpy(op, ip, 16);
+            ip += lit;
+            op += lit;
+            offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > (size_t)(op - dst)) return (size_t)-1;
+            if (ml < 15 && offset >= 8) {
+                const unsigned char* match = op - offset;
+                memcpy(op, match, 8);
+                memcpy(op + 8, match + 8, 8);
+                memcpy(op + 16, match + 16, 2);
+                op += ml + 4;
+                continue;
+            }
+        } else {
+            if (lit == 15) {
+                unsigned int b;
+                do {
+                    if (ip >= iend) return (size_t)-1;
+                    b = *ip++;
+                    lit += b;
+                } while (b == 255);
+            }
+            if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit) return (size_t)-1;
+            if ((size_t)(iend - ip) >= lit + 16 && (size_t)(oend - op) >= lit + 16) {
+                for (size_t i = 0; i < lit; i += 16) memcpy(op + i, ip + i, 16);
+            } else {
+                memcpy(op, ip, lit);
+            }
+            ip += lit;
+            op += lit;
+            if (ip == iend) break;  // Last sequence has no match
+
+            if (iend - ip < 2) return (size_t)-1;
+            offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > (size_t)(op - dst)) return (size_t)-1;
+        }
+
+        if (ml == 15) {
+            unsigned int b;
+            do {
+                if (ip >= iend) return (size_t)-1;
+                b = *ip++;
+                ml += b;
+            } while (b == 255);
+        }
+        ml += 4;
+        if ((size_t)(oend - op) < ml) return (size_t)-1;
+
+        const unsigned char* match = op - offset;
+        if (offset >= 16 && (size_t)(oend - op) >= ml + 16) {
+            // Chunks never read bytes they write, even when source and destination overlap
+            for (size_t i = 0; i < ml; i += 16) memcpy(op + i, match + i, 16);
+            op += ml;
+        } else if ((size_t)(oend - op) >= ml + 8) {
+            // Short offsets: seed one period byte by byte, then copy 8 bytes from a whole number of periods back
+            size_t period = offset, i = 0;
+            if (offset < 8) {
+                for (; i < 8; i++) op[i] = match[i];
+                while (period < 8) period += offset;
+            }
+            for (; i < ml; i += 8) memcpy(op + i, op + i - period, 8);
+            op += ml;
+        } else {
+            for (size_t i = 0; i < ml; i++) op[i] = match[i];
+            op += ml;
+        }
+    }
+    return (size_t)(op - dst);
+}
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    size_t block_size;
+    size_t first_block;
+    unsigned char* out;             // One openf__lz4_bound(block_size) slot per block in the batch
+    size_t out_stride;
+    unsigned int* out_words;        // Block size word as written to the frame
+} OpenF__Lz4Job;
+
+static inline void openf__lz4_compress_task(void* ctx, size_t i) {
+    const OpenF__Lz4Job* job = (const OpenF__Lz4Job*)ctx;
+    size_t begin = (job->first_block + i) * job->block_size;
+    size_t n = job->size - begin < job->block_size ? job->size - begin : job->block_size;
+    unsigned char* dst = job->out + i * job->out_stride;
+    unsigned int table[1 << OPENF__LZ4_HASH_LOG];
+    size_t len = openf__lz4_compress_block(job->data + begin, n, dst, table);
+    if (len >= n) {
+        // Incompressible: store as-is
+        memcpy(dst, job->data + begin, n);
+        job->out_words[i] = (unsigned int)n | OPENF__LZ4_RAW_BLOCK;
+    } else {
+        job->out_words[i] = (unsigned int)len;
+    }
+}
+
+/* Write data as an LZ4 frame (independent blocks, content size and checksum), compressing blocks in parallel */
+static inline OpenF_Error openf_write_compressed(const char* path, const void* data, size_t size, const OpenF_CompressOptions* options) {
+    if (!path || (!data && size > 0)) return OPENF_ERR_NULL_ARG;
+
+    size_t block_size = options && options->block_size ? options->block_size : (size_t)4 << 20;
+    unsigned int block_id;
+    switch (block_size) {
+        case (size_t)64 << 10: block_id = 4; break;
+        case (size_t)256 << 10: block_id = 5; break;
+        case (size_t)1 << 20: block_id = 6; break;
+        case (size_t)4 << 20: block_id = 7; break;
+        default: return OPENF_ERR_INVALID_ARG;
+    }
+    unsigned int threads = options && options->num_threads ? options->num_threads : openf_cpu_count();
+
+    size_t blocks = (size + block_size - 1) / block_size;
+    size_t batch = blocks < (size_t)threads * 2 ? blocks : (size_t)threads * 2;
+    if (batch == 0) batch = 1;
+    size_t stride = openf__lz4_bound(block_size);
+    OpenF__Lz4Job job;
+    job.data = (const unsigned char*)data;
+    job.size = size;
+    job.block_size = block_size;
+    job.out_stride = stride;
+    job.out = (unsigned char*)malloc(stride * batch);
+    job.out_words = (unsigned int*)malloc(sizeof(unsigned int) * batch);
+    if (!job.out || !job.out_words) {
+        free(job.out);
+        free(job.out_words);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        free(job.out);
+        free(job.out_words);
+        OPENF_DBG_PRINT("openf_write_compressed: failed to open '%s' for writing", path);
+        return OPENF_ERR_OPEN_FAILED;
+    }
+
+    // Magic, FLG (version 1, independent blocks, content size, content checksum), BD, content size, HC
+    unsigned char header[15];
+    openf__write_le32(header, OPENF__LZ4_MAGIC);
+    header[4] = 0x40 | 0x20 | 0x08 | 0x04;
+    header[5] = (unsigned char)(block_id << 4);
+    for (int i = 0; i < 8; i++) header[6 + i] = (unsigned char)((unsigned long long)size >> (8 * i));
+    header[14] = (unsigned char)(openf__xxh32(header + 4, 10, 0) >> 8);
+    int failed = fwrite(header, 1, sizeof(header), f) != sizeof(header);
+
+    for (size_t first = 0; first < blocks && !failed; first += batch) {
+        size_t count = blocks - first < batch ? blocks - first : batch;
+        job.first_block = first;
+        openf__parallel_for(count, threads, openf__lz4_compress_task, &job);
+        for (size_t i = 0; i < count && !failed; i++) {
+            unsigned char word[4];
+            openf__write_le32(word, job.out_words[i]);
+            size_t len = job.out_words[i] & ~OPENF__LZ4_RAW_BLOCK;
+            failed = fwrite(word, 1, 4, f) != 4 || fwrite(job.out + i * stride, 1, len, f) != len;
+        }
+    }
+
+    unsigned char trailer[8];
+    openf__write_le32(trailer, 0);  // End mark
+    openf__write_le32(trailer + 4, openf__xxh32((const unsigned char*)data, size, 0));
+    if (!failed) failed = fwrite(trailer, 1, sizeof(trailer), f) != sizeof(trailer);
+
+    free(job.out);
+    free(job.out_words);
+    if (failed) {
+        fclose(f);
+        return OPENF_ERR_WRITE_FAILED;
+    }
+    if (fclose(f) != 0) return OPENF_ERR_CLOSE_FAILED;
+
+    OPENF_DBG_PRINT("openf_write_compressed: wrote %zu bytes in %zu blocks to '%s'", size, blocks, path);
+
+    return OPENF_OK;
+}
+
+/* Incremental LZ4 frame reader: holds one decoded block at a time */
+typedef struct {
+    FILE* file;
+    unsigned char* block;           // Decoded block
+    unsigned char* packed;          // Compressed block as read from the file
+    size_t block_max;
+    size_t avail;                   // Decoded bytes in block
+    size_t pos;                     // Bytes of block already returned
+    unsigned long long content_size;
+    int has_content_size;
+    int block_checksum;
+    int content_checksum;
+    int done;
+    OpenF__Xxh32 hash;
+} OpenF_CompressedReader;
+
+/* Release a reader opened with openf_compressed_open */
+static inline void openf_compressed_close(OpenF_CompressedReader* reader) {
+    if (!reader) return;
+    if (reader->file) fclose(reader->file);
+    free(reader->block);
+    free(reader->packed);
+    memset(reader, 0, sizeof(*reader));
+}
+
+/* Open an LZ4 frame file and validate its header */
+static inline OpenF_Error openf_compressed_open(const char* path, OpenF_CompressedReader* out_reader) {
+    if (!path || !out_reader) return OPENF_ERR_NULL_ARG;
+    memset(out_reader, 0, sizeof(*out_reader));
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        OPENF_DBG_PRINT("openf_compressed_open: failed to open '%s'", path);
+        return OPENF_ERR_OPEN_FAILED;
+    }
+    out_reader->file = f;
+
+    unsigned char header[15];
+    if (fread(header, 1, 7, f) != 7) {  // Magic, FLG, BD and the byte after them
+        openf_compressed_close(out_reader);
+        return OPENF_ERR_READ_FAILED;
+    }
+    unsigned int flg = header[4], bd = header[5];
+    if (openf__read_le32(header) != OPENF__LZ4_MAGIC || (flg >> 6) != 1 || (flg & 0x02) || (bd & 0x8F)) {
+        openf_compressed_close(out_reader);
+        return OPENF_ERR_INVALID_FORMAT;
+    }
+    if (!(flg & 0x20) || (flg & 0x01)) {
+        // Linked blocks and dictionaries are not supported
+        openf_compressed_close(out_reader);
+        return OPENF_ERR_UNSUPPORTED;
+    }
+    size_t desc_len = 2;
+    if (flg & 0x08) {
+        if (fread(header + 7, 1, 8, f) != 8) {
+            openf_compressed_close(out_reader);
+            return OPENF_ERR_READ_FAILED;
+        }
+        out_reader->has_content_size = 1;
+        for (int i = 0; i < 8; i++) out_reader->content_size |= (unsigned long long)header[6 + i] << (8 * i);
+        desc_len += 8;
+    }
+    unsigned char hc = header[4 + desc_len];
+    if (hc != (unsigned char)(openf__xxh32(header + 4, desc_len, 0) >> 8) || (bd >> 4) < 4) {
+        openf_compressed_close(out_reader);
+        return OPENF_ERR_INVALID_FORMAT;
+    }
+
+    out_reader->block_checksum = (flg & 0x10) != 0;
+    out_reader->content_checksum = (flg & 0x04) != 0;
+    out_reader->block_max = (size_t)1 << (8 + 2 * (bd >> 4));
+    out_reader->block = (unsigned char*)malloc(out_reader->block_max);
+    out_reader->packed = (unsigned char*)malloc(out_reader->block_max);
+    if (!out_reader->block || !out_reader->packed) {
+        openf_compressed_close(out_reader);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    openf__xxh32_init(&out_reader->hash, 0);
+
+    return OPENF_OK;
+}
+
+/* Decode the next block into reader->block */
+static inline OpenF_Error openf__compressed_next(OpenF_CompressedReader* r) {
+    unsigned char word[4];
+    if (fread(word, 1, 4, r->file) != 4) return OPENF_ERR_READ_FAILED;
+    unsigned int size_word = openf__read_le32(word);
+    if (size_word == 0) {
+        r->done = 1;
+        if (r->content_checksum) {
+            if (fread(word, 1, 4, r->file) != 4) return OPENF_ERR_READ_FAILED;
+            if (openf__read_le32(word) != openf__xxh32_digest(&r->hash)) return OPENF_ERR_INVALID_FORMAT;
+        }
+        return OPENF_OK;
+    }
+
+    size_t len = size_word & ~OPENF__LZ4_RAW_BLOCK;
+    if (len > r->block_max) return OPENF_ERR_INVALID_FORMAT;
+    int raw = (size_word & OPENF__LZ4_RAW_BLOCK) != 0;
+    unsigned char* target = raw ? r->block : r->packed;
+    if (fread(target, 1, len, r->file) != len) return OPENF_ERR_READ_FAILED;
+    if (r->block_checksum) {
+        if (fread(word, 1, 4, r->file) != 4) return OPENF_ERR_READ_FAILED;
+        if (openf__read_le32(word) != openf__xxh32(target, len, 0)) return OPENF_ERR_INVALID_FORMAT;
+    }
+    if (!raw) {
+        len = openf__lz4_decompress_block(r->packed, len, r->block, r->block_max);
+        if (len == (size_t)-1) return OPENF_ERR_INVALID_FORMAT;
+    }
+    if (r->content_checksum) openf__xxh32_update(&r->hash, r->block, len);
+    r->avail = len;
+    r->pos = 0;
+    return OPENF_OK;
+}
+
+/* Read up to size decompressed bytes; *out_read is 0 once the frame is exhausted */
+static inline OpenF_Error openf_compressed_read(OpenF_CompressedReader* reader, void* buffer, size_t size, size_t* out_read) {
+    if (!reader || !reader->file || (!buffer && size > 0) || !out_read) return OPENF_ERR_NULL_ARG;
+    size_t total = 0;
+    while (total < size) {
+        if (reader->pos == reader->avail) {
+            if (reader->done) break;
+            OpenF_Error err = openf__compressed_next(reader);
+            if (err != OPENF_OK) {
+                *out_read = total;
+                return err;
+            }
+            continue;
+        }
+        size_t n = reader->avail - reader->pos < size - total ? reader->avail - reader->pos : size - total;
+        memcpy((unsigned char*)buffer + total, reader->block + reader->pos, n);
+        reader->pos += n;
+        total += n;
+    }
+    *out_read = total;
+    return OPENF_OK;
+}
+
+/* Read and decompress an entire LZ4 frame file (NUL-terminated like openf_read) */
+static inline OpenF_Error openf_read_compressed(const char* path, OpenF_File* out_file) {
+    if (!path || !out_file) return OPENF_ERR_NULL_ARG;
+
+    OpenF_CompressedReader reader;
+    OpenF_Error err = openf_compressed_open(path, &reader);
+    if (err != OPENF_OK) return err;
+
+    // The declared content size comes from the file, so it only trims the buffer, never sizes it up front
+    size_t cap = reader.block_max;
+    if (reader.has_content_size && reader.content_size < cap) cap = (size_t)reader.content_size;
+    char* buffer = (char*)malloc(cap + 1);
+    if (!buffer) {
+        openf_compressed_close(&reader);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+
+    size_t size = 0;
+    for (;;) {
+        if (size == cap) {
+            if (reader.has_content_size && size == reader.content_size) {
+                // Declared size reached: only the end mark may follow
+                unsigned char probe;
+                size_t extra = 0;
+                err = openf_compressed_read(&reader, &probe, 1, &extra);
+                if (err == OPENF_OK && extra) err = OPENF_ERR_INVALID_FORMAT;
+                break;
+            }
+            if (cap > ((size_t)-1 - 1) / 2) {
+                err = OPENF_ERR_MEM_ALLOC;
+                break;
+            }
+            size_t next = cap * 2;
+            if (reader.has_content_size && reader.content_size < next) next = (size_t)reader.content_size;
+            char* grown = (char*)realloc(buffer, next + 1);
+            if (!grown) {
+                err = OPENF_ERR_MEM_ALLOC;
+                break;
+            }
+            buffer = grown;
+            cap = next;
+        }
+        size_t got = 0;
+        err = openf_compressed_read(&reader, buffer + size, cap - size, &got);
+        size += got;
+        if (err != OPENF_OK || got == 0) break;
+    }
+    if (err == OPENF_OK && (!reader.done || (reader.has_content_size && size != reader.content_size))) {
+        err = OPENF_ERR_INVALID_FORMAT;
+    }
+    openf_compressed_close(&reader);
+    if (err != OPENF_OK) {
+        free(buffer);
+        return err;
+    }
+
+    buffer[size] = '\0';
+    out_file->data = buffer;
+    out_file->size = size;
+
+    OPENF_DBG_PRINT("openf_read_compressed: read %zu bytes from '%s'", size, path);
+
+    return OPENF_OK;
+}
+
+/*-----------------------------------
+  Pack files
+------------------------------------*/
+
+/* Layout (little-endian):
+     header   "OPENFPK\0", u32 version, u32 count, u32 slots, u32 reserved, u64 names_size
+     entries  count x {u64 offset, u64 size, u32 name_offset, u32 name_len, u32 hash, u32 reserved}, sorted by name
+     slots    slots x u32 (entry index + 1, 0 = empty), FNV-1a open addressing with linear probing
+     names    concatenated entry names
+     data     each entry on a 4 KB boundary */
+
+typedef struct {
+    const unsigned char* base;  // Whole pack, mapped read-only (or read into memory without mmap)
+    size_t size;
+    unsigned int count;
+    unsigned int slots;
+    int mapped;
+} OpenF_Pack;
+
+#define OPENF__PACK_MAGIC "OPENFPK"
+#define OPENF__PACK_VERSION 1
+#define OPENF__PACK_HEADER 32
+#define OPENF__PACK_ENTRY 32
+#define OPENF__PACK_ALIGN 4096
+
+static inline unsigned long long openf__read_le64(const unsigned char* p) {
+    return (unsigned long long)openf__read_le32(p) | ((unsigned long long)openf__read_le32(p + 4) << 32);
+}
+
+static inline void openf__write_le64(unsigned char* p, unsigned long long v) {
+    openf__write_le32(p, (unsigned int)v);
+    openf__write_le32(p + 4, (unsigned int)(v >> 32));
+}
+
+static inline unsigned int openf__fnv1a(const char* s, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+typedef struct {
+    const char* name;
+    size_t name_len;
+    size_t size;
+    unsigned long long offset;
+} OpenF__PackItem;
+
+static inline int openf__pack_item_cmp(const void* a, const void* b) {
+    return strcmp(((const OpenF__PackItem*)a)->name, ((const OpenF__PackItem*)b)->name);
+}
+
+/* Bundle files into a pack; each file is stored under the path string it was given */
+static inline OpenF_Error openf_pack_create(const char* path, const char* const* files, size_t count) {
+    if (!path || (!files && count > 0)) return OPENF_ERR_NULL_ARG;
+    if (count > 0x3FFFFFFF) return OPENF_ERR_INVALID_ARG;
+
+    OpenF__PackItem* items = (OpenF__PackItem*)malloc(sizeof(OpenF__PackItem) * (count ? count : 1));
+    if (!items) return OPENF_ERR_MEM_ALLOC;
+
+    OpenF_Error err = OPENF_OK;
+    size_t names_size = 0;
+    for (size_t i = 0; i < count && err == OPENF_OK; i++) {
+        if (!files[i]) {
+            err = OPENF_ERR_NULL_ARG;
+            break;
+        }
+        items[i].name = files[i];
+        items[i].name_len = strlen(files[i]);
+        names_size += items[i].name_len;
+        err = openf_get_size(files[i], &items[i].size);
+    }
+    if (err == OPENF_OK) {
+        qsort(items, count, sizeof(OpenF__PackItem), openf__pack_item_cmp);
+        for (size_t i = 1; i < count; i++) {
+            if (strcmp(items[i - 1].name, items[i].name) == 0) err = OPENF_ERR_INVALID_ARG;  // Duplicate name
+        }
+    }
+    if (err != OPENF_OK || names_size > 0xFFFFFFFFu) {
+        free(items);
+        return err != OPENF_OK ? err : OPENF_ERR_INVALID_ARG;
+    }
+
+    unsigned int slots = 1;
+    while (slots < count * 2) slots <<= 1;
+    size_t table_size = OPENF__PACK_HEADER + count * OPENF__PACK_ENTRY + (size_t)slots * 4 + names_size;
+    unsigned long long offset = (table_size + OPENF__PACK_ALIGN - 1) & ~(unsigned long long)(OPENF__PACK_ALIGN - 1);
+    for (size_t i = 0; i < count; i++) {
+        items[i].offset = offset;
+        offset = (offset + items[i].size + OPENF__PACK_ALIGN - 1) & ~(unsigned long long)(OPENF__PACK_ALIGN - 1);
+    }
+
+    // Header, entry table, hash slots and names are built in memory and written at once
+    unsigned char* table = (unsigned char*)calloc(1, table_size);
+    const size_t chunk = 64 * 1024;
+    unsigned char* buffer = (unsigned char*)malloc(chunk);
+    if (!table || !buffer) {
+        free(table);
+        free(buffer);
+        free(items);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    memcpy(table, OPENF__PACK_MAGIC, 8);
+    openf__write_le32(table + 8, OPENF__PACK_VERSION);
+    openf__write_le32(table + 12, (unsigned int)count);
+    openf__write_le32(table + 16, slots);
+    openf__write_le64(table + 24, names_size);
+    unsigned char* slot_table = table + OPENF__PACK_HEADER + count * OPENF__PACK_ENTRY;
+    unsigned char* names = slot_table + (size_t)slots * 4;
+    size_t name_offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        unsigned char* e = table + OPENF__PACK_HEADER + i * OPENF__PACK_ENTRY;
+        unsigned int h = openf__fnv1a(items[i].name, items[i].name_len);
+        openf__write_le64(e, items[i].offset);
+        openf__write_le64(e + 8, items[i].size);
+        openf__write_le32(e + 16, (unsigned int)name_offset);
+        openf__write_le32(e + 20, (unsigned int)items[i].name_len);
+        openf__write_le32(e + 24, h);
+        memcpy(names + name_offset, items[i].name, items[i].name_len);
+        name_offset += items[i].name_len;
+
+        unsigned int slot = h & (slots - 1);
+        while (openf__read_le32(slot_table + (size_t)slot * 4) != 0) slot = (slot + 1) & (slots - 1);
+        openf__write_le32(slot_table + (size_t)slot * 4, (unsigned int)i + 1);
+    }
+
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        free(table);
+        free(buffer);
+        free(items);
+        return OPENF_ERR_OPEN_FAILED;
+    }
+    if (fwrite(table, 1, table_size, out) != table_size) err = OPENF_ERR_WRITE_FAILED;
+    unsigned long long pos = table_size;
+
+    memset(buffer, 0, chunk);
+    for (size_t i = 0; i < count && err == OPENF_OK; i++) {
+        // Zero padding up to the entry's 4 KB boundary (always shorter than one chunk)
+        size_t pad = (size_t)(items[i].offset - pos);
+        if (pad && fwrite(buffer, 1, pad, out) != pad) {
+            err = OPENF_ERR_WRITE_FAILED;
+            break;
+        }
+        FILE* in = fopen(items[i].name, "rb");
+        if (!in) {
+            err = OPENF_ERR_FILE_NOT_FOUND;
+            break;
+        }
+        size_t copied = 0, bytes;
+        while ((bytes = fread(buffer, 1, chunk, in)) > 0 && copied + bytes <= items[i].size) {
+            if (fwrite(buffer, 1, bytes, out) != bytes) {
+                err = OPENF_ERR_WRITE_FAILED;
+                break;
+            }
+            copied += bytes;
+        }
+        if (err == OPENF_OK && (ferror(in) || copied != items[i].size || bytes != 0)) err = OPENF_ERR_READ_FAILED;  // Changed size
+        fclose(in);
+        memset(buffer, 0, chunk);
+        pos = items[i].offset + items[i].size;
+    }
+
+    free(table);
+    free(buffer);
+    if (fclose(out) != 0 && err == OPENF_OK) err = OPENF_ERR_CLOSE_FAILED;
+    if (err != OPENF_OK) {
+        free(items);
+        remove(path);
+        return err;
+    }
+
+    OPENF_DBG_PRINT("openf_pack_create: packed %zu files into '%s'", count, path);
+
+    free(items);
+    return OPENF_OK;
+}
+
+/* Release a pack opened with openf_pack_open; views returned by openf_pack_get become invalid */
+static inline void openf_pack_close(OpenF_Pack* pack) {
+    if (!pack) return;
+#if OPENF_POSIX
+    if (pack->mapped && pack->base) munmap((void*)pack->base, pack->size);
+#endif
+    if (!pack->mapped) free((void*)pack->base);
+    memset(pack, 0, sizeof(*pack));
+}
+
+/* Map a pack and validate its tables so lookups need no further checks */
+static inline OpenF_Error openf_pack_open(const char* path, OpenF_Pack* out_pack) {
+    if (!path || !out_pack) return OPENF_ERR_NULL_ARG;
+    memset(out_pack, 0, sizeof(*out_pack));
+
+#if OPENF_POSIX
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return OPENF_ERR_FILE_NOT_FOUND;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return OPENF_ERR_SEEK_FAILED;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < OPENF__PACK_HEADER) {
+        close(fd);
+        return OPENF_ERR_INVALID_FORMAT;
+    }
+    void* base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return OPENF_ERR_READ_FAILED;
+    out_pack->base = (const unsigned char*)base;
+    out_pack->size = size;
+    out_pack->mapped = 1;
+#else
+    OpenF_File file;
+    OpenF_Error read_err = openf_read(path, &file);
+    if (read_err != OPENF_OK) return read_err;
+    out_pack->base = (const unsigned char*)file.data;
+    out_pack->size = file.size;
+#endif
+
+    const unsigned char* b = out_pack->base;
+    size_t size_total = out_pack->size;
+    if (size_total < OPENF__PACK_HEADER || memcmp(b, OPENF__PACK_MAGIC, 8) != 0 || openf__read_le32(b + 8) != OPENF__PACK_VERSION) {
+        openf_pack_close(out_pack);
+        return OPENF_ERR_INVALID_FORMAT;
+    }
+    unsigned long long count = openf__read_le32(b + 12);
+    unsigned long long slots = openf__read_le32(b + 16);
+    unsigned long long names_size = openf__read_le64(b + 24);
+    unsigned long long names_at = OPENF__PACK_HEADER + count * OPENF__PACK_ENTRY + slots * 4;
+    int valid = slots != 0 && (slots & (slots - 1)) == 0 && slots >= count && names_at <= size_total &&
+                names_size <= size_total - names_at;
+    for (unsigned long long i = 0; valid && i < count; i++) {
+        const unsigned char* e = b + OPENF__PACK_HEADER + i * OPENF__PACK_ENTRY;
+        unsigned long long offset = openf__read_le64(e), len = openf__read_le64(e + 8);
+        unsigned long long name_offset = openf__read_le32(e + 16), name_len = openf__read_le32(e + 20);
+        valid = offset <= size_total && len <= size_total - offset && name_offset + name_len <= names_size;
+    }
+    for (unsigned long long i = 0; valid && i < slots; i++) {
+        valid = openf__read_le32(b + OPENF__PACK_HEADER + count * OPENF__PACK_ENTRY + i * 4) <= count;
+    }
+    if (!valid) {
+        openf_pack_close(out_pack);
+        return OPENF_ERR_INVALID_FORMAT;
+    }
+    out_pack->count = (unsigned int)count;
+    out_pack->slots = (unsigned int)slots;
+
+    OPENF_DBG_PRINT("openf_pack_open: opened '%s' with %u entries", path, out_pack->count);
+
+    return OPENF_OK;
+}
+
+/* Look up an entry by name; out_view points into the pack (read-only, do not openf_free_file it) */
+static inline OpenF_Error openf_pack_get(const OpenF_Pack* pack, const char* name, OpenF_File* out_view) {
+    if (!pack || !pack->base || !name || !out_view) return OPENF_ERR_NULL_ARG;
+    size_t len = strlen(name);
+    unsigned int h = openf__fnv1a(name, len);
+    const unsigned char* entries = pack->base + OPENF__PACK_HEADER;
+    const unsigned char* slot_table = entries + (size_t)pack->count * OPENF__PACK_ENTRY;
+    const char* names = (const char*)(slot_table + (size_t)pack->slots * 4);
+
+    for (unsigned int slot = h & (pack->slots - 1), probes = 0; probes < pack->slots; slot = (slot + 1) & (pack->slots - 1), probes++) {
+        unsigned int index = openf__read_le32(slot_table + (size_t)slot * 4);
+        if (index == 0) break;
+        const unsigned char* e = entries + (size_t)(index - 1) * OPENF__PACK_ENTRY;
+        if (openf__read_le32(e + 24) == h && openf__read_le32(e + 20) == len &&
+            memcmp(names + openf__read_le32(e + 16), name, len) == 0) {
+            out_view->data = (char*)(pack->base + openf__read_le64(e));
+            out_view->size = (size_t)openf__read_le64(e + 8);
+            return OPENF_OK;
+        }
+    }
+    return OPENF_ERR_FILE_NOT_FOUND;
+}
+
+/*-----------------------------------
+  Concurrent append log
+------------------------------------*/
+
+typedef enum {
+    OPENF_DURABILITY_NONE = 0,  // Records reach the file promptly; flushing to disk is left to the OS
+    OPENF_DURABILITY_BATCH,     // fdatasync at most every sync_interval_ms
+    OPENF_DURABILITY_SYNC       // openf_append_log_write returns once its record is on disk (group commit)
+} OpenF_Durability;
+
+typedef struct {
+    size_t capacity;                // Ring size in bytes, rounded up to a power of two and capped at 1 GB; 0 = 4 MB
+    OpenF_Durability durability;
+    unsigned int sync_interval_ms;  // BATCH only, 0 = 10 ms
+} OpenF_AppendLogOptions;
+
+typedef struct OpenF_AppendLog OpenF_AppendLog;
+
+#if OPENF_THREADS && OPENF_POSIX
+
+/* Records are an 8-byte header {u32 length, u32 state} plus payload, padded to 8 bytes. Producers reserve
+   space with a CAS on head, copy, then publish the state; a record that would straddle the end of the ring
+   is preceded by a padding record. The writer thread drains committed records in order with writev and
+   zeroes the drained bytes, so a zero state always means "not yet committed". */
+#define OPENF__LOG_PENDING 0u
+#define OPENF__LOG_RECORD 1u
+#define OPENF__LOG_PADDING 2u
+#define OPENF__LOG_IOV 1024
+#define OPENF__APPEND_LOG_MAX_CAPACITY ((size_t)1 << 30)
+
+struct OpenF_AppendLog {
+    unsigned char* ring;
+    size_t capacity;
+    int fd;
+    OpenF_Durability durability;
+    unsigned int sync_interval_ms;
+    char pad0[64];
+    unsigned long long head;        // Next ring position to reserve (producers)
+    char pad1[64];
+    unsigned long long tail;        // First ring position not yet drained (writer)
+    char pad2[64];
+    unsigned long long written;     // Ring positions handed to the file (under lock)
+    unsigned long long synced;      // Ring positions known durable (under lock)
+    unsigned long long flush_target;
+    int writer_idle;
+    int stop;
+    OpenF_Error error;              // First write or sync failure, reported to every later call
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;            // Wakes the writer
+    pthread_cond_t progress;        // Wakes producers waiting for space, a sync or a flush
+};
+
+static inline unsigned long long openf__log_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + (unsigned long long)ts.tv_nsec / 1000000;
+}
+
+static inline unsigned int* openf__log_state(const OpenF_AppendLog* log, unsigned long long pos) {
+    return (unsigned int*)(log->ring + (pos & (log->capacity - 1)) + 4);
+}
+
+static inline void* openf__log_writer(void* arg) {
+    OpenF_AppendLog* log = (OpenF_AppendLog*)arg;
+    struct iovec iov[OPENF__LOG_IOV];
+    size_t mask = log->capacity - 1;
+    unsigned long long last_sync = openf__log_now_ms();
+    unsigned long long unsynced_from = 0, unsynced_to = 0;
+
+    for (;;) {
+        // Gather the committed prefix of the ring
+        unsigned long long start = log->tail, pos = start;
+        unsigned long long limit = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);  // A full ring would wrap onto itself
+        int count = 0;
+        while (count < OPENF__LOG_IOV && pos < limit) {
+            unsigned int state = __atomic_load_n(openf__log_state(log, pos), __ATOMIC_ACQUIRE);
+            if (state == OPENF__LOG_PENDING) break;
+            unsigned int len;
+            memcpy(&len, log->ring + (pos & mask), 4);
+            if (state == OPENF__LOG_RECORD) {
+                iov[count].iov_base = log->ring + (pos & mask) + 8;
+                iov[count].iov_len = len;
+                count++;
+            }
+            pos += (8 + (unsigned long long)len + 7) & ~7ull;
+        }
+
+        if (pos != start) {
+            OpenF_Error err = OPENF_OK;
+            if (count > 0 && openf__writev_all(log->fd, iov, count) != 0) err = OPENF_ERR_WRITE_FAILED;
+            unsynced_to = pos;
+
+            // Zero what was drained so stale headers can never look committed, then release the space
+            size_t off = (size_t)(start & mask), n = (size_t)(pos - start);
+            size_t first = n < log->capacity - off ? n : log->capacity - off;
+            memset(log->ring + off, 0, first);
+            memset(log->ring, 0, n - first);
+            __atomic_store_n(&log->tail, pos, __ATOMIC_RELEASE);
+
+            pthread_mutex_lock(&log->lock);
+            if (err != OPENF_OK && log->error == OPENF_OK) log->error = err;
+            log->written = pos;
+            pthread_mutex_unlock(&log->lock);
+        }
+
+        // Group commit: one fdatasync covers every record drained since the last one
+        pthread_mutex_lock(&log->lock);
+        int flush = log->flush_target > log->synced && log->written >= log->flush_target;
+        pthread_mutex_unlock(&log->lock);
+        unsigned long long now = openf__log_now_ms();
+        int sync = unsynced_to != unsynced_from &&
+                   (flush || log->durability == OPENF_DURABILITY_SYNC ||
+                    (log->durability == OPENF_DURABILITY_BATCH && now - last_sync >= log->sync_interval_ms));
+        if (sync || flush) {
+            int failed = unsynced_to != unsynced_from && fdatasync(log->fd) != 0;
+            last_sync = now;
+            unsynced_from = unsynced_to;
+            pthread_mutex_lock(&log->lock);
+            if (failed && log->error == OPENF_OK) log->error = OPENF_ERR_WRITE_FAILED;
+            if (log->synced < unsynced_to) log->synced = unsynced_to;
+            pthread_mutex_unlock(&log->lock);
+        }
+
+        pthread_mutex_lock(&log->lock);
+        pthread_cond_broadcast(&log->progress);
+        if (pos == start) {
+            if (log->stop && __atomic_load_n(&log->head, __ATOMIC_ACQUIRE) == log->tail) {
+                pthread_mutex_unlock(&log->lock);
+                break;
+            }
+            // Idle: producers wake us through writer_idle; the timeout bounds BATCH sync latency
+            __atomic_store_n(&log->writer_idle, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(openf__log_state(log, log->tail), __ATOMIC_SEQ_CST) == OPENF__LOG_PENDING && !log->stop &&
+                !(log->flush_target > log->synced)) {
+                unsigned int wait_ms = log->durability == OPENF_DURABILITY_BATCH ? log->sync_interval_ms : 50;
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_sec += wait_ms / 1000;
+                ts.tv_nsec += (long)(wait_ms % 1000) * 1000000;
+                if (ts.tv_nsec >= 1000000000) {
+                    ts.tv_sec++;
+                    ts.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&log->wake, &log->lock, &ts);
+            }
+            __atomic_store_n(&log->writer_idle, 0, __ATOMIC_SEQ_CST);
+        }
+        pthread_mutex_unlock(&log->lock);
+    }
+
+    if (unsynced_to != unsynced_from && log->durability != OPENF_DURABILITY_NONE && fdatasync(log->fd) != 0) {
+        pthread_mutex_lock(&log->lock);
+        if (log->error == OPENF_OK) log->error = OPENF_ERR_WRITE_FAILED;
+        pthread_mutex_unlock(&log->lock);
+    }
+    return NULL;
+}
+
+/* Open (or create) path for appending through a background writer thread */
+static inline OpenF_Error openf_append_log_open(const char* path, const OpenF_AppendLogOptions* options, OpenF_AppendLog** out_log) {
+    if (!path || !out_log) return OPENF_ERR_NULL_ARG;
+    *out_log = NULL;
+
+    // The cap keeps the rounding loop finite and records (at most a quarter of the ring) within their u32 length
+    size_t capacity = options && options->capacity ? options->capacity : (size_t)4 << 20;
+    if (capacity > OPENF__APPEND_LOG_MAX_CAPACITY) capacity = OPENF__APPEND_LOG_MAX_CAPACITY;
+    size_t pow2 = 4096;
+    while (pow2 < capacity) pow2 <<= 1;
+
+    OpenF_AppendLog* log = (OpenF_AppendLog*)calloc(1, sizeof(OpenF_AppendLog));
+    if (!log) return OPENF_ERR_MEM_ALLOC;
+    log->ring = (unsigned char*)calloc(1, pow2);
+    if (!log->ring) {
+        free(log);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    log->capacity = pow2;
+    log->durability = options ? options->durability : OPENF_DURABILITY_NONE;
+    log->sync_interval_ms = options && options->sync_interval_ms ? options->sync_interval_ms : 10;
+
+    log->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    if (log->fd < 0) {
+        free(log->ring);
+        free(log);
+        OPENF_DBG_PRINT("openf_append_log_open: failed to open '%s'", path);
+        return OPENF_ERR_OPEN_FAILED;
+    }
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->wake, NULL);
+    pthread_cond_init(&log->progress, NULL);
+    if (pthread_create(&log->writer, NULL, openf__log_writer, log) != 0) {
+        pthread_mutex_destroy(&log->lock);
+        pthread_cond_destroy(&log->wake);
+        pthread_cond_destroy(&log->progress);
+        close(log->fd);
+        free(log->ring);
+        free(log);
+        return OPENF_ERR_GENERAL_FAILURE;
+    }
+
+    *out_log = log;
+    return OPENF_OK;
+}
+
+static inline void openf__log_wake_writer(OpenF_AppendLog* log) {
+    if (__atomic_load_n(&log->writer_idle, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&log->lock);
+        pthread_cond_signal(&log->wake);
+        pthread_mutex_unlock(&log->lock);
+    }
+}
+
+/* Append one record; safe to call from any number of threads. Records are written whole and in
+   reservation order. Lengths above a quarter of the ring capacity are rejected. */
+static inline OpenF_Error openf_append_log_write(OpenF_AppendLog* log, const void* data, size_t len) {
+    if (!log || (!data && len > 0)) return OPENF_ERR_NULL_ARG;
+    if (len > log->capacity / 4) return OPENF_ERR_INVALID_ARG;
+
+    size_t mask = log->capacity - 1;
+    unsigned long long total = (8 + (unsigned long long)len + 7) & ~7ull;
+    unsigned long long pos, pad, spins = 0;
+    for (;;) {
+        pos = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+        size_t off = (size_t)(pos & mask);
+        pad = off + total > log->capacity ? log->capacity - off : 0;
+        if (pos + pad + total - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) > log->capacity) {
+            // Ring full: spin briefly, then sleep until the writer drains
+            if (++spins < 64) continue;
+            openf__log_wake_writer(log);
+            pthread_mutex_lock(&log->lock);
+            if (pos + pad + total - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) > log->capacity && log->error == OPENF_OK) {
+                pthread_cond_wait(&log->progress, &log->lock);
+            }
+            OpenF_Error err = log->error;
+            pthread_mutex_unlock(&log->lock);
+            if (err != OPENF_OK) return err;
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&log->head, &pos, pos + pad + total, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) break;
+    }
+
+    if (pad) {
+        unsigned int pad_len = (unsigned int)(pad - 8);
+        memcpy(log->ring + (pos & mask), &pad_len, 4);
+        __atomic_store_n(openf__log_state(log, pos), OPENF__LOG_PADDING, __ATOMIC_RELEASE);
+    }
+    unsigned long long rec = pos + pad;
+    unsigned int rec_len = (unsigned int)len;
+    memcpy(log->ring + (rec & mask), &rec_len, 4);
+    if (len) memcpy(log->ring + (rec & mask) + 8, data, len);
+    __atomic_store_n(openf__log_state(log, rec), OPENF__LOG_RECORD, __ATOMIC_SEQ_CST);
+    openf__log_wake_writer(log);
+
+    if (log->durability != OPENF_DURABILITY_SYNC) return OPENF_OK;
+
+    unsigned long long end = rec + total;
+    pthread_mutex_lock(&log->lock);
+    while (log->synced < end && log->error == OPENF_OK) pthread_cond_wait(&log->progress, &log->lock);
+    OpenF_Error err = log->error;
+    pthread_mutex_unlock(&log->lock);
+    return err;
+}
+
+/* Block until every record appended so far is written and fdatasync'd, whatever the durability policy */
+static inline OpenF_Error openf_append_log_flush(OpenF_AppendLog* log) {
+    if (!log) return OPENF_ERR_NULL_ARG;
+    unsigned long long target = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+    pthread_mutex_lock(&log->lock);
+    if (log->flush_target < target) log->flush_target = target;
+    pthread_cond_signal(&log->wake);
+    while (log->synced < target && log->error == OPENF_OK) pthread_cond_wait(&log->progress, &log->lock);
+    OpenF_Error err = log->error;
+    pthread_mutex_unlock(&log->lock);
+    return err;
+}
+
+/* Drain every pending record, stop the writer and close the file */
+static inline OpenF_Error openf_append_log_close(OpenF_AppendLog* log) {
+    if (!log) return OPENF_ERR_NULL_ARG;
+    pthread_mutex_lock(&log->lock);
+    log->stop = 1;
+    pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->writer, NULL);
+
+    OpenF_Error err = log->error;
+    if (close(log->fd) != 0 && err == OPENF_OK) err = OPENF_ERR_CLOSE_FAILED;
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->wake);
+    pthread_cond_destroy(&log->progress);
+    free(log->ring);
+    free(log);
+    return err;
+}
+
+#else
+
+/* The append log needs a writer thread and POSIX I/O */
+static inline OpenF_Error openf_append_log_open(const char* path, const OpenF_AppendLogOptions* options, OpenF_AppendLog** out_log) {
+    (void)path;
+    (void)options;
+    if (out_log) *out_log = NULL;
+    return OPENF_ERR_UNSUPPORTED;
+}
+static inline OpenF_Error openf_append_log_write(OpenF_AppendLog* log, const void* data, size_t len) {
+    (void)log;
+    (void)data;
+    (void)len;
+    return OPENF_ERR_UNSUPPORTED;
+}
+static inline OpenF_Error openf_append_log_flush(OpenF_AppendLog* log) {
+    (void)log;
+    return OPENF_ERR_UNSUPPORTED;
+}
+static inline OpenF_Error openf_append_log_close(OpenF_AppendLog* log) {
+    (void)log;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+#endif
+
+/*-----------------------------------
+  Segmented record log
+------------------------------------*/
+
+typedef struct {
+    size_t segment_size;        // Start a new segment once the active one reaches this size, 0 = 64 MB
+    size_t index_interval;      // Bytes between sparse index entries, 0 = 4 KB
+    int sync_each_append;       // fdatasync after every append (otherwise call openf_log_sync)
+} OpenF_LogOptions;
+
+/* Called for each record in order; return non-zero to stop iterating */
+typedef int (*OpenF_LogVisitor)(void* ctx, unsigned long long seq, const void* data, size_t len);
+
+typedef struct {
+    char* dir;
+    OpenF_LogOptions options;
+    unsigned long long* segments;   // Base sequence number of each segment file, ascending
+    size_t segment_count;
+    size_t segment_cap;
+    int fd;                         // Active (last) segment
+    int index_fd;
+    unsigned long long size;        // Bytes in the active segment
+    unsigned long long last_indexed;
+    unsigned long long next_seq;
+} OpenF_Log;
+
+/* Segment files are "<base>.log": a 16-byte header ("OPENFLG1", u64 base sequence) followed by records
+   {u32 length, u32 CRC32C of length and payload, payload}. "<base>.idx" holds {u64 seq, u64 offset}
+   pairs roughly every index_interval bytes, so lookups scan at most that much. */
+#define OPENF__LOG_MAGIC "OPENFLG1"
+#define OPENF__LOG_HEADER 16
+#define OPENF__LOG_RECORD_HEADER 8
+#define OPENF__LOG_MAX_RECORD 0x7FFFFFFFu
+
+/* CRC32C (Castagnoli) with slice-by-8 tables */
+static inline unsigned int openf__crc32c_table(unsigned int crc, const unsigned char* p, size_t len) {
+    static unsigned int table[8][256];
+    static int ready = 0;
+    crc = ~crc;
+    if (!__atomic_load_n(&ready, __ATOMIC_ACQUIRE)) {
+        // Every thread computes identical values, so a racing first use is harmless
+        for (unsigned int i = 0; i < 256; i++) {
+            unsigned int c = i;
+            for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+            table[0][i] = c;
+        }
+        for (unsigned int i = 0; i < 256; i++) {
+            for (int t = 1; t < 8; t++) table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+        }
+        __atomic_store_n(&ready, 1, __ATOMIC_RELEASE);
+    }
+    for (; len >= 8; p += 8, len -= 8) {
+        unsigned int lo = crc ^ openf__read_le32(p), hi = openf__read_le32(p + 4);
+        crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+              table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+    }
+    for (; len > 0; p++, len--) crc = (crc >> 8) ^ table[0][(crc ^ *p) & 0xFF];
+    return ~crc;
+}
+
+#if OPENF__X86_DISPATCH
+/* CRC32C with the SSE4.2 crc32 instruction, eight bytes at a time */
+OPENF__TARGET("sse4.2")
+static inline unsigned int openf__crc32c_sse42(unsigned int crc, const unsigned char* p, size_t len) {
+    unsigned long long c = ~crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        unsigned long long v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (unsigned int)c;
+    for (; len > 0; p++, len--) crc = _mm_crc32_u8(crc, *p);
+    return ~crc;
+}
+#endif
+
+static inline unsigned int openf__crc32c(unsigned int crc, const unsigned char* p, size_t len) {
+    return openf__dispatch()->crc32c(crc, p, len);
+}
+
+static inline unsigned int openf__log_record_crc(const unsigned char* len_le, const void* data, size_t len) {
+    return openf__crc32c(openf__crc32c(0, len_le, 4), (const unsigned char*)data, len);
+}
+
+#if OPENF_POSIX
+
+static inline char* openf__log_path(const OpenF_Log* log, unsigned long long base, const char* ext) {
+    size_t len = strlen(log->dir) + 32;
+    char* path = (char*)malloc(len);
+    if (path) snprintf(path, len, "%s/%020llu.%s", log->dir, base, ext);
+    return path;
+}
+
+/* Validate records from offset; visits those with seq >= from_seq when fn is set, and appends a sparse
+   index entry to index_fd (if >= 0) every interval bytes. Returns the offset just past the last valid record. */
+static inline size_t openf__log_walk(const unsigned char* data, size_t size, size_t offset, unsigned long long* io_seq,
+                                     unsigned long long from_seq, OpenF_LogVisitor fn, void* ctx, int* out_stopped,
+                                     int index_fd, size_t interval, unsigned long long* io_last_indexed) {
+    unsigned long long seq = *io_seq;
+    if (offset > size) return offset;  // Nothing valid past the end; callers treat end != size as corruption
+    while (size - offset >= OPENF__LOG_RECORD_HEADER) {
+        const unsigned char* rec = data + offset;
+        unsigned int len = openf__read_le32(rec);
+        if (len > OPENF__LOG_MAX_RECORD || len > size - offset - OPENF__LOG_RECORD_HEADER) break;
+        if (openf__read_le32(rec + 4) != openf__log_record_crc(rec, rec + OPENF__LOG_RECORD_HEADER, len)) break;
+        if (index_fd >= 0 && offset >= *io_last_indexed + interval) {
+            unsigned char entry[16];
+            openf__write_le64(entry, seq);
+            openf__write_le64(entry + 8, offset);
+            if (write(index_fd, entry, sizeof(entry)) == (ssize_t)sizeof(entry)) *io_last_indexed = offset;
+        }
+        if (fn && seq >= from_seq && fn(ctx, seq, rec + OPENF__LOG_RECORD_HEADER, len)) {
+            *out_stopped = 1;
+            seq++;
+            offset += OPENF__LOG_RECORD_HEADER + len;
+            break;
+        }
+        seq++;
+        offset += OPENF__LOG_RECORD_HEADER + len;
+    }
+    *io_seq = seq;
+    return offset;
+}
+
+/* Closest indexed position at or before seq in a segment of size bytes. Falls back to the first record when the
+   index has no such entry or the entry does not fit the segment (sealed segments' indexes are not rebuilt). */
+static inline void openf__log_seek(const OpenF_Log* log, unsigned long long base, unsigned long long seq, size_t size,
+                                   unsigned long long* out_seq, size_t* out_offset) {
+    *out_seq = base;
+    *out_offset = OPENF__LOG_HEADER;
+    char* path = openf__log_path(log, base, "idx");
+    if (!path) return;
+    OpenF_File idx;
+    if (openf_read(path, &idx) == OPENF_OK) {
+        const unsigned char* e = (const unsigned char*)idx.data;
+        size_t lo = 0, hi = idx.size / 16;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (openf__read_le64(e + mid * 16) <= seq) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo > 0) {
+            unsigned long long at = openf__read_le64(e + (lo - 1) * 16);
+            unsigned long long offset = openf__read_le64(e + (lo - 1) * 16 + 8);
+            if (at >= base && at <= seq && offset >= OPENF__LOG_HEADER && offset <= size) {
+                *out_seq = at;
+                *out_offset = (size_t)offset;
+            }
+        }
+        openf_free_file(&idx);
+    }
+    free(path);
+}
+
+static inline int openf__log_base_cmp(const void* a, const void* b) {
+    unsigned long long x = *(const unsigned long long*)a, y = *(const unsigned long long*)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static inline OpenF_Error openf__log_add_segment(OpenF_Log* log, unsigned long long base) {
+    if (log->segment_count == log->segment_cap) {
+        size_t cap = log->segment_cap ? log->segment_cap * 2 : 16;
+        unsigned long long* grown = (unsigned long long*)realloc(log->segments, sizeof(unsigned long long) * cap);
+        if (!grown) return OPENF_ERR_MEM_ALLOC;
+        log->segments = grown;
+        log->segment_cap = cap;
+    }
+    log->segments[log->segment_count++] = base;
+    return OPENF_OK;
+}
+
+/* Make the segment starting at base the active one: open (creating it if needed), recover its tail and
+   rebuild its index. Only this segment is ever scanned on open. */
+static inline OpenF_Error openf__log_activate(OpenF_Log* log, unsigned long long base) {
+    char* path = openf__log_path(log, base, "log");
+    char* idx_path = openf__log_path(log, base, "idx");
+    if (!path || !idx_path) {
+        free(path);
+        free(idx_path);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0666);
+    int index_fd = open(idx_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
+    free(path);
+    free(idx_path);
+    if (fd < 0 || index_fd < 0) {
+        if (fd >= 0) close(fd);
+        if (index_fd >= 0) close(index_fd);
+        return OPENF_ERR_OPEN_FAILED;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        close(index_fd);
+        return OPENF_ERR_SEEK_FAILED;
+    }
+    size_t size = (size_t)st.st_size;
+    unsigned long long seq = base, last_indexed = OPENF__LOG_HEADER;
+    size_t valid = 0;
+    if (size >= OPENF__LOG_HEADER) {
+        void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            close(index_fd);
+            return OPENF_ERR_READ_FAILED;
+        }
+        const unsigned char* data = (const unsigned char*)map;
+        if (memcmp(data, OPENF__LOG_MAGIC, 8) == 0 && openf__read_le64(data + 8) == base) {
+            int stopped = 0;
+            valid = openf__log_walk(data, size, OPENF__LOG_HEADER, &seq, 0, NULL, NULL, &stopped, index_fd,
+                                    log->options.index_interval, &last_indexed);
+        }
+        munmap(map, size);
+    }
+
+    OpenF_Error err = OPENF_OK;
+    if (valid == 0) {
+        // New or unreadable header: start the segment afresh
+        unsigned char header[OPENF__LOG_HEADER];
+        memcpy(header, OPENF__LOG_MAGIC, 8);
+        openf__write_le64(header + 8, base);
+        if (ftruncate(fd, 0) != 0 || write(fd, header, sizeof(header)) != (ssize_t)sizeof(header)) err = OPENF_ERR_WRITE_FAILED;
+        valid = OPENF__LOG_HEADER;
+    } else if (valid < size) {
+        // Torn or corrupt tail from a crash: drop it
+        if (ftruncate(fd, (off_t)valid) != 0) err = OPENF_ERR_WRITE_FAILED;
+        OPENF_DBG_PRINT("openf_log: recovered segment %llu, dropped %zu trailing bytes", base, size - valid);
+    }
+    if (err != OPENF_OK) {
+        close(fd);
+        close(index_fd);
+        return err;
+    }
+
+    log->fd = fd;
+    log->index_fd = index_fd;
+    log->size = valid;
+    log->last_indexed = last_indexed;
+    log->next_seq = seq;
+    return OPENF_OK;
+}
+
+static inline void openf__log_deactivate(OpenF_Log* log) {
+    if (log->fd >= 0) close(log->fd);
+    if (log->index_fd >= 0) close(log->index_fd);
+    log->fd = -1;
+    log->index_fd = -1;
+}
+
+/* Release a log opened with openf_log_open (does not sync; call openf_log_sync first when needed) */
+static inline void openf_log_close(OpenF_Log* log) {
+    if (!log) return;
+    openf__log_deactivate(log);
+    free(log->dir);
+    free(log->segments);
+    memset(log, 0, sizeof(*log));
+    log->fd = -1;
+    log->index_fd = -1;
+}
+
+/* Open or create a log stored in directory dir */
+static inline OpenF_Error openf_log_open(const char* dir, const OpenF_LogOptions* options, OpenF_Log* out_log) {
+    if (!dir || !out_log) return OPENF_ERR_NULL_ARG;
+    memset(out_log, 0, sizeof(*out_log));
+    out_log->fd = -1;
+    out_log->index_fd = -1;
+    if (options) out_log->options = *options;
+    if (out_log->options.segment_size == 0) out_log->options.segment_size = (size_t)64 << 20;
+    if (out_log->options.index_interval == 0) out_log->options.index_interval = 4096;
+
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) return OPENF_ERR_OPEN_FAILED;
+    OpenF_Error err = openf_strdup(dir, &out_log->dir);
+    if (err != OPENF_OK) return err;
+
+    DIR* d = opendir(dir);
+    if (!d) {
+        openf_log_close(out_log);
+        return OPENF_ERR_OPEN_FAILED;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(d)) != NULL && err == OPENF_OK) {
+        const char* name = ent->d_name;
+        if (strlen(name) != 24 || strcmp(name + 20, ".log") != 0) continue;
+        unsigned long long base = 0;
+        int digits = 1;
+        for (int i = 0; i < 20; i++) {
+            if (name[i] < '0' || name[i] > '9') digits = 0;
+            base = base * 10 + (unsigned long long)(name[i] - '0');
+        }
+        if (digits) err = openf__log_add_segment(out_log, base);
+    }
+    closedir(d);
+    if (err == OPENF_OK && out_log->segment_count == 0) err = openf__log_add_segment(out_log, 0);
+    if (err == OPENF_OK) {
+        qsort(out_log->segments, out_log->segment_count, sizeof(unsigned long long), openf__log_base_cmp);
+        err = openf__log_activate(out_log, out_log->segments[out_log->segment_count - 1]);
+    }
+    if (err != OPENF_OK) {
+        openf_log_close(out_log);
+        return err;
+    }
+
+    OPENF_DBG_PRINT("openf_log_open: '%s' has %zu segments, next sequence %llu", dir, out_log->segment_count, out_log->next_seq);
+
+    return OPENF_OK;
+}
+
+/* fdatasync the active segment (earlier segments are synced when they roll over) */
+static inline OpenF_Error openf_log_sync(OpenF_Log* log) {
+    if (!log || log->fd < 0) return OPENF_ERR_NULL_ARG;
+    return fdatasync(log->fd) == 0 ? OPENF_OK : OPENF_ERR_WRITE_FAILED;
+}
+
+/* Append one record; out_seq (optional) receives its sequence number */
+static inline OpenF_Error openf_log_append(OpenF_Log* log, const void* data, size_t len, unsigned long long* out_seq) {
+    if (!log || log->fd < 0 || (!data && len > 0)) return OPENF_ERR_NULL_ARG;
+    if (len > OPENF__LOG_MAX_RECORD) return OPENF_ERR_INVALID_ARG;
+
+    if (log->size > OPENF__LOG_HEADER && log->size + OPENF__LOG_RECORD_HEADER + len > log->options.segment_size) {
+        // Roll over: the finished segment is made durable once, then never touched again
+        if (fdatasync(log->fd) != 0) return OPENF_ERR_WRITE_FAILED;
+        OpenF_Error err = openf__log_add_segment(log, log->next_seq);
+        if (err != OPENF_OK) return err;
+        openf__log_deactivate(log);
+        err = openf__log_activate(log, log->next_seq);
+        if (err != OPENF_OK) {
+            log->segment_count--;
+            return err;
+        }
+    }
+
+    unsigned char header[OPENF__LOG_RECORD_HEADER];
+    openf__write_le32(header, (unsigned int)len);
+    openf__write_le32(header + 4, openf__log_record_crc(header, data, len));
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void*)data;
+    iov[1].iov_len = len;
+    if (openf__writev_all(log->fd, iov, len ? 2 : 1) != 0) return OPENF_ERR_WRITE_FAILED;
+
+    if (log->size >= log->last_indexed + log->options.index_interval) {
+        unsigned char entry[16];
+        openf__write_le64(entry, log->next_seq);
+        openf__write_le64(entry + 8, log->size);
+        if (write(log->index_fd, entry, sizeof(entry)) == (ssize_t)sizeof(entry)) log->last_indexed = log->size;
+    }
+    if (out_seq) *out_seq = log->next_seq;
+    log->next_seq++;
+    log->size += OPENF__LOG_RECORD_HEADER + len;
+
+    if (log->options.sync_each_append && fdatasync(log->fd) != 0) return OPENF_ERR_WRITE_FAILED;
+    return OPENF_OK;
+}
+
+/* Visit records from from_seq onward in order, reading each segment through a read-only mapping */
+static inline OpenF_Error openf_log_iterate(OpenF_Log* log, unsigned long long from_seq, OpenF_LogVisitor fn, void* ctx) {
+    if (!log || log->fd < 0 || !fn) return OPENF_ERR_NULL_ARG;
+    if (from_seq >= log->next_seq) return OPENF_OK;
+
+    // Last segment whose base is <= from_seq
+    size_t first = 0;
+    while (first + 1 < log->segment_count && log->segments[first + 1] <= from_seq) first++;
+
+    for (size_t i = first; i < log->segment_count; i++) {
+        unsigned long long base = log->segments[i];
+        int active = i + 1 == log->segment_count;
+        char* path = openf__log_path(log, base, "log");
+        if (!path) return OPENF_ERR_MEM_ALLOC;
+        int fd = open(path, O_RDONLY);
+        free(path);
+        if (fd < 0) return OPENF_ERR_FILE_NOT_FOUND;
+        struct stat st;
+        size_t size = 0;
+        if (fstat(fd, &st) == 0) size = active ? (size_t)log->size : (size_t)st.st_size;
+        if (size <= OPENF__LOG_HEADER) {
+            close(fd);
+            continue;
+        }
+        void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) return OPENF_ERR_READ_FAILED;
+#if defined(MADV_SEQUENTIAL)
+        madvise(map, size, MADV_SEQUENTIAL);
+#endif
+
+        unsigned long long seq = base;
+        size_t offset = OPENF__LOG_HEADER;
+        if (i == first) openf__log_seek(log, base, from_seq, size, &seq, &offset);
+        int stopped = 0;
+        unsigned long long unused = 0;
+        size_t end = openf__log_walk((const unsigned char*)map, size, offset, &seq, from_seq, fn, ctx, &stopped, -1, 0, &unused);
+        munmap(map, size);
+        if (stopped) return OPENF_OK;
+        if (end != size) return OPENF_ERR_INVALID_FORMAT;  // Corruption inside a sealed range
+    }
+    return OPENF_OK;
+}
+
+typedef struct {
+    const unsigned char* base;
+    size_t offset;              // Byte offset of the first record visited
+} OpenF__LogCut;
+
+static inline int openf__log_cut_visitor(void* ctx, unsigned long long seq, const void* data, size_t len) {
+    OpenF__LogCut* cut = (OpenF__LogCut*)ctx;
+    (void)seq;
+    (void)len;
+    cut->offset = (size_t)((const unsigned char*)data - cut->base) - OPENF__LOG_RECORD_HEADER;
+    return 1;
+}
+
+/* Drop every record with sequence >= seq; appends continue from seq */
+static inline OpenF_Error openf_log_truncate(OpenF_Log* log, unsigned long long seq) {
+    if (!log || log->fd < 0) return OPENF_ERR_NULL_ARG;
+    if (seq >= log->next_seq) return OPENF_OK;
+
+    // Remove whole segments that start at or after seq (keeping the first one if everything goes)
+    openf__log_deactivate(log);
+    while (log->segment_count > 1 && log->segments[log->segment_count - 1] >= seq) {
+        unsigned long long base = log->segments[--log->segment_count];
+        char* path = openf__log_path(log, base, "log");
+        char* idx_path = openf__log_path(log, base, "idx");
+        if (path) unlink(path);
+        if (idx_path) unlink(idx_path);
+        free(path);
+        free(idx_path);
+    }
+    unsigned long long base = log->segments[log->segment_count - 1];
+    if (seq < base) seq = base;
+
+    // Cut the remaining segment at the record boundary of seq
+    char* path = openf__log_path(log, base, "log");
+    if (!path) return OPENF_ERR_MEM_ALLOC;
+    int fd = open(path, O_RDWR);
+    free(path);
+    if (fd < 0) return OPENF_ERR_FILE_NOT_FOUND;
+    struct stat st;
+    OpenF_Error err = fstat(fd, &st) == 0 ? OPENF_OK : OPENF_ERR_SEEK_FAILED;
+    size_t size = (size_t)st.st_size, cut = OPENF__LOG_HEADER;
+    if (err == OPENF_OK && size > OPENF__LOG_HEADER) {
+        void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            err = OPENF_ERR_READ_FAILED;
+        } else {
+            unsigned long long at = base;
+            size_t offset = OPENF__LOG_HEADER;
+            openf__log_seek(log, base, seq, size, &at, &offset);
+            // The visitor fires on record seq and reports where it starts; without it the valid end is kept
+            OpenF__LogCut find;
+            find.base = (const unsigned char*)map;
+            find.offset = 0;
+            int stopped = 0;
+            unsigned long long unused = 0;
+            size_t end = openf__log_walk(find.base, size, offset, &at, seq, openf__log_cut_visitor, &find, &stopped, -1, 0, &unused);
+            cut = stopped ? find.offset : end;
+            munmap(map, size);
+        }
+    }
+    if (err == OPENF_OK && ftruncate(fd, (off_t)cut) != 0) err = OPENF_ERR_WRITE_FAILED;
+    if (err == OPENF_OK && fdatasync(fd) != 0) err = OPENF_ERR_WRITE_FAILED;
+    close(fd);
+    if (err != OPENF_OK) return err;
+
+    // Reactivating rescans the shortened segment and rebuilds its index
+    return openf__log_activate(log, base);
+}
+
+#else
+
+static inline OpenF_Error openf_log_open(const char* dir, const OpenF_LogOptions* options, OpenF_Log* out_log) {
+    (void)options;
+    if (!dir || !out_log) return OPENF_ERR_NULL_ARG;
+    memset(out_log, 0, sizeof(*out_log));
+    out_log->fd = -1;
+    out_log->index_fd = -1;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline OpenF_Error openf_log_append(OpenF_Log* log, const void* data, size_t len, unsigned long long* out_seq) {
+    (void)log;
+    (void)data;
+    (void)len;
+    (void)out_seq;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline OpenF_Error openf_log_iterate(OpenF_Log* log, unsigned long long from_seq, OpenF_LogVisitor fn, void* ctx) {
+    (void)log;
+    (void)from_seq;
+    (void)fn;
+    (void)ctx;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline OpenF_Error openf_log_truncate(OpenF_Log* log, unsigned long long seq) {
+    (void)log;
+    (void)seq;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline OpenF_Error openf_log_sync(OpenF_Log* log) {
+    (void)log;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline void openf_log_close(OpenF_Log* log) {
+    (void)log;
+}
+
+#endif
+
+/*-----------------------------------
+  Key-value store
+------------------------------------*/
+
+typedef struct {
+    size_t max_file_size;       // Start a new data file once the active one reaches this size, 0 = 64 MB
+    int sync_each_put;          // fdatasync after every put and delete (otherwise call openf_kv_sync)
+    int background_compaction;  // Compact on a worker thread once half the sealed bytes are dead (OPENF_THREADS)
+} OpenF_KVOptions;
+
+typedef struct OpenF_KV OpenF_KV;
+
+#if OPENF_POSIX
+
+/* Data files are "<id>.kv" holding records {u32 CRC32C of the rest, u32 key length, u32 value length,
+   u64 sequence, key, value}; a delete is a record whose value length is OPENF__KV_TOMBSTONE. Only the
+   active file is appended to; sealed files are mapped read-only. On open every file is replayed and the
+   highest sequence for each key wins, so compaction output may be written under any new id. */
+#define OPENF__KV_HEADER 20
+#define OPENF__KV_TOMBSTONE 0xFFFFFFFFu
+#define OPENF__KV_MAX_LEN 0x7FFFFFFFu
+
+typedef struct {
+    char* key;                  // NULL marks an empty slot
+    unsigned int key_len;
+    unsigned int hash;
+    unsigned int file_id;
+    unsigned int value_len;     // OPENF__KV_TOMBSTONE only while replaying
+    unsigned long long offset;  // Record start within its file
+    unsigned long long seq;
+} OpenF__KVSlot;
+
+typedef struct {
+    unsigned int id;
+    int fd;                     // -1 once sealed
+    unsigned char* map;         // Sealed, non-empty files only
+    size_t size;
+    size_t dead;                // Bytes of superseded records and tombstones
+} OpenF__KVFile;
+
+struct OpenF_KV {
+    char* dir;
+    OpenF_KVOptions options;
+    OpenF__KVSlot* slots;       // Open addressing with linear probing, power-of-two capacity
+    size_t slot_cap;
+    size_t count;
+    OpenF__KVFile* files;       // Ascending id
+    size_t file_count;
+    size_t file_cap;
+    unsigned int active_id;
+    unsigned int next_id;
+    unsigned long long next_seq;
+    size_t sealed_bytes;
+    size_t sealed_dead;
+#if OPENF_THREADS
+    pthread_rwlock_t lock;          // Index and file table
+    pthread_mutex_t compact_lock;   // One compaction at a time
+    pthread_mutex_t signal_lock;
+    pthread_cond_t compact_wake;
+    pthread_t compactor;
+    int has_compactor;
+    int compact_requested;
+    int stop;
+#endif
+};
+
+static inline void openf__kv_rdlock(OpenF_KV* kv) {
+#if OPENF_THREADS
+    pthread_rwlock_rdlock(&kv->lock);
+#else
+    (void)kv;
+#endif
+}
+
+static inline void openf__kv_wrlock(OpenF_KV* kv) {
+#if OPENF_THREADS
+    pthread_rwlock_wrlock(&kv->lock);
+#else
+    (void)kv;
+#endif
+}
+
+static inline void openf__kv_unlock(OpenF_KV* kv) {
+#if OPENF_THREADS
+    pthread_rwlock_unlock(&kv->lock);
+#else
+    (void)kv;
+#endif
+}
+
+static inline size_t openf__kv_record_size(unsigned int key_len, unsigned int value_len) {
+    return OPENF__KV_HEADER + (size_t)key_len + (value_len == OPENF__KV_TOMBSTONE ? 0 : value_len);
+}
+
+static inline char* openf__kv_path(const OpenF_KV* kv, unsigned int id) {
+    size_t len = strlen(kv->dir) + 24;
+    char* path = (char*)malloc(len);
+    if (path) snprintf(path, len, "%s/%010u.kv", kv->dir, id);
+    return path;
+}
+
+static inline OpenF__KVFile* openf__kv_file(OpenF_KV* kv, unsigned int id) {
+    size_t lo = 0, hi = kv->file_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (kv->files[mid].id < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < kv->file_count && kv->files[lo].id == id ? &kv->files[lo] : NULL;
+}
+
+static inline void openf__kv_charge_dead(OpenF_KV* kv, unsigned int id, size_t bytes) {
+    OpenF__KVFile* f = openf__kv_file(kv, id);
+    if (!f) return;
+    f->dead += bytes;
+    if (f->fd < 0) kv->sealed_dead += bytes;
+}
+
+/* Slot holding key, or the empty slot where it would be inserted */
+static inline OpenF__KVSlot* openf__kv_probe(const OpenF_KV* kv, const char* key, unsigned int key_len, unsigned int hash) {
+    size_t mask = kv->slot_cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        OpenF__KVSlot* s = &kv->slots[i];
+        if (!s->key || (s->hash == hash && s->key_len == key_len && memcmp(s->key, key, key_len) == 0)) return s;
+    }
+}
+
+static inline OpenF_Error openf__kv_reserve(OpenF_KV* kv) {
+    if ((kv->count + 1) * 10 < kv->slot_cap * 7) return OPENF_OK;
+    size_t cap = kv->slot_cap ? kv->slot_cap * 2 : 1024;
+    OpenF__KVSlot* slots = (OpenF__KVSlot*)calloc(cap, sizeof(OpenF__KVSlot));
+    if (!slots) return OPENF_ERR_MEM_ALLOC;
+    for (size_t i = 0; i < kv->slot_cap; i++) {
+        if (!kv->slots[i].key) continue;
+        size_t j = kv->slots[i].hash & (cap - 1);
+        while (slots[j].key) j = (j + 1) & (cap - 1);
+        slots[j] = kv->slots[i];
+    }
+    free(kv->slots);
+    kv->slots = slots;
+    kv->slot_cap = cap;
+    return OPENF_OK;
+}
+
+/* Backward-shift deletion keeps probe chains intact without tombstone slots */
+static inline void openf__kv_remove(OpenF_KV* kv, OpenF__KVSlot* s) {
+    size_t mask = kv->slot_cap - 1, hole = (size_t)(s - kv->slots);
+    free(s->key);
+    for (size_t j = (hole + 1) & mask; kv->slots[j].key; j = (j + 1) & mask) {
+        size_t home = kv->slots[j].hash & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            kv->slots[hole] = kv->slots[j];
+            hole = j;
+        }
+    }
+    memset(&kv->slots[hole], 0, sizeof(OpenF__KVSlot));
+    kv->count--;
+}
+
+/* Point key at a record unless a newer one is already indexed; whatever loses becomes dead bytes.
+   Tombstones are kept as slots while replaying (keep_tombstones) so older files cannot resurrect a key. */
+static inline OpenF_Error openf__kv_index(OpenF_KV* kv, const char* key, unsigned int key_len, unsigned int file_id,
+                                          unsigned long long offset, unsigned int value_len, unsigned long long seq,
+                                          int keep_tombstones) {
+    OpenF_Error err = openf__kv_reserve(kv);
+    if (err != OPENF_OK) return err;
+    unsigned int hash = openf__fnv1a(key, key_len);
+    OpenF__KVSlot* s = openf__kv_probe(kv, key, key_len, hash);
+    size_t size = openf__kv_record_size(key_len, value_len);
+    int tombstone = value_len == OPENF__KV_TOMBSTONE;
+
+    if (s->key && s->seq > seq) {
+        openf__kv_charge_dead(kv, file_id, size);
+        return OPENF_OK;
+    }
+    if (tombstone) openf__kv_charge_dead(kv, file_id, size);
+    if (s->key) {
+        // A replaced tombstone was charged when it was indexed
+        if (s->value_len != OPENF__KV_TOMBSTONE) openf__kv_charge_dead(kv, s->file_id, openf__kv_record_size(s->key_len, s->value_len));
+        if (tombstone && !keep_tombstones) {
+            openf__kv_remove(kv, s);
+            return OPENF_OK;
+        }
+    } else {
+        if (tombstone && !keep_tombstones) return OPENF_OK;
+        s->key = (char*)malloc(key_len + 1);
+        if (!s->key) return OPENF_ERR_MEM_ALLOC;
+        memcpy(s->key, key, key_len);
+        s->key[key_len] = '\0';
+        s->key_len = key_len;
+        s->hash = hash;
+        kv->count++;
+    }
+    s->file_id = file_id;
+    s->offset = offset;
+    s->value_len = value_len;
+    s->seq = seq;
+    return OPENF_OK;
+}
+
+/* Length of the valid record at p (0 if torn or corrupt) */
+static inline size_t openf__kv_check_record(const unsigned char* p, size_t avail) {
+    if (avail < OPENF__KV_HEADER) return 0;
+    unsigned int key_len = openf__read_le32(p + 4), value_len = openf__read_le32(p + 8);
+    if (key_len > OPENF__KV_MAX_LEN || (value_len > OPENF__KV_MAX_LEN && value_len != OPENF__KV_TOMBSTONE)) return 0;
+    size_t size = openf__kv_record_size(key_len, value_len);
+    if (size > avail || openf__read_le32(p) != openf__crc32c(0, p + 4, size - 4)) return 0;
+    return size;
+}
+
+static inline OpenF_Error openf__kv_add_file(OpenF_KV* kv, unsigned int id, int fd, OpenF__KVFile** out) {
+    if (kv->file_count == kv->file_cap) {
+        size_t cap = kv->file_cap ? kv->file_cap * 2 : 16;
+        OpenF__KVFile* grown = (OpenF__KVFile*)realloc(kv->files, sizeof(OpenF__KVFile) * cap);
+        if (!grown) return OPENF_ERR_MEM_ALLOC;
+        kv->files = grown;
+        kv->file_cap = cap;
+    }
+    OpenF__KVFile* f = &kv->files[kv->file_count++];
+    memset(f, 0, sizeof(*f));
+    f->id = id;
+    f->fd = fd;
+    if (out) *out = f;
+    return OPENF_OK;
+}
+
+/* Create a new, empty data file (ids only grow, so the table stays sorted) */
+static inline OpenF_Error openf__kv_new_file(OpenF_KV* kv, int append, unsigned int* out_id) {
+    unsigned int id = kv->next_id++;
+    char* path = openf__kv_path(kv, id);
+    if (!path) return OPENF_ERR_MEM_ALLOC;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | (append ? O_APPEND : 0), 0666);
+    free(path);
+    if (fd < 0) return OPENF_ERR_OPEN_FAILED;
+    OpenF_Error err = openf__kv_add_file(kv, id, fd, NULL);
+    if (err != OPENF_OK) {
+        close(fd);
+        return err;
+    }
+    *out_id = id;
+    return OPENF_OK;
+}
+
+/* Make a finished file durable and switch its reads to a read-only mapping */
+static inline OpenF_Error openf__kv_seal(OpenF_KV* kv, OpenF__KVFile* f) {
+    if (fdatasync(f->fd) != 0) return OPENF_ERR_WRITE_FAILED;
+    if (f->size > 0) {
+        void* map = mmap(NULL, f->size, PROT_READ, MAP_SHARED, f->fd, 0);
+        if (map == MAP_FAILED) return OPENF_ERR_READ_FAILED;
+        f->map = (unsigned char*)map;
+    }
+    close(f->fd);
+    f->fd = -1;
+    kv->sealed_bytes += f->size;
+    kv->sealed_dead += f->dead;
+    return OPENF_OK;
+}
+
+static inline int openf__kv_wants_compaction(const OpenF_KV* kv) {
+    return kv->sealed_dead > 0 && kv->sealed_dead * 2 >= kv->sealed_bytes && kv->sealed_bytes >= kv->options.max_file_size;
+}
+
+/* Rewrite the live records of every sealed file into fresh files, then delete the old ones. Readers and
+   writers keep going; each record is re-checked against the index under the lock before it is moved. */
+static inline OpenF_Error openf__kv_compact(OpenF_KV* kv) {
+#if OPENF_THREADS
+    pthread_mutex_lock(&kv->compact_lock);
+#endif
+    openf__kv_wrlock(kv);
+    size_t victim_count = 0;
+    unsigned int* victims = (unsigned int*)malloc(sizeof(unsigned int) * (kv->file_count + 1));
+    if (victims) {
+        for (size_t i = 0; i < kv->file_count; i++) {
+            if (kv->files[i].fd < 0) victims[victim_count++] = kv->files[i].id;
+        }
+    }
+    openf__kv_unlock(kv);
+
+    OpenF_Error err = victims ? OPENF_OK : OPENF_ERR_MEM_ALLOC;
+    unsigned int out_id = 0;
+    int have_out = 0;
+    size_t moved = 0;
+    for (size_t v = 0; v < victim_count && err == OPENF_OK; v++) {
+        // Sealed files are only unmapped by compaction itself, so the mapping stays valid without the lock
+        openf__kv_rdlock(kv);
+        OpenF__KVFile* src = openf__kv_file(kv, victims[v]);
+        const unsigned char* map = src ? src->map : NULL;
+        size_t size = src ? src->size : 0;
+        openf__kv_unlock(kv);
+
+        for (size_t offset = 0; offset < size && err == OPENF_OK;) {
+            const unsigned char* rec = map + offset;
+            size_t len = openf__kv_check_record(rec, size - offset);
+            if (len == 0) break;
+            unsigned int key_len = openf__read_le32(rec + 4);
+
+            openf__kv_wrlock(kv);
+            OpenF__KVSlot* s = kv->slot_cap == 0 ? NULL : openf__kv_probe(kv, (const char*)rec + OPENF__KV_HEADER, key_len,
+                                                                          openf__fnv1a((const char*)rec + OPENF__KV_HEADER, key_len));
+            if (s && s->key && s->file_id == victims[v] && s->offset == offset) {
+                OpenF__KVFile* out = have_out ? openf__kv_file(kv, out_id) : NULL;
+                if (out && out->size > 0 && out->size + len > kv->options.max_file_size) {
+                    err = openf__kv_seal(kv, out);
+                    out = NULL;
+                }
+                if (err == OPENF_OK && !out) {
+                    err = openf__kv_new_file(kv, 0, &out_id);
+                    if (err == OPENF_OK) {
+                        out = openf__kv_file(kv, out_id);
+                        have_out = 1;
+                    }
+                }
+                if (err == OPENF_OK && openf__pwrite_all(out->fd, rec, len, (off_t)out->size) != 0) err = OPENF_ERR_WRITE_FAILED;
+                if (err == OPENF_OK) {
+                    s->file_id = out_id;
+                    s->offset = out->size;
+                    out->size += len;
+                    moved += len;
+                }
+            }
+            openf__kv_unlock(kv);
+            offset += len;
+        }
+    }
+
+    openf__kv_wrlock(kv);
+    if (err == OPENF_OK && have_out) err = openf__kv_seal(kv, openf__kv_file(kv, out_id));
+    if (err == OPENF_OK) {
+        // Oldest first: a tombstone is never deleted while an older value it hides still exists on disk
+        for (size_t v = 0; v < victim_count; v++) {
+            OpenF__KVFile* f = openf__kv_file(kv, victims[v]);
+            if (!f) continue;
+            if (f->map) munmap(f->map, f->size);
+            kv->sealed_bytes -= f->size;
+            kv->sealed_dead -= f->dead;
+            char* path = openf__kv_path(kv, f->id);
+            if (path) unlink(path);
+            free(path);
+            size_t index = (size_t)(f - kv->files);
+            memmove(f, f + 1, sizeof(OpenF__KVFile) * (kv->file_count - index - 1));
+            kv->file_count--;
+        }
+        OPENF_DBG_PRINT("openf_kv_compact: %zu files compacted, %zu live bytes kept", victim_count, moved);
+    }
+    openf__kv_unlock(kv);
+    free(victims);
+#if OPENF_THREADS
+    pthread_mutex_unlock(&kv->compact_lock);
+#endif
+    return err;
+}
+
+#if OPENF_THREADS
+static inline void* openf__kv_compactor(void* arg) {
+    OpenF_KV* kv = (OpenF_KV*)arg;
+    pthread_mutex_lock(&kv->signal_lock);
+    for (;;) {
+        while (!kv->compact_requested && !kv->stop) pthread_cond_wait(&kv->compact_wake, &kv->signal_lock);
+        if (kv->stop) break;
+        kv->compact_requested = 0;
+        pthread_mutex_unlock(&kv->signal_lock);
+        openf__kv_compact(kv);
+        pthread_mutex_lock(&kv->signal_lock);
+    }
+    pthread_mutex_unlock(&kv->signal_lock);
+    return NULL;
+}
+#endif
+
+/* Compact now, in the calling thread */
+static inline OpenF_Error openf_kv_compact(OpenF_KV* kv) {
+    if (!kv) return OPENF_ERR_NULL_ARG;
+    return openf__kv_compact(kv);
+}
+
+/* Stop background compaction, seal the active file and release everything */
+static inline void openf_kv_close(OpenF_KV* kv) {
+    if (!kv) return;
+#if OPENF_THREADS
+    if (kv->has_compactor) {
+        pthread_mutex_lock(&kv->signal_lock);
+        kv->stop = 1;
+        pthread_cond_signal(&kv->compact_wake);
+        pthread_mutex_unlock(&kv->signal_lock);
+        pthread_join(kv->compactor, NULL);
+    }
+#endif
+    for (size_t i = 0; i < kv->file_count; i++) {
+        OpenF__KVFile* f = &kv->files[i];
+        if (f->fd >= 0) {
+            fdatasync(f->fd);
+            close(f->fd);
+            if (f->id == kv->active_id && f->size == 0) {
+                // Nothing was written this session
+                char* path = openf__kv_path(kv, f->id);
+                if (path) unlink(path);
+                free(path);
+            }
+        }
+        if (f->map) munmap(f->map, f->size);
+    }
+    for (size_t i = 0; i < kv->slot_cap; i++) free(kv->slots[i].key);
+#if OPENF_THREADS
+    pthread_rwlock_destroy(&kv->lock);
+    pthread_mutex_destroy(&kv->compact_lock);
+    pthread_mutex_destroy(&kv->signal_lock);
+    pthread_cond_destroy(&kv->compact_wake);
+#endif
+    free(kv->slots);
+    free(kv->files);
+    free(kv->dir);
+    free(kv);
+}
+
+/* Replay one existing data file into the index, cutting off a torn tail */
+static inline OpenF_Error openf__kv_load_file(OpenF_KV* kv, unsigned int id) {
+    char* path = openf__kv_path(kv, id);
+    if (!path) return OPENF_ERR_MEM_ALLOC;
+    int fd = open(path, O_RDWR);
+    free(path);
+    if (fd < 0) return OPENF_ERR_OPEN_FAILED;
+    OpenF__KVFile* f;
+    OpenF_Error err = openf__kv_add_file(kv, id, fd, &f);
+    if (err != OPENF_OK) {
+        close(fd);
+        return err;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) return OPENF_ERR_SEEK_FAILED;
+    size_t size = (size_t)st.st_size, offset = 0;
+    if (size > 0) {
+        void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) return OPENF_ERR_READ_FAILED;
+        const unsigned char* data = (const unsigned char*)map;
+        while (offset < size && err == OPENF_OK) {
+            size_t len = openf__kv_check_record(data + offset, size - offset);
+            if (len == 0) break;
+            unsigned long long seq = openf__read_le64(data + offset + 12);
+            err = openf__kv_index(kv, (const char*)data + offset + OPENF__KV_HEADER, openf__read_le32(data + offset + 4), id,
+                                  offset, openf__read_le32(data + offset + 8), seq, 1);
+            if (seq >= kv->next_seq) kv->next_seq = seq + 1;
+            offset += len;
+        }
+        munmap(map, size);
+    }
+    if (err == OPENF_OK && offset < size) {
+        OPENF_DBG_PRINT("openf_kv_open: dropping %zu trailing bytes of data file %u", size - offset, id);
+        if (ftruncate(fd, (off_t)offset) != 0) err = OPENF_ERR_WRITE_FAILED;
+    }
+    f = openf__kv_file(kv, id);
+    f->size = offset;
+    return err == OPENF_OK ? openf__kv_seal(kv, f) : err;
+}
+
+/* Open or create a store in directory dir; every existing file is replayed to rebuild the index */
+static inline OpenF_Error openf_kv_open(const char* dir, const OpenF_KVOptions* options, OpenF_KV** out_kv) {
+    if (!dir || !out_kv) return OPENF_ERR_NULL_ARG;
+    *out_kv = NULL;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) return OPENF_ERR_OPEN_FAILED;
+
+    OpenF_KV* kv = (OpenF_KV*)calloc(1, sizeof(OpenF_KV));
+    if (!kv) return OPENF_ERR_MEM_ALLOC;
+    if (options) kv->options = *options;
+    if (kv->options.max_file_size == 0) kv->options.max_file_size = (size_t)64 << 20;
+    kv->active_id = 0xFFFFFFFFu;  // No active file until the existing ones are replayed
+#if OPENF_THREADS
+    pthread_rwlock_init(&kv->lock, NULL);
+    pthread_mutex_init(&kv->compact_lock, NULL);
+    pthread_mutex_init(&kv->signal_lock, NULL);
+    pthread_cond_init(&kv->compact_wake, NULL);
+#endif
+    OpenF_Error err = openf_strdup(dir, &kv->dir);
+
+    // Collect existing ids, then replay them in ascending order
+    unsigned int* ids = NULL;
+    size_t id_count = 0, id_cap = 0;
+    DIR* d = err == OPENF_OK ? opendir(dir) : NULL;
+    if (err == OPENF_OK && !d) err = OPENF_ERR_OPEN_FAILED;
+    struct dirent* ent;
+    while (d && err == OPENF_OK && (ent = readdir(d)) != NULL) {
+        const char* name = ent->d_name;
+        if (strlen(name) != 13 || strcmp(name + 10, ".kv") != 0) continue;
+        unsigned int id = 0;
+        int digits = 1;
+        for (int i = 0; i < 10; i++) {
+            if (name[i] < '0' || name[i] > '9') digits = 0;
+            id = id * 10 + (unsigned int)(name[i] - '0');
+        }
+        if (!digits) continue;
+        if (id_count == id_cap) {
+            id_cap = id_cap ? id_cap * 2 : 16;
+            unsigned int* grown = (unsigned int*)realloc(ids, sizeof(unsigned int) * id_cap);
+            if (!grown) {
+                err = OPENF_ERR_MEM_ALLOC;
+                break;
+            }
+            ids = grown;
+        }
+        ids[id_count++] = id;
+    }
+    if (d) closedir(d);
+    if (err == OPENF_OK) {
+        for (size_t i = 1; i < id_count; i++) {
+            unsigned int id = ids[i];
+            size_t j = i;
+            for (; j > 0 && ids[j - 1] > id; j--) ids[j] = ids[j - 1];
+            ids[j] = id;
+        }
+        for (size_t i = 0; i < id_count && err == OPENF_OK; i++) {
+            err = openf__kv_load_file(kv, ids[i]);
+            kv->next_id = ids[i] + 1;
+        }
+    }
+    free(ids);
+
+    // Tombstones were only needed to order the replay
+    for (size_t i = 0; err == OPENF_OK && i < kv->slot_cap; i++) {
+        while (kv->slots[i].key && kv->slots[i].value_len == OPENF__KV_TOMBSTONE) openf__kv_remove(kv, &kv->slots[i]);
+    }
+    if (err == OPENF_OK) err = openf__kv_new_file(kv, 1, &kv->active_id);
+#if OPENF_THREADS
+    if (err == OPENF_OK && kv->options.background_compaction) {
+        if (pthread_create(&kv->compactor, NULL, openf__kv_compactor, kv) != 0) {
+            err = OPENF_ERR_GENERAL_FAILURE;
+        } else {
+            kv->has_compactor = 1;
+        }
+    }
+#endif
+    if (err != OPENF_OK) {
+        openf_kv_close(kv);
+        return err;
+    }
+
+    OPENF_DBG_PRINT("openf_kv_open: '%s' has %zu keys in %zu files", dir, kv->count, kv->file_count);
+
+    *out_kv = kv;
+    return OPENF_OK;
+}
+
+/* Append a record to the active file and index it (caller holds the write lock) */
+static inline OpenF_Error openf__kv_append(OpenF_KV* kv, const char* key, size_t key_len, const void* value, unsigned int value_len) {
+    OpenF__KVFile* f = openf__kv_file(kv, kv->active_id);
+    size_t size = openf__kv_record_size((unsigned int)key_len, value_len);
+    OpenF_Error err = OPENF_OK;
+    if (f->size > 0 && f->size + size > kv->options.max_file_size) {
+        err = openf__kv_seal(kv, f);
+        if (err == OPENF_OK) err = openf__kv_new_file(kv, 1, &kv->active_id);
+        if (err != OPENF_OK) return err;
+        f = openf__kv_file(kv, kv->active_id);
+    }
+
+    unsigned char header[OPENF__KV_HEADER];
+    unsigned long long seq = kv->next_seq++;
+    size_t data_len = value_len == OPENF__KV_TOMBSTONE ? 0 : value_len;
+    openf__write_le32(header + 4, (unsigned int)key_len);
+    openf__write_le32(header + 8, value_len);
+    openf__write_le64(header + 12, seq);
+    unsigned int crc = openf__crc32c(0, header + 4, OPENF__KV_HEADER - 4);
+    crc = openf__crc32c(crc, (const unsigned char*)key, key_len);
+    openf__write_le32(header, openf__crc32c(crc, (const unsigned char*)value, data_len));
+
+    struct iovec iov[3];
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void*)key;
+    iov[1].iov_len = key_len;
+    iov[2].iov_base = (void*)value;
+    iov[2].iov_len = data_len;
+    if (openf__writev_all(f->fd, iov, data_len ? 3 : 2) != 0) return OPENF_ERR_WRITE_FAILED;
+    size_t offset = f->size;
+    f->size += size;
+    if (kv->options.sync_each_put && fdatasync(f->fd) != 0) return OPENF_ERR_WRITE_FAILED;
+    return openf__kv_index(kv, key, (unsigned int)key_len, kv->active_id, offset, value_len, seq, 0);
+}
+
+static inline void openf__kv_request_compaction(OpenF_KV* kv) {
+#if OPENF_THREADS
+    if (!kv->has_compactor) return;
+    pthread_mutex_lock(&kv->signal_lock);
+    kv->compact_requested = 1;
+    pthread_cond_signal(&kv->compact_wake);
+    pthread_mutex_unlock(&kv->signal_lock);
+#else
+    (void)kv;
+#endif
+}
+
+/* Store value under key (an O(1) append) */
+static inline OpenF_Error openf_kv_put(OpenF_KV* kv, const char* key, const void* value, size_t size) {
+    if (!kv || !key || (!value && size > 0)) return OPENF_ERR_NULL_ARG;
+    size_t key_len = strlen(key);
+    if (key_len > OPENF__KV_MAX_LEN || size > OPENF__KV_MAX_LEN) return OPENF_ERR_INVALID_ARG;
+    openf__kv_wrlock(kv);
+    OpenF_Error err = openf__kv_append(kv, key, key_len, value, (unsigned int)size);
+    int wants = err == OPENF_OK && openf__kv_wants_compaction(kv);
+    openf__kv_unlock(kv);
+    if (wants) openf__kv_request_compaction(kv);
+    return err;
+}
+
+/* Remove key; OPENF_ERR_FILE_NOT_FOUND if it is not present */
+static inline OpenF_Error openf_kv_delete(OpenF_KV* kv, const char* key) {
+    if (!kv || !key) return OPENF_ERR_NULL_ARG;
+    size_t key_len = strlen(key);
+    if (key_len > OPENF__KV_MAX_LEN) return OPENF_ERR_INVALID_ARG;
+    openf__kv_wrlock(kv);
+    OpenF_Error err = OPENF_ERR_FILE_NOT_FOUND;
+    if (kv->slot_cap > 0 && openf__kv_probe(kv, key, (unsigned int)key_len, openf__fnv1a(key, key_len))->key) {
+        err = openf__kv_append(kv, key, key_len, NULL, OPENF__KV_TOMBSTONE);
+    }
+    int wants = err == OPENF_OK && openf__kv_wants_compaction(kv);
+    openf__kv_unlock(kv);
+    if (wants) openf__kv_request_compaction(kv);
+    return err;
+}
+
+/* Copy the value for key into out (free with openf_free_file); a memcpy from a mapped file or one pread */
+static inline OpenF_Error openf_kv_get(OpenF_KV* kv, const char* key, OpenF_File* out) {
+    if (!kv || !key || !out) return OPENF_ERR_NULL_ARG;
+    out->data = NULL;
+    out->size = 0;
+    size_t key_len = strlen(key);
+    if (key_len > OPENF__KV_MAX_LEN) return OPENF_ERR_INVALID_ARG;
+
+    openf__kv_rdlock(kv);
+    OpenF_Error err = OPENF_ERR_FILE_NOT_FOUND;
+    OpenF__KVSlot* s = kv->slot_cap > 0 ? openf__kv_probe(kv, key, (unsigned int)key_len, openf__fnv1a(key, key_len)) : NULL;
+    if (s && s->key) {
+        OpenF__KVFile* f = openf__kv_file(kv, s->file_id);
+        size_t offset = (size_t)s->offset + OPENF__KV_HEADER + s->key_len;
+        char* data = (char*)malloc((size_t)s->value_len + 1);
+        err = OPENF_OK;
+        if (!data) {
+            err = OPENF_ERR_MEM_ALLOC;
+        } else if (f->map) {
+            memcpy(data, f->map + offset, s->value_len);
+        } else {
+            size_t done = 0;
+            while (done < s->value_len) {
+                ssize_t n = pread(f->fd, data + done, s->value_len - done, (off_t)(offset + done));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) {
+                    err = OPENF_ERR_READ_FAILED;
+                    break;
+                }
+                done += (size_t)n;
+            }
+        }
+        if (err == OPENF_OK) {
+            data[s->value_len] = '\0';
+            out->data = data;
+            out->size = s->value_len;
+        } else {
+            free(data);
+        }
+    }
+    openf__kv_unlock(kv);
+    return err;
+}
+
+/* fdatasync the active file */
+static inline OpenF_Error openf_kv_sync(OpenF_KV* kv) {
+    if (!kv) return OPENF_ERR_NULL_ARG;
+    openf__kv_wrlock(kv);
+    OpenF__KVFile* f = openf__kv_file(kv, kv->active_id);
+    OpenF_Error err = fdatasync(f->fd) == 0 ? OPENF_OK : OPENF_ERR_WRITE_FAILED;
+    openf__kv_unlock(kv);
+    return err;
+}
+
+/* Number of live keys */
+static inline size_t openf_kv_count(OpenF_KV* kv) {
+    if (!kv) return 0;
+    openf__kv_rdlock(kv);
+    size_t count = kv->count;
+    openf__kv_unlock(kv);
+    return count;
+}
+
+#else
+
+static inline OpenF_Error openf_kv_open(const char* dir, const OpenF_KVOptions* options, OpenF_KV** out_kv) {
+    (void)options;
+    if (!dir || !out_kv) return OPENF_ERR_NULL_ARG;
+    *out_kv = NULL;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline OpenF_Error openf_kv_put(OpenF_KV* kv, const char* key, const void* value, size_t size) {
+    (void)kv;
+    (void)key;
+    (void)value;
+    (void)size;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline OpenF_Error openf_kv_get(OpenF_KV* kv, const char* key, OpenF_File* out) {
+    (void)kv;
+    (void)key;
+    (void)out;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline OpenF_Error openf_kv_delete(OpenF_KV* kv, const char* key) {
+    (void)kv;
+    (void)key;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline OpenF_Error openf_kv_compact(OpenF_KV* kv) {
+    (void)kv;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline OpenF_Error openf_kv_sync(OpenF_KV* kv) {
+    (void)kv;
+    return OPENF_ERR_UNSUPPORTED;
+}
+
+static inline size_t openf_kv_count(OpenF_KV* kv) {
+    (void)kv;
+    return 0;
+}
+
+static inline void openf_kv_close(OpenF_KV* kv) {
+    (void)kv;
+}
+
+#endif
+
+/*-----------------------------------
+  Asynchronous operations
+------------------------------------*/
+
+typedef struct OpenF_Future OpenF_Future;
+
+/* Runs once on the thread that completes the future (or inside openf_future_then if already complete) */
+typedef void (*OpenF_FutureCallback)(OpenF_Future* future, void* user);
+
+typedef enum {
+    OPENF__ASYNC_READ = 0,
+    OPENF__ASYNC_WRITE,
+    OPENF__ASYNC_COPY,
+    OPENF__ASYNC_LOAD_BMP,
+    OPENF__ASYNC_SAVE_BMP
+} OpenF__AsyncOp;
+
+struct OpenF_Future {
+    int done;
+    OpenF_Error error;
+    OpenF__AsyncOp op;
+    char* path;
+    char* path2;                // Copy destination
+    const void* data;           // Write source / image to save (caller keeps it alive until completion)
+    size_t size;
+    OpenF_File file;            // Read result
+    OpenF_Image* image;         // Load result
+    OpenF_FutureCallback callback;
+    void* user;
+    int event_fd;
+    OpenF__Task task;           // Scheduler entry, so starting an operation does not allocate
+    char* path_storage;         // Kept across reuse for both path copies
+    size_t path_capacity;
+    OpenF_Future* next_free;
+#if OPENF_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t completed;
+#endif
+};
+
+/* Released futures (with their path buffers) are kept for reuse, so steady-state async calls do not allocate */
+typedef struct {
+    OpenF_Future* free_list;
+#if OPENF_THREADS
+    pthread_mutex_t lock;
+#endif
+} OpenF__FuturePool;
+
+static inline OpenF__FuturePool* openf__future_pool(void) {
+#if OPENF_THREADS
+    static OpenF__FuturePool pool = {NULL, PTHREAD_MUTEX_INITIALIZER};
+#else
+    static OpenF__FuturePool pool = {NULL};
+#endif
+    return &pool;
+}
+
+static inline OpenF_Future* openf__future_acquire(OpenF__AsyncOp op) {
+    OpenF__FuturePool* pool = openf__future_pool();
+#if OPENF_THREADS
+    pthread_mutex_lock(&pool->lock);
+#endif
+    OpenF_Future* future = pool->free_list;
+    if (future) pool->free_list = future->next_free;
+#if OPENF_THREADS
+    pthread_mutex_unlock(&pool->lock);
+#endif
+    if (!future) {
+        future = (OpenF_Future*)malloc(sizeof(OpenF_Future));
+        if (!future) return NULL;
+        future->path_storage = NULL;
+        future->path_capacity = 0;
+#if OPENF_THREADS
+        pthread_mutex_init(&future->lock, NULL);
+        pthread_cond_init(&future->completed, NULL);
+#endif
+    }
+    future->done = 0;
+    future->error = OPENF_OK;
+    future->op = op;
+    future->path = NULL;
+    future->path2 = NULL;
+    future->data = NULL;
+    future->size = 0;
+    future->file.data = NULL;
+    future->file.size = 0;
+    future->image = NULL;
+    future->callback = NULL;
+    future->user = NULL;
+    future->event_fd = -1;
+    future->next_free = NULL;
+    return future;
+}
+
+static inline void openf__future_complete(OpenF_Future* future, OpenF_Error error) {
+#if OPENF_THREADS
+    pthread_mutex_lock(&future->lock);
+#endif
+    future->error = error;
+    __atomic_store_n(&future->done, 1, __ATOMIC_RELEASE);
+    OpenF_FutureCallback callback = future->callback;
+    void* user = future->user;
+#if OPENF_POSIX
+    if (future->event_fd >= 0) {
+        unsigned long long one = 1;
+        ssize_t n = write(future->event_fd, &one, sizeof(one));
+        (void)n;
+    }
+#endif
+#if OPENF_THREADS
+    pthread_cond_broadcast(&future->completed);
+    pthread_mutex_unlock(&future->lock);
+#endif
+    if (callback) callback(future, user);
+}
+
+static inline void openf__future_run(void* ctx) {
+    OpenF_Future* f = (OpenF_Future*)ctx;
+    OpenF_Error err = OPENF_ERR_GENERAL_FAILURE;
+    switch (f->op) {
+        case OPENF__ASYNC_READ:
+            err = openf_read(f->path, &f->file);
+            break;
+        case OPENF__ASYNC_WRITE:
+            err = openf_write(f->path, (const char*)f->data, f->size);
+            break;
+        case OPENF__ASYNC_COPY:
+            err = openf_copy_file(f->path, f->path2);
+            break;
+        case OPENF__ASYNC_LOAD_BMP:
+            err = openf_load_bmp(f->path, &f->image);
+            break;
+        case OPENF__ASYNC_SAVE_BMP:
+            err = openf_save_bmp(f->path, (const OpenF_Image*)f->data);
+            break;
+    }
+    openf__future_complete(f, err);
+}
+
+/* Hand a prepared future to the scheduler */
+static inline OpenF_Error openf__future_start(OpenF_Future* future, OpenF_Future** out_future) {
+    *out_future = future;
+    future->task.fn = openf__future_run;
+    future->task.ctx = future;
+    future->task.group = NULL;
+    future->task.heap = 0;
+    openf__submit_task(&future->task);
+    return OPENF_OK;
+}
+
+/* Completed yet? Never blocks */
+static inline int openf_future_poll(const OpenF_Future* future) {
+    return future ? __atomic_load_n(&future->done, __ATOMIC_ACQUIRE) : 1;
+}
+
+/* Block until complete and return the operation's result */
+static inline OpenF_Error openf_future_wait(OpenF_Future* future) {
+    if (!future) return OPENF_ERR_NULL_ARG;
+#if OPENF_THREADS
+    pthread_mutex_lock(&future->lock);
+    while (!future->done) pthread_cond_wait(&future->completed, &future->lock);
+    pthread_mutex_unlock(&future->lock);
+#endif
+    return future->error;
+}
+
+/* Call fn(future, user) on completion; runs immediately if the future has already completed */
+static inline OpenF_Error openf_future_then(OpenF_Future* future, OpenF_FutureCallback fn, void* user) {
+    if (!future || !fn) return OPENF_ERR_NULL_ARG;
+#if OPENF_THREADS
+    pthread_mutex_lock(&future->lock);
+#endif
+    int done = future->done;
+    if (!done) {
+        future->callback = fn;
+        future->user = user;
+    }
+#if OPENF_THREADS
+    pthread_mutex_unlock(&future->lock);
+#endif
+    if (done) fn(future, user);
+    return OPENF_OK;
+}
+
+/* Descriptor that becomes readable on completion, for epoll/poll loops (Linux eventfd; -1 elsewhere).
+   Owned by the future: do not close it. */
+static inline int openf_future_fd(OpenF_Future* future) {
+    if (!future) return -1;
+#if defined(__linux__) && defined(SYS_eventfd2)
+#if OPENF_THREADS
+    pthread_mutex_lock(&future->lock);
+#endif
+    if (future->event_fd < 0) {
+        future->event_fd = (int)syscall(SYS_eventfd2, 0, O_CLOEXEC | O_NONBLOCK);
+        if (future->event_fd >= 0 && future->done) {
+            unsigned long long one = 1;
+            ssize_t n = write(future->event_fd, &one, sizeof(one));
+            (void)n;
+        }
+    }
+    int fd = future->event_fd;
+#if OPENF_THREADS
+    pthread_mutex_unlock(&future->lock);
+#endif
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+/* Take the result of a completed openf_read_async (free with openf_free_file) */
+static inline OpenF_Error openf_future_take_file(OpenF_Future* future, OpenF_File* out_file) {
+    if (!future || !out_file) return OPENF_ERR_NULL_ARG;
+    OpenF_Error err = openf_future_wait(future);
+    if (err != OPENF_OK) return err;
+    *out_file = future->file;
+    future->file.data = NULL;
+    future->file.size = 0;
+    return OPENF_OK;
+}
+
+/* Take the result of a completed openf_load_bmp_async (free with openf_free_image) */
+static inline OpenF_Error openf_future_take_image(OpenF_Future* future, OpenF_Image** out_image) {
+    if (!future || !out_image) return OPENF_ERR_NULL_ARG;
+    OpenF_Error err = openf_future_wait(future);
+    if (err != OPENF_OK) return err;
+    *out_image = future->image;
+    future->image = NULL;
+    return OPENF_OK;
+}
+
+/* Wait for the future, free any result not taken and recycle it */
+static inline void openf_future_release(OpenF_Future* future) {
+    if (!future) return;
+    openf_future_wait(future);
+    openf_free_file(&future->file);
+    if (future->image) openf_free_image(&future->image);
+#if OPENF_POSIX
+    if (future->event_fd >= 0) close(future->event_fd);
+#endif
+    OpenF__FuturePool* pool = openf__future_pool();
+#if OPENF_THREADS
+    pthread_mutex_lock(&pool->lock);
+#endif
+    future->next_free = pool->free_list;
+    pool->free_list = future;
+#if OPENF_THREADS
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+/* Free the futures kept for reuse (openf_cleanup) */
+static inline void openf__future_pool_drain(void) {
+    OpenF__FuturePool* pool = openf__future_pool();
+#if OPENF_THREADS
+    pthread_mutex_lock(&pool->lock);
+#endif
+    OpenF_Future* future = pool->free_list;
+    pool->free_list = NULL;
+#if OPENF_THREADS
+    pthread_mutex_unlock(&pool->lock);
+#endif
+    while (future) {
+        OpenF_Future* next = future->next_free;
+#if OPENF_THREADS
+        pthread_mutex_destroy(&future->lock);
+        pthread_cond_destroy(&future->completed);
+#endif
+        free(future->path_storage);
+        free(future);
+        future = next;
+    }
+}
+
+/* Async calls need scheduler workers to run on; without them the I/O would block the caller, so they fail instead */
+static inline int openf__async_available(void) {
+#if OPENF_THREADS
+    return openf__scheduler_running();
+#else
+    return 0;
+#endif
+}
+
+static inline OpenF_Error openf__future_prepare(OpenF__AsyncOp op, const char* path, const char* path2, OpenF_Future** out) {
+    if (!openf__async_available()) {
+        OPENF_DBG_PRINT("openf async: no scheduler running (call openf_init_ex first)");
+        return OPENF_ERR_UNSUPPORTED;
+    }
+    OpenF_Future* future = openf__future_acquire(op);
+    if (!future) return OPENF_ERR_MEM_ALLOC;
+    size_t len = strlen(path) + 1, len2 = path2 ? strlen(path2) + 1 : 0;
+    if (len + len2 > future->path_capacity) {
+        char* grown = (char*)realloc(future->path_storage, len + len2);
+        if (!grown) {
+            __atomic_store_n(&future->done, 1, __ATOMIC_RELEASE);
+            openf_future_release(future);
+            return OPENF_ERR_MEM_ALLOC;
+        }
+        future->path_storage = grown;
+        future->path_capacity = len + len2;
+    }
+    future->path = future->path_storage;
+    memcpy(future->path, path, len);
+    if (path2) {
+        future->path2 = future->path_storage + len;
+        memcpy(future->path2, path2, len2);
+    }
+    *out = future;
+    return OPENF_OK;
+}
+
+/* Each _async call returns at once with a future; release it with openf_future_release. They need the scheduler
+   started by openf_init_ex and fail with OPENF_ERR_UNSUPPORTED without it rather than block the caller. */
+static inline OpenF_Error openf_read_async(const char* path, OpenF_Future** out_future) {
+    if (!path || !out_future) return OPENF_ERR_NULL_ARG;
+    OpenF_Future* future;
+    OpenF_Error err = openf__future_prepare(OPENF__ASYNC_READ, path, NULL, &future);
+    return err == OPENF_OK ? openf__future_start(future, out_future) : err;
+}
+
+/* data must stay valid until the future completes */
+static inline OpenF_Error openf_write_async(const char* path, const char* data, size_t size, OpenF_Future** out_future) {
+    if (!path || !data || !out_future) return OPENF_ERR_NULL_ARG;
+    OpenF_Future* future;
+    OpenF_Error err = openf__future_prepare(OPENF__ASYNC_WRITE, path, NULL, &future);
+    if (err != OPENF_OK) return err;
+    future->data = data;
+    future->size = size;
+    return openf__future_start(future, out_future);
+}
+
+static inline OpenF_Error openf_copy_file_async(const char* src, const char* dest, OpenF_Future** out_future) {
+    if (!src || !dest || !out_future) return OPENF_ERR_NULL_ARG;
+    OpenF_Future* future;
+    OpenF_Error err = openf__future_prepare(OPENF__ASYNC_COPY, src, dest, &future);
+    return err == OPENF_OK ? openf__future_start(future, out_future) : err;
+}
+
+static inline OpenF_Error openf_load_bmp_async(const char* path, OpenF_Future** out_future) {
+    if (!path || !out_future) return OPENF_ERR_NULL_ARG;
+    OpenF_Future* future;
+    OpenF_Error err = openf__future_prepare(OPENF__ASYNC_LOAD_BMP, path, NULL, &future);
+    return err == OPENF_OK ? openf__future_start(future, out_future) : err;
+}
+
+/* image must stay valid and unmodified until the future completes */
+static inline OpenF_Error openf_save_bmp_async(const char* path, const OpenF_Image* image, OpenF_Future** out_future) {
+    if (!path || !image || !out_future) return OPENF_ERR_NULL_ARG;
+    OpenF_Future* future;
+    OpenF_Error err = openf__future_prepare(OPENF__ASYNC_SAVE_BMP, path, NULL, &future);
+    if (err != OPENF_OK) return err;
+    future->data = image;
+    return openf__future_start(future, out_future);
+}
+
+/*-----------------------------------
+  SIMD kernel dispatch
+------------------------------------*/
+
+/* Point every table entry at the best implementation at or below level */
+static inline void openf__dispatch_select(OpenF__Dispatch* d, OpenF_SimdLevel level) {
+    d->level = level;
+    d->swap_rb24 = openf__swap_rb24_none;
+    d->halve_rgba = openf__halve_rgba_none;
+    d->compare = openf__compare_none;
+    d->crc32c = openf__crc32c_table;
+    d->taps = openf__taps_none;
+    d->resize_h = openf__resize_h_none;
+    d->rgb24_to_rgba = openf__rgb24_to_rgba_none;
+    d->rgba_to_rgb24 = openf__rgba_to_rgb24_none;
+    d->rgba_to_plane = openf__rgba_to_plane_none;
+    d->rgba_to_chroma = openf__rgba_to_chroma_none;
+    d->yuv_to_rgba = openf__yuv_to_rgba_none;
+#if defined(__SSE2__)
+    if (level >= OPENF_SIMD_SSE2) {
+        d->taps = openf__taps_sse2;
+        d->resize_h = openf__resize_h_sse2;
+        d->rgba_to_plane = openf__rgba_to_plane_sse2;
+        d->rgba_to_chroma = openf__rgba_to_chroma_sse2;
+        d->yuv_to_rgba = openf__yuv_to_rgba_sse2;
+        d->halve_rgba = openf__halve_rgba_sse2;
+        d->compare = openf__compare_sse2;
+    }
+#endif
+#if OPENF__X86_DISPATCH
+    if (level >= OPENF_SIMD_SSE4_2) {
+        d->swap_rb24 = openf__swap_rb24_ssse3;
+        d->crc32c = openf__crc32c_sse42;
+        d->rgb24_to_rgba = openf__rgb24_to_rgba_ssse3;
+        d->rgba_to_rgb24 = openf__rgba_to_rgb24_ssse3;
+    }
+    if (level >= OPENF_SIMD_AVX2) {
+        d->swap_rb24 = openf__swap_rb24_avx2;
+        d->halve_rgba = openf__halve_rgba_avx2;
+        d->compare = openf__compare_avx2;
+        d->taps = openf__taps_avx2;
+        d->resize_h = openf__resize_h_avx2;
+        d->rgb24_to_rgba = openf__rgb24_to_rgba_avx2;
+        d->rgba_to_rgb24 = openf__rgba_to_rgb24_avx2;
+        d->rgba_to_plane = openf__rgba_to_plane_avx2;
+        d->rgba_to_chroma = openf__rgba_to_chroma_avx2;
+        d->yuv_to_rgba = openf__yuv_to_rgba_avx2;
+    }
+#endif
+}
+
+/* Level the dispatched kernels run at: the CPU's best unless capped by the OPENF_SIMD environment variable.
+   The table is per translation unit, so this reports (and openf_set_simd_level changes) the calling TU only. */
+static inline OpenF_SimdLevel openf_simd_level(void) {
+    return openf__dispatch()->level;
+}
+
+/* Force a level, e.g. to benchmark kernels against each other; OPENF_SIMD_AUTO restores the detected one.
+   Fails with OPENF_ERR_UNSUPPORTED above what the CPU supports. Affects only kernels called from this translation
+   unit (call it in each TU that should be forced, or use OPENF_SIMD). Call while no other thread is inside OpenF. */
+static inline OpenF_Error openf_set_simd_level(OpenF_SimdLevel level) {
+    OpenF_SimdLevel detected = openf__dispatch()->detected;
+    if (level == OPENF_SIMD_AUTO) level = detected;
+    if (level < OPENF_SIMD_SCALAR || level > OPENF_SIMD_AVX512) return OPENF_ERR_INVALID_ARG;
+    if (level > detected) return OPENF_ERR_UNSUPPORTED;
+    openf__dispatch_select(openf__dispatch_state(), level);
+    return OPENF_OK;
+}
+
 /*-----------------------------------
-  Initialization and Cleanup (dummy for extensibility)
+  Initialization and Cleanup
 ------------------------------------*/
 
 static inline OpenF_Error openf_init(void) {
     OPENF_DBG_PRINT("openf_init: called");
-    /* For now no real global init, placeholder */
+    /* Detect CPU features and pick kernels now rather than on the first image call; the scheduler is opt-in (openf_init_ex) */
+    openf__dispatch();
+    return OPENF_OK;
+}
+
+/* Start the shared work-stealing scheduler used by openf_submit and every parallel operation.
+   Its state is static, so it belongs to the translation unit that calls this; call before other threads
+   use OpenF and pair with openf_cleanup. */
+static inline OpenF_Error openf_init_ex(const OpenF_InitOptions* options) {
+    OPENF_DBG_PRINT("openf_init_ex: starting %u workers", options && options->num_threads ? options->num_threads : openf_cpu_count());
+    openf__dispatch();
+#if OPENF_THREADS
+    return openf__scheduler_start(options);
+#else
+    (void)options;
     return OPENF_OK;
+#endif
 }
 
 static inline void openf_cleanup(void) {
     OPENF_DBG_PRINT("openf_cleanup: called");
-    /* For now no real global cleanup, placeholder */
+#if OPENF_THREADS
+    openf__scheduler_stop();
+#endif
+    openf__future_pool_drain();
 }
 
 /*-----------------------------------
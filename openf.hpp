@@ -0,0 +1,840 @@
+#ifndef OPENF_HPP
+#define OPENF_HPP
+
+#include "openf.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus > 201703L && __has_include(<span>)
+#include <span>
+#endif
+
+/*-----------------------------------
+  RAII wrappers
+------------------------------------*/
+
+namespace openf {
+
+/* Owns file contents: either a buffer adopted from the C API (freed with free) or one allocated from a
+   std::pmr::memory_resource. Move-only; views never copy. */
+class File {
+  public:
+    File() noexcept = default;
+    explicit File(OpenF_File raw) noexcept : data_(raw.data), size_(raw.size) {}
+    File(File&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+          resource_(std::exchange(other.resource_, nullptr)) {}
+    File& operator=(File&& other) noexcept {
+        if (this != &other) {
+            reset();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            resource_ = std::exchange(other.resource_, nullptr);
+        }
+        return *this;
+    }
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+    ~File() { reset(); }
+
+    const char* data() const noexcept { return data_; }
+    char* data() noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    std::pmr::memory_resource* resource() const noexcept { return resource_; }
+    std::string_view str() const noexcept { return std::string_view(data_ ? data_ : "", size_); }
+#if defined(__cpp_lib_span)
+    std::span<const std::byte> bytes() const noexcept { return {reinterpret_cast<const std::byte*>(data_), size_}; }
+#endif
+
+    /* Non-owning view for C functions that take an OpenF_File */
+    OpenF_File view() const noexcept { return OpenF_File{data_, size_}; }
+
+    /* Give a malloc'd buffer back to the C API (free with openf_free_file); nullptr data for pmr buffers */
+    OpenF_File release() noexcept {
+        if (resource_) return OpenF_File{nullptr, 0};
+        OpenF_File raw{data_, size_};
+        data_ = nullptr;
+        size_ = 0;
+        return raw;
+    }
+
+    void reset() noexcept {
+        if (resource_) {
+            if (data_) resource_->deallocate(data_, size_ + 1, alignof(std::max_align_t));
+        } else {
+            std::free(data_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+        resource_ = nullptr;
+    }
+
+  private:
+    friend OpenF_Error read(const char* path, File& out, std::pmr::memory_resource* resource);
+
+    char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::pmr::memory_resource* resource_ = nullptr;  // nullptr = malloc'd by the C API
+};
+
+/* Read a whole file; with a memory resource the buffer comes from it instead of malloc */
+inline OpenF_Error read(const char* path, File& out, std::pmr::memory_resource* resource = nullptr) {
+    out.reset();
+    if (!resource) {
+        OpenF_File raw{nullptr, 0};
+        OpenF_Error err = openf_read(path, &raw);
+        if (err == OPENF_OK) out = File(raw);
+        return err;
+    }
+    if (!path) return OPENF_ERR_NULL_ARG;
+    std::FILE* f = std::fopen(path, "rb");
+    if (!f) return OPENF_ERR_OPEN_FAILED;
+    long size = -1;
+    if (std::fseek(f, 0, SEEK_END) == 0) size = std::ftell(f);
+    if (size < 0 || std::fseek(f, 0, SEEK_SET) != 0) {
+        std::fclose(f);
+        return OPENF_ERR_SEEK_FAILED;
+    }
+    char* data = nullptr;
+    try {
+        data = static_cast<char*>(resource->allocate(static_cast<std::size_t>(size) + 1, alignof(std::max_align_t)));
+    } catch (...) {
+        std::fclose(f);
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    std::size_t got = std::fread(data, 1, static_cast<std::size_t>(size), f);
+    std::fclose(f);
+    if (got != static_cast<std::size_t>(size)) {
+        resource->deallocate(data, static_cast<std::size_t>(size) + 1, alignof(std::max_align_t));
+        return OPENF_ERR_READ_FAILED;
+    }
+    data[size] = '\0';
+    out.data_ = data;
+    out.size_ = static_cast<std::size_t>(size);
+    out.resource_ = resource;
+    return OPENF_OK;
+}
+
+/* Owns an OpenF_Image; pixels come from malloc (C API) or from a memory resource */
+class Image {
+  public:
+    Image() noexcept = default;
+    explicit Image(OpenF_Image* raw) noexcept : image_(raw) {}
+    Image(Image&& other) noexcept
+        : image_(std::exchange(other.image_, nullptr)), resource_(std::exchange(other.resource_, nullptr)) {}
+    Image& operator=(Image&& other) noexcept {
+        if (this != &other) {
+            reset();
+            image_ = std::exchange(other.image_, nullptr);
+            resource_ = std::exchange(other.resource_, nullptr);
+        }
+        return *this;
+    }
+    Image(const Image&) = delete;
+    Image& operator=(const Image&) = delete;
+    ~Image() { reset(); }
+
+    explicit operator bool() const noexcept { return image_ != nullptr; }
+    /* For C functions taking const OpenF_Image* or modifying pixels in place; ownership stays here */
+    OpenF_Image* get() const noexcept { return image_; }
+    unsigned int width() const noexcept { return image_ ? image_->width : 0; }
+    unsigned int height() const noexcept { return image_ ? image_->height : 0; }
+    OpenF_PixelFormat format() const noexcept { return image_ ? image_->format : OPENF_FORMAT_RGB24; }
+    unsigned char* pixels() const noexcept { return image_ ? image_->pixels : nullptr; }
+    std::size_t byte_size() const noexcept {
+        return image_ ? openf_image_buffer_size(image_->width, image_->height, image_->format) : 0;
+    }
+#if defined(__cpp_lib_span)
+    std::span<std::byte> bytes() const noexcept { return {reinterpret_cast<std::byte*>(pixels()), byte_size()}; }
+#endif
+
+    /* Hand a malloc'd image back to the C API (free with openf_free_image); nullptr for pmr images */
+    OpenF_Image* release() noexcept { return resource_ ? nullptr : std::exchange(image_, nullptr); }
+
+    void reset() noexcept {
+        if (image_ && resource_) {
+            resource_->deallocate(image_->pixels, byte_size(), 64);
+            resource_->deallocate(image_, sizeof(OpenF_Image), alignof(OpenF_Image));
+        } else if (image_) {
+            openf_free_image(&image_);
+        }
+        image_ = nullptr;
+        resource_ = nullptr;
+    }
+
+  private:
+    friend OpenF_Error create_image(unsigned int width, unsigned int height, OpenF_PixelFormat format, Image& out,
+                                    std::pmr::memory_resource* resource);
+
+    OpenF_Image* image_ = nullptr;
+    std::pmr::memory_resource* resource_ = nullptr;
+};
+
+/* Allocate an uninitialized image, from resource when given */
+inline OpenF_Error create_image(unsigned int width, unsigned int height, OpenF_PixelFormat format, Image& out,
+                                std::pmr::memory_resource* resource = nullptr) {
+    out.reset();
+    if (!resource) {
+        OpenF_Image* raw = nullptr;
+        OpenF_Error err = openf_create_image(width, height, format, &raw);
+        if (err == OPENF_OK) out = Image(raw);
+        return err;
+    }
+    std::size_t bytes = openf_image_buffer_size(width, height, format);
+    if (width == 0 || height == 0 || bytes == 0) return OPENF_ERR_INVALID_ARG;
+    OpenF_Image shape{width, height, nullptr, format};
+    OpenF_Image* image = nullptr;
+    try {
+        image = static_cast<OpenF_Image*>(resource->allocate(sizeof(OpenF_Image), alignof(OpenF_Image)));
+        *image = shape;
+        image->pixels = static_cast<unsigned char*>(resource->allocate(bytes, 64));
+    } catch (...) {
+        if (image) resource->deallocate(image, sizeof(OpenF_Image), alignof(OpenF_Image));
+        return OPENF_ERR_MEM_ALLOC;
+    }
+    out.image_ = image;
+    out.resource_ = resource;
+    return OPENF_OK;
+}
+
+inline OpenF_Error load_bmp(const char* path, Image& out) {
+    out.reset();
+    OpenF_Image* raw = nullptr;
+    OpenF_Error err = openf_load_bmp(path, &raw);
+    if (err == OPENF_OK) out = Image(raw);
+    return err;
+}
+
+inline OpenF_Error save_bmp(const char* path, const Image& image) { return openf_save_bmp(path, image.get()); }
+
+/* Read-only mapping of a whole file (contents are read into memory where mmap is unavailable) */
+class MappedFile {
+  public:
+    MappedFile() noexcept = default;
+    MappedFile(MappedFile&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+          mapped_(std::exchange(other.mapped_, false)), fallback_(std::move(other.fallback_)) {}
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            reset();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            mapped_ = std::exchange(other.mapped_, false);
+            fallback_ = std::move(other.fallback_);
+        }
+        return *this;
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { reset(); }
+
+    OpenF_Error open(const char* path) {
+        reset();
+        if (!path) return OPENF_ERR_NULL_ARG;
+#if OPENF_POSIX
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return OPENF_ERR_OPEN_FAILED;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return OPENF_ERR_SEEK_FAILED;
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ > 0) {
+            void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (map == MAP_FAILED) {
+                ::close(fd);
+                size_ = 0;
+                return OPENF_ERR_READ_FAILED;
+            }
+            data_ = static_cast<const char*>(map);
+            mapped_ = true;
+        }
+        ::close(fd);
+        return OPENF_OK;
+#else
+        OpenF_Error err = read(path, fallback_);
+        data_ = fallback_.data();
+        size_ = fallback_.size();
+        return err;
+#endif
+    }
+
+    const char* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    std::string_view str() const noexcept { return std::string_view(data_ ? data_ : "", size_); }
+#if defined(__cpp_lib_span)
+    std::span<const std::byte> bytes() const noexcept { return {reinterpret_cast<const std::byte*>(data_), size_}; }
+#endif
+
+    void reset() noexcept {
+#if OPENF_POSIX
+        if (mapped_) munmap(const_cast<char*>(data_), size_);
+#endif
+        fallback_.reset();
+        data_ = nullptr;
+        size_ = 0;
+        mapped_ = false;
+    }
+
+  private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool mapped_ = false;
+    File fallback_;
+};
+
+}  // namespace openf
+
+/*-----------------------------------
+  Pixel kernels
+------------------------------------*/
+
+namespace openf {
+namespace pixel {
+
+/* Format tags: bytes per pixel and the byte offset of each channel (-1 = absent) */
+struct RGB24 {
+    static constexpr OpenF_PixelFormat format = OPENF_FORMAT_RGB24;
+    static constexpr int bytes = 3, r = 0, g = 1, b = 2, a = -1;
+    static constexpr bool gray = false;
+};
+
+struct BGR24 {
+    static constexpr OpenF_PixelFormat format = OPENF_FORMAT_BGR24;
+    static constexpr int bytes = 3, r = 2, g = 1, b = 0, a = -1;
+    static constexpr bool gray = false;
+};
+
+struct RGBA32 {
+    static constexpr OpenF_PixelFormat format = OPENF_FORMAT_RGBA32;
+    static constexpr int bytes = 4, r = 0, g = 1, b = 2, a = 3;
+    static constexpr bool gray = false;
+};
+
+struct GRAY8 {
+    static constexpr OpenF_PixelFormat format = OPENF_FORMAT_GRAY8;
+    static constexpr int bytes = 1, r = 0, g = 0, b = 0, a = -1;
+    static constexpr bool gray = true;
+};
+
+/* Row order of the destination relative to the source */
+struct TopDown {
+    static constexpr bool flip = false;
+};
+
+struct BottomUp {
+    static constexpr bool flip = true;
+};
+
+/* Convert one row; every branch is resolved at compile time, leaving a straight per-pixel copy */
+template <typename Src, typename Dst>
+inline void convert_row(const unsigned char* OPENF_RESTRICT src, unsigned char* OPENF_RESTRICT dst, unsigned int width) noexcept {
+    if constexpr (std::is_same_v<Src, Dst>) {
+        std::memcpy(dst, src, static_cast<std::size_t>(width) * Src::bytes);
+    } else {
+        for (unsigned int x = 0; x < width; x++, src += Src::bytes, dst += Dst::bytes) {
+            if constexpr (Dst::gray && !Src::gray) {
+                dst[0] = static_cast<unsigned char>((77 * src[Src::r] + 150 * src[Src::g] + 29 * src[Src::b] + 128) >> 8);
+            } else if constexpr (Dst::gray) {
+                dst[0] = src[0];
+            } else {
+                dst[Dst::r] = src[Src::r];
+                dst[Dst::g] = src[Src::g];
+                dst[Dst::b] = src[Src::b];
+                if constexpr (Dst::a >= 0) {
+                    if constexpr (Src::a >= 0) {
+                        dst[Dst::a] = src[Src::a];
+                    } else {
+                        dst[Dst::a] = 255;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* Convert height rows; BottomUp writes the first source row to the last destination row */
+template <typename Src, typename Dst, typename Orientation = TopDown>
+inline void convert_rows(const unsigned char* src, std::ptrdiff_t src_stride, unsigned char* dst, std::ptrdiff_t dst_stride,
+                         unsigned int width, unsigned int height) noexcept {
+    if constexpr (Orientation::flip) {
+        dst += static_cast<std::ptrdiff_t>(height - 1) * dst_stride;
+        dst_stride = -dst_stride;
+    }
+    for (unsigned int y = 0; y < height; y++, src += src_stride, dst += dst_stride) convert_row<Src, Dst>(src, dst, width);
+}
+
+namespace detail {
+
+template <typename Src, typename Orientation>
+inline bool convert_from(OpenF_PixelFormat dst_format, const unsigned char* src, unsigned char* dst, unsigned int width,
+                         unsigned int height) noexcept {
+    std::ptrdiff_t src_stride = static_cast<std::ptrdiff_t>(width) * Src::bytes;
+    switch (dst_format) {
+        case OPENF_FORMAT_RGB24:
+            convert_rows<Src, RGB24, Orientation>(src, src_stride, dst, static_cast<std::ptrdiff_t>(width) * 3, width, height);
+            return true;
+        case OPENF_FORMAT_BGR24:
+            convert_rows<Src, BGR24, Orientation>(src, src_stride, dst, static_cast<std::ptrdiff_t>(width) * 3, width, height);
+            return true;
+        case OPENF_FORMAT_RGBA32:
+            convert_rows<Src, RGBA32, Orientation>(src, src_stride, dst, static_cast<std::ptrdiff_t>(width) * 4, width, height);
+            return true;
+        case OPENF_FORMAT_GRAY8:
+            convert_rows<Src, GRAY8, Orientation>(src, src_stride, dst, static_cast<std::ptrdiff_t>(width), width, height);
+            return true;
+        default:
+            return false;
+    }
+}
+
+template <typename Orientation>
+inline bool convert_packed(OpenF_PixelFormat src_format, OpenF_PixelFormat dst_format, const unsigned char* src,
+                           unsigned char* dst, unsigned int width, unsigned int height) noexcept {
+    switch (src_format) {
+        case OPENF_FORMAT_RGB24:
+            return convert_from<RGB24, Orientation>(dst_format, src, dst, width, height);
+        case OPENF_FORMAT_BGR24:
+            return convert_from<BGR24, Orientation>(dst_format, src, dst, width, height);
+        case OPENF_FORMAT_RGBA32:
+            return convert_from<RGBA32, Orientation>(dst_format, src, dst, width, height);
+        case OPENF_FORMAT_GRAY8:
+            return convert_from<GRAY8, Orientation>(dst_format, src, dst, width, height);
+        default:
+            return false;
+    }
+}
+
+}  // namespace detail
+}  // namespace pixel
+
+/* Convert between the packed formats (RGB24, BGR24, RGBA32, GRAY8), optionally flipping vertically, by
+   dispatching once to the matching convert_rows instantiation */
+inline OpenF_Error convert(const Image& src, OpenF_PixelFormat format, Image& out, bool flip_vertical = false,
+                           std::pmr::memory_resource* resource = nullptr) {
+    if (!src) return OPENF_ERR_NULL_ARG;
+    if (&src == &out) return OPENF_ERR_INVALID_ARG;
+    Image result;
+    OpenF_Error err = create_image(src.width(), src.height(), format, result, resource);
+    if (err != OPENF_OK) return err;
+    bool ok = flip_vertical ? pixel::detail::convert_packed<pixel::BottomUp>(src.format(), format, src.pixels(), result.pixels(),
+                                                                             src.width(), src.height())
+                            : pixel::detail::convert_packed<pixel::TopDown>(src.format(), format, src.pixels(), result.pixels(),
+                                                                            src.width(), src.height());
+    if (!ok) return OPENF_ERR_UNSUPPORTED;
+    out = std::move(result);
+    return OPENF_OK;
+}
+
+}  // namespace openf
+
+/*-----------------------------------
+  Coroutines (C++20)
+------------------------------------*/
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+
+namespace openf {
+
+/* Value plus the OpenF_Error that produced it; value is only meaningful when error == OPENF_OK */
+template <typename T>
+struct result {
+    OpenF_Error error;
+    T value;
+
+    explicit operator bool() const noexcept { return error == OPENF_OK; }
+};
+
+namespace detail {
+
+/* Coroutine frames are recycled through per-thread free lists in 64-byte size classes (up to 2 KB). Frames
+   often finish on a scheduler worker rather than the thread that created them, so a full local list spills
+   into a shared one instead of freeing. */
+constexpr std::size_t frame_granule = 64;
+constexpr std::size_t frame_classes = 32;
+constexpr std::size_t frame_local_limit = 64;
+
+struct frame_block {
+    frame_block* next;
+};
+
+struct frame_shared {
+    std::mutex lock;
+    frame_block* lists[frame_classes] = {};
+};
+
+inline frame_shared& shared_frames() {
+    static frame_shared shared;
+    return shared;
+}
+
+struct frame_cache {
+    frame_block* lists[frame_classes] = {};
+    std::size_t counts[frame_classes] = {};
+
+    ~frame_cache() {
+        for (std::size_t c = 0; c < frame_classes; c++) {
+            while (frame_block* b = lists[c]) {
+                lists[c] = b->next;
+                ::operator delete(b);
+            }
+        }
+    }
+};
+
+inline frame_cache& local_frames() {
+    thread_local frame_cache cache;
+    return cache;
+}
+
+inline void* frame_allocate(std::size_t size) {
+    std::size_t c = (size + frame_granule - 1) / frame_granule;
+    if (c >= frame_classes) return ::operator new(size);
+    frame_cache& local = local_frames();
+    if (frame_block* b = local.lists[c]) {
+        local.lists[c] = b->next;
+        local.counts[c]--;
+        return b;
+    }
+    frame_shared& shared = shared_frames();
+    {
+        std::lock_guard<std::mutex> guard(shared.lock);
+        if (frame_block* b = shared.lists[c]) {
+            shared.lists[c] = b->next;
+            return b;
+        }
+    }
+    return ::operator new(c * frame_granule);
+}
+
+inline void frame_deallocate(void* p, std::size_t size) noexcept {
+    std::size_t c = (size + frame_granule - 1) / frame_granule;
+    if (c >= frame_classes) {
+        ::operator delete(p);
+        return;
+    }
+    frame_block* b = static_cast<frame_block*>(p);
+    frame_cache& local = local_frames();
+    if (local.counts[c] < frame_local_limit) {
+        b->next = local.lists[c];
+        local.lists[c] = b;
+        local.counts[c]++;
+        return;
+    }
+    frame_shared& shared = shared_frames();
+    std::lock_guard<std::mutex> guard(shared.lock);
+    b->next = shared.lists[c];
+    shared.lists[c] = b;
+}
+
+struct promise_base {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr exception;
+
+    static void* operator new(std::size_t size) { return frame_allocate(size); }
+    static void operator delete(void* p, std::size_t size) noexcept { frame_deallocate(p, size); }
+
+    struct final_awaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            return h.promise().continuation;  // Symmetric transfer back to whoever awaited us
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct task_promise;
+
+}  // namespace detail
+
+/* Lazily started coroutine: runs when awaited (or passed to sync_wait) and resumes its awaiter on completion */
+template <typename T = void>
+class task {
+  public:
+    using promise_type = detail::task_promise<T>;
+
+    task(task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    task& operator=(task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+    ~task() {
+        if (handle_) handle_.destroy();
+    }
+
+    auto operator co_await() && noexcept {
+        struct awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return !handle || handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() {
+                if (handle.promise().exception) std::rethrow_exception(handle.promise().exception);
+                if constexpr (!std::is_void_v<T>) return std::move(*handle.promise().value);
+            }
+        };
+        return awaiter{handle_};
+    }
+
+  private:
+    friend promise_type;
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <typename T>
+struct task_promise : promise_base {
+    std::optional<T> value;
+
+    task<T> get_return_object() noexcept { return task<T>(std::coroutine_handle<task_promise>::from_promise(*this)); }
+    template <typename U>
+    void return_value(U&& v) {
+        value.emplace(std::forward<U>(v));
+    }
+};
+
+template <>
+struct task_promise<void> : promise_base {
+    task<void> get_return_object() noexcept { return task<void>(std::coroutine_handle<task_promise>::from_promise(*this)); }
+    void return_void() const noexcept {}
+};
+
+/* Awaits an OpenF_Future: suspends until its completion callback fires, then resumes on the completing
+   worker. The future is released when the awaiter goes away. */
+class future_awaiter {
+  public:
+    future_awaiter(OpenF_Error start_error, OpenF_Future* future) noexcept : error_(start_error), future_(future) {}
+    future_awaiter(const future_awaiter&) = delete;
+    future_awaiter& operator=(const future_awaiter&) = delete;
+    ~future_awaiter() {
+        if (future_) openf_future_release(future_);
+    }
+
+    bool await_ready() const noexcept { return error_ != OPENF_OK || openf_future_poll(future_); }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept {
+        handle_ = handle;
+        openf_future_then(future_, &future_awaiter::on_complete, this);
+        // Whichever of us and the callback arrives second does the resuming
+        return state_.exchange(1, std::memory_order_acq_rel) == 0;
+    }
+
+  protected:
+    OpenF_Error finish() noexcept { return error_ != OPENF_OK ? error_ : openf_future_wait(future_); }
+
+    OpenF_Error error_;
+    OpenF_Future* future_;
+
+  private:
+    static void on_complete(OpenF_Future*, void* user) {
+        future_awaiter* self = static_cast<future_awaiter*>(user);
+        if (self->state_.exchange(1, std::memory_order_acq_rel) == 1) self->handle_.resume();
+    }
+
+    std::coroutine_handle<> handle_;
+    std::atomic<int> state_{0};
+};
+
+struct status_awaiter : future_awaiter {
+    using future_awaiter::future_awaiter;
+    OpenF_Error await_resume() noexcept { return finish(); }
+};
+
+struct file_awaiter : future_awaiter {
+    using future_awaiter::future_awaiter;
+    result<OpenF_File> await_resume() noexcept {
+        result<OpenF_File> r{finish(), {nullptr, 0}};
+        if (r.error == OPENF_OK) r.error = openf_future_take_file(future_, &r.value);
+        return r;
+    }
+};
+
+struct image_awaiter : future_awaiter {
+    using future_awaiter::future_awaiter;
+    result<OpenF_Image*> await_resume() noexcept {
+        result<OpenF_Image*> r{finish(), nullptr};
+        if (r.error == OPENF_OK) r.error = openf_future_take_image(future_, &r.value);
+        return r;
+    }
+};
+
+/* Drives a task to completion for sync_wait and signals the blocked caller */
+struct sync_signal {
+    std::mutex lock;
+    std::condition_variable cv;
+    bool done = false;
+};
+
+struct sync_driver {
+    struct promise_type {
+        sync_signal* signal = nullptr;
+
+        static void* operator new(std::size_t size) { return frame_allocate(size); }
+        static void operator delete(void* p, std::size_t size) noexcept { frame_deallocate(p, size); }
+
+        sync_driver get_return_object() noexcept { return sync_driver{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        auto final_suspend() const noexcept {
+            struct notifier {
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<promise_type> h) const noexcept {
+                    // Notify under the lock so the waiter cannot destroy the signal before we are done with it
+                    sync_signal* s = h.promise().signal;
+                    std::lock_guard<std::mutex> guard(s->lock);
+                    s->done = true;
+                    s->cv.notify_one();
+                }
+                void await_resume() const noexcept {}
+            };
+            return notifier{};
+        }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+sync_driver drive(task<T>& t, std::optional<T>& out, std::exception_ptr& error) {
+    try {
+        out.emplace(co_await std::move(t));
+    } catch (...) {
+        error = std::current_exception();
+    }
+}
+
+inline sync_driver drive(task<void>& t, std::exception_ptr& error) {
+    try {
+        co_await std::move(t);
+    } catch (...) {
+        error = std::current_exception();
+    }
+}
+
+inline void run_driver(sync_driver driver) {
+    sync_signal signal;
+    driver.handle.promise().signal = &signal;
+    driver.handle.resume();
+    {
+        std::unique_lock<std::mutex> guard(signal.lock);
+        signal.cv.wait(guard, [&] { return signal.done; });
+    }
+    driver.handle.destroy();
+}
+
+}  // namespace detail
+
+/* Run a task from ordinary code and block until it finishes (do not call from a scheduler worker) */
+template <typename T>
+T sync_wait(task<T> t) {
+    std::optional<T> out;
+    std::exception_ptr error;
+    detail::run_driver(detail::drive(t, out, error));
+    if (error) std::rethrow_exception(error);
+    return std::move(*out);
+}
+
+inline void sync_wait(task<void> t) {
+    std::exception_ptr error;
+    detail::run_driver(detail::drive(t, error));
+    if (error) std::rethrow_exception(error);
+}
+
+/* co_await openf::schedule() moves the coroutine onto a scheduler worker (no-op without openf_init_ex) */
+inline auto schedule() noexcept {
+    struct awaiter {
+        OpenF__Task entry;
+
+        bool await_ready() const noexcept {
+#if OPENF_THREADS
+            return !openf__scheduler_running();
+#else
+            return true;
+#endif
+        }
+        void await_suspend(std::coroutine_handle<> handle) noexcept {
+            entry.fn = [](void* address) { std::coroutine_handle<>::from_address(address).resume(); };
+            entry.ctx = handle.address();
+            entry.group = nullptr;
+            entry.next = nullptr;
+            entry.heap = 0;
+            openf__submit_task(&entry);
+        }
+        void await_resume() const noexcept {}
+    };
+    return awaiter{};
+}
+
+/* Awaitable operations: each starts at the call and yields its result when awaited, e.g.
+   auto [err, file] = co_await openf::read("data.bin");
+   Like the _async functions they need openf_init_ex; without it they yield OPENF_ERR_UNSUPPORTED. */
+inline detail::file_awaiter read(const char* path) {
+    OpenF_Future* future = nullptr;
+    OpenF_Error err = openf_read_async(path, &future);
+    return detail::file_awaiter(err, future);
+}
+
+/* data must stay valid until the write is awaited */
+inline detail::status_awaiter write(const char* path, const char* data, std::size_t size) {
+    OpenF_Future* future = nullptr;
+    OpenF_Error err = openf_write_async(path, data, size, &future);
+    return detail::status_awaiter(err, future);
+}
+
+inline detail::status_awaiter copy(const char* src, const char* dest) {
+    OpenF_Future* future = nullptr;
+    OpenF_Error err = openf_copy_file_async(src, dest, &future);
+    return detail::status_awaiter(err, future);
+}
+
+inline detail::image_awaiter load_bmp(const char* path) {
+    OpenF_Future* future = nullptr;
+    OpenF_Error err = openf_load_bmp_async(path, &future);
+    return detail::image_awaiter(err, future);
+}
+
+/* image must stay valid until the save is awaited */
+inline detail::status_awaiter save_bmp(const char* path, const OpenF_Image* image) {
+    OpenF_Future* future = nullptr;
+    OpenF_Error err = openf_save_bmp_async(path, image, &future);
+    return detail::status_awaiter(err, future);
+}
+
+}  // namespace openf
+
+#endif  // __cpp_impl_coroutine
+
+#endif  // OPENF_HPP